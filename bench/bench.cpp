@@ -0,0 +1,31 @@
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string_view>
+
+#include "bench_alloc.h"
+#include "bench_cfg.h"
+#include "bench_codegen.h"
+#include "bench_module.h"
+#include "bench_tokenizer.h"
+
+void* operator new(std::size_t size) {
+    bench::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+//`eraxc_bench [tokenizer|cfg|codegen|module]` runs only the named benchmark, all of them by default
+int main(int argc, char* argv[]) {
+    const std::string_view only = argc > 1 ? argv[1] : "";
+    auto selected = [&](std::string_view name) { return only.empty() || only == name; };
+    std::cout << "Running eraxc benchmarks...\n";
+    if (selected("tokenizer")) bench::bench_tokenizer();
+    if (selected("cfg")) bench::bench_cfg();
+    if (selected("codegen")) bench::bench_codegen();
+    if (selected("module")) bench::bench_module();
+    return 0;
+}
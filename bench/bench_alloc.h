@@ -0,0 +1,42 @@
+#ifndef ERAXC_BENCH_ALLOC_H
+#define ERAXC_BENCH_ALLOC_H
+
+#include <atomic>
+#include <cstddef>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+namespace bench {
+
+    /// Heap allocations made by the process so far, counted by global operator new replaced in bench.cpp
+    inline std::atomic<size_t> allocations = 0;
+
+    /// @return heap allocations made while `f` ran
+    template<typename F>
+    size_t allocations_of(F&& f) {
+        const size_t before = allocations;
+        f();
+        return allocations - before;
+    }
+
+    /// Peak resident set size of the process so far, in kilobytes. It never goes down, so benchmark memory is
+    /// compared by running it alone, e.g. `eraxc_bench cfg`
+    inline size_t peak_rss_kb() {
+        #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters {};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize >> 10;
+        #else
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        return size_t(usage.ru_maxrss);
+        #endif
+    }
+}
+
+#endif  //ERAXC_BENCH_ALLOC_H
@@ -0,0 +1,101 @@
+#ifndef ERAXC_BENCH_CFG_H
+#define ERAXC_BENCH_CFG_H
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "bench_alloc.h"
+#include "bench_tokenizer.h"
+#include "../src/backend/JIR/CFG/CFG.h"
+#include "../src/frontend/lexic/token_stream.h"
+
+namespace bench {
+
+    /// Generates program of `functions` functions the CFG builder can parse
+    inline std::string synthetic_program(size_t functions) {
+        std::string src = "i64 global_counter = 2l;\n\n";
+        for (size_t f = 0; f < functions; f++) {
+            std::string n = std::to_string(f);
+            src += "u64 function_" + n + "(u64 first_argument, u64 second_argument) {\n";
+            src += "    u64 accumulator = first_argument + 3ul;\n";
+            src += "    accumulator += second_argument * 2ul;\n";
+            src += "    if (accumulator > 10ul) {\n        accumulator -= 1ul;\n    } else accumulator = first_argument;\n";
+            src += "    u64 result = (accumulator + 1ul) * 256ul / (second_argument + 1ul);\n";
+            src += "    return result;\n}\n\n";
+        }
+        src += "int main() {\n    return 0i;\n}\n";
+        return src;
+    }
+
+    inline int bench_cfg(size_t functions = 20000, int runs = 5) {
+        const std::string source = synthetic_program(functions);
+        eraxc::tokenizer t {};
+        std::stringstream ss {source};
+        auto tokens = t.tokenize(ss);
+        if (!tokens) {
+            std::cout << "cfg: failed to tokenize synthetic program: " << tokens.error << '\n';
+            return -1;
+        }
+
+        std::string error {};
+        double seconds = best_of(runs, [&] {
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create(tokens.value);
+            if (!r) error = r.message();
+        });
+        if (!error.empty()) {
+            std::cout << "cfg: failed to build CFG of synthetic program: " << error << '\n';
+            return -1;
+        }
+
+        eraxc::arena::statistics arena {};
+        const size_t allocated = allocations_of([&] {
+            eraxc::JIR::CFG cfg {};
+            cfg.create(tokens.value);
+            arena = cfg.memory_stats();
+        });
+        const size_t peak_rss = peak_rss_kb();
+
+        const double token_count = double(tokens.value.size());
+        std::cout << "cfg: " << functions << " functions, " << tokens.value.size() << " tokens\n";
+        std::cout << "  CFG::create: " << seconds * 1000 << "ms, " << seconds * 1e9 / token_count << "ns/token, "
+                  << double(allocated) / token_count << " allocations/token, " << allocated << " allocations, "
+                  << peak_rss / 1024 << "MB peak RSS\n";
+        std::cout << "  arena: " << arena.allocations << " allocations, " << (arena.bytes >> 20) << "MB requested, "
+                  << (arena.chunk_bytes >> 20) << "MB in " << arena.chunks << " chunks\n";
+
+        //whole file lexed first vs lexer thread streaming tokens to parser
+        const auto path = std::filesystem::temp_directory_path() / "eraxc_bench_cfg.erx";
+        std::ofstream {path} << source;
+        double sequential = best_of(runs, [&] {
+            eraxc::tokenizer file_tokenizer {};
+            auto file_tokens = file_tokenizer.tokenize_file(path.string());
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create(file_tokens.value);
+            if (!r) error = r.message();
+        });
+        double streamed = best_of(runs, [&] {
+            eraxc::tokenizer file_tokenizer {};
+            eraxc::token_stream stream {};
+            std::thread lexer {eraxc::tokenize_file_to_stream, std::ref(file_tokenizer), path.string(),
+                               std::ref(stream)};
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create(stream);
+            stream.abandon();
+            lexer.join();
+            if (!r) error = r.message();
+        });
+        std::filesystem::remove(path);
+        if (!error.empty()) {
+            std::cout << "cfg: failed to build CFG of synthetic program file: " << error << '\n';
+            return -1;
+        }
+        std::cout << "  tokenize_file + CFG::create: " << sequential * 1000 << "ms\n";
+        std::cout << "  streamed (lexer thread, " << eraxc::token_stream::DEFAULT_CAPACITY
+                  << " tokens ring): " << streamed * 1000 << "ms\n";
+        return 0;
+    }
+}
+
+#endif  //ERAXC_BENCH_CFG_H
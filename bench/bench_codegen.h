@@ -0,0 +1,61 @@
+#ifndef ERAXC_BENCH_CODEGEN_H
+#define ERAXC_BENCH_CODEGEN_H
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "bench_cfg.h"
+#include "../src/backend/codegen/asm_parallel.h"
+
+namespace bench {
+
+    /// Whole file pipeline: sequential tokenize -> CFG -> asm vs streamed lexer and per-function translation on pool
+    inline int bench_codegen(size_t functions = 20000, int runs = 3) {
+        const auto path = std::filesystem::temp_directory_path() / "eraxc_bench_codegen.erx";
+        const auto asm_path = std::filesystem::temp_directory_path() / "eraxc_bench_codegen.asm";
+        std::ofstream {path} << synthetic_program(functions);
+
+        std::string error {};
+        double sequential = best_of(runs, [&] {
+            eraxc::tokenizer t {};
+            auto tokens = t.tokenize_file(path.string());
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create(tokens.value);
+            if (!r) error = r.message();
+            eraxc::asm_translator<eraxc::X64> asmt {};
+            auto a = asmt.translate(cfg, asm_path.string());
+            if (!a) error = a.message();
+        });
+
+        std::cout << "codegen: " << functions << " functions\n";
+        std::cout << "  sequential tokenize + CFG + asm: " << sequential * 1000 << "ms\n";
+        for (size_t threads = 1; threads <= std::max(1u, std::thread::hardware_concurrency()); threads *= 2) {
+            double pipelined = best_of(runs, [&] {
+                eraxc::thread_pool pool {threads};
+                eraxc::parallel_asm_translator<eraxc::X64> asmt {pool};
+                eraxc::tokenizer t {};
+                eraxc::token_stream stream {};
+                std::thread lexer {eraxc::tokenize_file_to_stream, std::ref(t), path.string(), std::ref(stream)};
+                eraxc::JIR::CFG cfg {};
+                asmt.attach(cfg);
+                auto r = cfg.create(stream);
+                stream.abandon();
+                lexer.join();
+                if (!r) error = r.message();
+                auto a = asmt.write(cfg, asm_path.string());
+                if (!a) error = a.message();
+            });
+            std::cout << "  pipelined, " << threads << " codegen threads: " << pipelined * 1000 << "ms\n";
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(asm_path);
+        if (!error.empty()) {
+            std::cout << "codegen: failed to compile synthetic program: " << error << '\n';
+            return -1;
+        }
+        return 0;
+    }
+}
+
+#endif  //ERAXC_BENCH_CODEGEN_H
@@ -0,0 +1,74 @@
+#ifndef ERAXC_BENCH_MODULE_H
+#define ERAXC_BENCH_MODULE_H
+
+#include <filesystem>
+#include <fstream>
+
+#include "bench_cfg.h"
+#include "../src/backend/JIR/module_image.h"
+
+namespace bench {
+
+    /// Small file using a large shared one: reparsing shared source vs importing its module image
+    inline int bench_module(size_t functions = 20000, int runs = 5) {
+        const std::string program = synthetic_program(functions);
+        const size_t main_pos = program.find("int main()");
+        const auto dir = std::filesystem::temp_directory_path();
+        const auto shared_path = dir / "eraxc_bench_module.erx";
+        const auto image_path = dir / "eraxc_bench_module.jirm";
+        const auto main_path = dir / "eraxc_bench_module_main.erx";
+        std::ofstream {shared_path} << program.substr(0, main_pos);
+        std::ofstream {main_path} << program.substr(main_pos);
+
+        std::string error {};
+        double reparsed = best_of(runs, [&] {
+            eraxc::tokenizer t {};
+            auto shared = t.tokenize_file(shared_path.string());
+            auto main = t.tokenize_file(main_path.string());
+            shared.value.insert(shared.value.end(), main.value.begin(), main.value.end());
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create(shared.value);
+            if (!r) error = r.message();
+        });
+
+        double written = best_of(1, [&] {
+            eraxc::tokenizer t {};
+            auto shared = t.tokenize_file(shared_path.string());
+            eraxc::token_stream stream {shared.value};
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.create_module(stream);
+            if (!r) error = r.message();
+            else if (auto w = eraxc::JIR::write_module(cfg, image_path.string()); !w) error = w.error;
+        });
+
+        double imported = best_of(runs, [&] {
+            eraxc::JIR::module_image image {};
+            auto mapped = image.map(image_path.string());
+            if (!mapped) {
+                error = mapped.error;
+                return;
+            }
+            eraxc::tokenizer t {};
+            auto main = t.tokenize_file(main_path.string());
+            eraxc::JIR::CFG cfg {};
+            auto r = cfg.import_module(image);
+            if (r) r = cfg.create(main.value);
+            if (!r) error = r.message();
+        });
+
+        const auto image_size = std::filesystem::file_size(image_path);
+        for (const auto& path : {shared_path, image_path, main_path}) std::filesystem::remove(path);
+        if (!error.empty()) {
+            std::cout << "module: failed to build CFG: " << error << '\n';
+            return -1;
+        }
+
+        std::cout << "module: " << functions << " shared functions, image of " << image_size / 1024 << "KiB\n";
+        std::cout << "  write_module: " << written * 1000 << "ms\n";
+        std::cout << "  reparse shared source: " << reparsed * 1000 << "ms\n";
+        std::cout << "  import module image: " << imported * 1000 << "ms\n";
+        return 0;
+    }
+}
+
+#endif  //ERAXC_BENCH_MODULE_H
@@ -0,0 +1,103 @@
+#ifndef ERAXC_BENCH_TOKENIZER_H
+#define ERAXC_BENCH_TOKENIZER_H
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "../src/frontend/lexic/preprocessor_tokenizer.h"
+
+namespace bench {
+
+    /// Generates synthetic .erx source of at least `bytes` bytes
+    inline std::string synthetic_erx(size_t bytes) {
+        std::string src;
+        src.reserve(bytes + 1024);
+        src += "#define BENCH_WIDTH 64ul\n";
+        for (size_t f = 0; src.size() < bytes; f++) {
+            std::string n = std::to_string(f);
+            src += "// ---------------------------------------------------------------- function " + n + '\n';
+            src += "u64 generated_function_name_" + n + "(u64 first_argument, u64 second_argument) {\n";
+            src += "    u64 accumulator_value_" + n + " = first_argument * 3ul + second_argument;\n";
+            src += "    if (accumulator_value_" + n + " >= BENCH_WIDTH) {\n";
+            src += "        accumulator_value_" + n + " += (first_argument << 2ul) % 17ul;\n";
+            src += "    } else accumulator_value_" + n + " -= 1ul;\n";
+            src += "    return accumulator_value_" + n + ";\n}\n\n";
+        }
+        return src;
+    }
+
+    /// Generates source shaped like machine-generated code: long identifiers, deep indentation and comment banners
+    inline std::string synthetic_generated_erx(size_t bytes) {
+        std::string src;
+        src.reserve(bytes + 1024);
+        const std::string banner(78, '=');
+        for (size_t f = 0; src.size() < bytes; f++) {
+            std::string n = std::to_string(f);
+            src += "//" + banner + "\n// generated block " + n + "\n//" + banner + '\n';
+            src += "                u64 machine_generated_accumulator_identifier_" + n +
+                   " = machine_generated_input_parameter_value_" + n + " + 1ul;\n";
+        }
+        return src;
+    }
+
+    template<typename F>
+    double best_of(int runs, F&& f) {
+        double best = 1e300;
+        for (int r = 0; r < runs; r++) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            f();
+            auto t2 = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double>(t2 - t1).count());
+        }
+        return best;
+    }
+
+    inline void bench_tokenizer_file(const std::string& name, const std::string& source, int runs) {
+        const auto path = std::filesystem::temp_directory_path() / "eraxc_bench_tokenizer.erx";
+        {
+            std::ofstream f {path, std::ios::binary};
+            f << source;
+        }
+        const double mb = double(source.size()) / (1024.0 * 1024.0);
+
+        size_t count = 0;
+        auto view_mode = [&](eraxc::lexic::simd_level level) {
+            return best_of(runs, [&] {
+                eraxc::tokenizer t {};
+                t.set_simd_level(level);
+                auto r = t.tokenize_file_view(path.string());
+                count = r.value.size();
+            });
+        };
+        auto report = [&](const char* mode, double seconds) {
+            std::cout << "  " << mode << mb / seconds << " MB/s (" << seconds * 1000 << "ms)\n";
+        };
+
+        double scalar = view_mode(eraxc::lexic::simd_level::SCALAR);
+        double sse2 = view_mode(eraxc::lexic::simd_level::SSE2);
+        double avx2 = view_mode(eraxc::lexic::simd_level::AVX2);
+        double owning = best_of(runs, [&] {
+            eraxc::tokenizer t {};
+            auto r = t.tokenize_file(path.string());
+            count = r.value.size();
+        });
+
+        std::cout << "tokenizer, " << name << ": " << mb << " MB, " << count << " tokens\n";
+        report("tokenize_file_view (scalar): ", scalar);
+        report("tokenize_file_view (sse2):   ", sse2);
+        report("tokenize_file_view (avx2):   ", avx2);
+        report("tokenize_file:               ", owning);
+
+        std::filesystem::remove(path);
+    }
+
+    inline int bench_tokenizer(size_t bytes = 16u << 20, int runs = 5) {
+        bench_tokenizer_file("handwritten-like", synthetic_erx(bytes), runs);
+        bench_tokenizer_file("generated-like", synthetic_generated_erx(bytes), runs);
+        return 0;
+    }
+}
+
+#endif  //ERAXC_BENCH_TOKENIZER_H
@@ -1,8 +1,13 @@
 #include "CFG.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <limits>
 
 #include "errors.h"
+#include "passes.h"
+#include "../module_image.h"
 #include "../../scope.h"
 #include "../utils.h"
 
@@ -10,47 +15,181 @@
 
 namespace eraxc::JIR {
 
-    error::errable<void> CFG::create(const std::vector<token>& tokens) {
-        int i = 0;
-        size_t global_node_id = nodes.size();
-        nodes.emplace_back();
+    error::expected<void> CFG::create(const std::vector<token>& tokens) {
+        token_stream stream {tokens};
+        return create(stream);
+    }
+
+    error::expected<void> CFG::create(token_stream& tokens) {
+        auto globals = parse_globals(tokens);
+        edges.build(nodes.size());
+        if (!globals || diags.has_errors()) return diags.first_error();
+
+        //check for main() entrypoint
+        auto main_decl = scopeManager.findDeclaration(sym::MAIN);
+        if (!main_decl.isFunc() || main_decl.getType() != scopeManager.findTypeRecursive(sym::INT)) {
+            const auto no_entrypoint = error::fail(NO_ENTRYPOINT, NO_ENTRYPOINT_ERROR);
+            diags.report(diagnostics::severity::FATAL, no_entrypoint, {}, {});
+            return no_entrypoint;
+        }
+
+        scopeManager.dealloc_top(nodes[0].body);
+        terminate(0, {terminator::RETURN});
+
+        return {};
+    }
+
+    error::expected<void> CFG::create_module(token_stream& tokens) {
+        auto globals = parse_globals(tokens);
+        edges.build(nodes.size());
+        if (!globals || diags.has_errors()) return diags.first_error();
+        terminate(0, {terminator::RETURN});
+        return {};
+    }
+
+    void CFG::terminate(size_t node_id, terminator exit) {
+        auto& node = nodes[node_id];
+        if (node.exit.kind != terminator::NONE) return;
+        node.exit = exit;
+        //not taken branch first, as parser creates it first
+        if (exit.kind == terminator::BRANCH) edges.add(node_id, exit.next);
+        if (exit.kind == terminator::JUMP || exit.kind == terminator::BRANCH) edges.add(node_id, exit.target);
+    }
+
+    void CFG::report(diagnostics::severity level, const error::failure& what, token_stream& tokens,
+                     const token& begin, int i) {
+        const token end = tokens.readable(i) ? tokens[i] : begin;
+        if (failed_at.t == token::NONE) failed_at = end;
+        std::vector<diagnostics::note> notes {};
+        if (current_function.t != token::NONE) {
+            notes.push_back({error::fail("In function `{}`", current_function.sym), current_function});
+        }
+        diags.report(level, what, begin, end, std::move(notes));
+    }
+
+    void CFG::recover(token_stream& tokens, int& i) {
+        int depth = 0;
+        for (; tokens[i].t != token::NONE; i++) {
+            if (tokens[i].t == token::L_F_BRACKET) depth++;
+            else if (tokens[i].t == token::R_F_BRACKET) {
+                //`}` of the enclosing block is left for its parser
+                if (depth == 0) return;
+                if (--depth == 0) {
+                    i++;
+                    return;
+                }
+            } else if (tokens[i].t == token::SEMICOLON && depth == 0) {
+                i++;
+                return;
+            }
+        }
+    }
 
-        while (i < tokens.size()) {
+    error::expected<void> CFG::parse_globals(token_stream& tokens) {
+        int i = 0;
+        //global node may already hold initialization of imported modules
+        if (nodes.empty()) nodes.emplace_back();
+        size_t global_node_id = 0;
+
+        //parsers leave i where they failed. Declarations of globals aren't recovered from, so the failure is fatal
+        auto failed = [&](error::failure f) -> error::expected<void> {
+            const token end = tokens.readable(i) ? tokens[i] : token {};
+            report(diagnostics::severity::FATAL, f, tokens, end, i);
+            return f;
+        };
+        while (tokens[i].t != token::NONE) {
             if (tokens[i].t == token::IDENTIFIER && tokens[i + 1].t == token::IDENTIFIER) {
                 if (tokens[i + 2].t == token::L_BRACKET) {
                     //func decl
                     auto f = parse_function(tokens, i, global_node_id);
-                    if (!f) return {"Error while parsing a function declaration:\n" + f.error};
+                    if (!f) return failed(f.error().within("Error while parsing a function declaration:\n"));
                 } else {
                     //global var decl
                     auto f = parse_declaration(tokens, i, global_node_id);
-                    if (!f) return {"Error while parsing a variable declaration:\n" + f.error};
+                    if (!f) return failed(f.error().within("Error while parsing a variable declaration:\n"));
                 }
-            } else return {"Unknown statement: " + tokens[i].data};
+            } else return failed(error::fail(SYNTAX_ERROR, "Unknown statement: ", tokens[i].sym));
         }
-        //check for main() entrypoint
         if (scopeManager.size() != 1) {
-            return {"Something went wrong during compilation. Scopes count: " + std::to_string(scopeManager.size())};
+            const std::string scopes = std::to_string(scopeManager.size());
+            return error::fail(INTERNAL_ERROR, "Something went wrong during compilation. Scopes count: ", scopes);
         }
-        if (!scopeManager.containsIdRecursive("main")) return {NO_ENTRYPOINT_ERROR};
-        auto main_decl = scopeManager.findDeclaration("main");
-        if (!main_decl.isFunc()) return {NO_ENTRYPOINT_ERROR};
-        if (main_decl.getType() != scopeManager.findTypeRecursive("int")) return {NO_ENTRYPOINT_ERROR};
+        return {};
+    }
 
-        scopeManager.dealloc_top(nodes[global_node_id].body);
+    error::expected<void> CFG::import_module(const module_image& module) {
+        namespace mf = module_format;
+        //module is checked when it's written, so what fails here is about the whole file
+        auto failed = [&](error::failure f) -> error::expected<void> {
+            diags.report(diagnostics::severity::FATAL, f, {}, {});
+            return f;
+        };
+        if (scopeManager.size() != 1)
+            return failed(error::fail(UNSUPPORTED, "Modules can be imported only into global scope"));
+        if (nodes.empty()) nodes.emplace_back();
+
+        const u64 id_base = scopeManager.reserveIds(module.id_count());
+        //module global node is merged into ours, the rest of its nodes go after the existing ones
+        const size_t node_base = nodes.size() - 1;
+        auto node_id = [&](u64 id) { return id == 0 ? 0 : id + node_base; };
+        auto operand = [&](const mf::operand& o) -> Operand {
+            if (o.kind == mf::EMPTY) return Operand {};
+            if (o.kind == mf::INSTANT) return {o.type, o.value, true, bool(o.is_rvalue)};
+            if (o.kind == mf::NODE_ID) return {o.type, node_id(o.value), true, bool(o.is_rvalue)};
+            return {o.type, o.value + id_base, false, bool(o.is_rvalue)};
+        };
+
+        for (const auto& t : module.types()) {
+            if (!scopeManager.importType(interner::global().intern(module.text(t.name)), t.type))
+                return failed(
+                    error::fail(REDEFINITION, "Type {} of imported module is already defined", module.text(t.name)));
+        }
+        for (const auto& id : module.identifiers()) {
+            const Scope::Declaration decl {id.type, id.id + id_base, bool(id.is_func)};
+            if (!scopeManager.importId(interner::global().intern(module.text(id.name)), decl))
+                return failed(error::fail(REDEFINITION, "Identifier {} of imported module is already defined",
+                                          module.text(id.name)));
+        }
+        for (const auto& a : module.allocations()) scopeManager.importAllocation(operand(a));
 
-        return {""};
+        const auto bodies = module.bodies();
+        for (size_t n = 0; n < bodies.size(); n++) {
+            auto& body = n == 0 ? nodes[0].body : nodes.emplace_back().body;
+            for (const auto& node : module.nodes().subspan(bodies[n].first, bodies[n].count))
+                body.emplace_back(Operation(node.op), operand(node.operand1), operand(node.operand2));
+        }
+        //global node is terminated when the whole file is parsed
+        const auto exits = module.terminators();
+        for (size_t n = 1; n < exits.size(); n++) {
+            const auto& e = exits[n];
+            terminate(node_id(n), {terminator::kind_t(e.kind), Operation(e.condition), u32(node_id(e.target)),
+                                   u32(node_id(e.next))});
+        }
+        edges.build(nodes.size());
+
+        for (const auto& f : module.functions()) {
+            std::vector<Operand> params {};
+            for (const auto& p : module.params().subspan(f.first_param, f.param_count)) params.push_back(operand(p));
+            const u64 func_id = f.id + id_base;
+            const u64 entry = node_id(f.node_id);
+            auto blocks = layout_blocks(entry, [&](size_t id) -> const CFG_Node& { return nodes[id]; }, &memory);
+            global_funcs[func_id] = CFG_Func {f.return_type, entry, std::move(params), std::move(blocks)};
+            if (on_function_parsed) on_function_parsed(func_id, global_funcs[func_id]);
+        }
+        return {};
     }
 
+    error::expected<void> CFG::parse_function(token_stream& tokens, int& i, size_t& node_id) {
+        if (!scopeManager.containsTypeRecursive(tokens[i].sym)) {
+            return error::fail(UNKNOWN_TYPENAME, "No such typename ", tokens[i].sym);
+        }
+        const u64 return_type = scopeManager.findTypeRecursive(tokens[i].sym);
 
-    error::errable<void> CFG::parse_function(const std::vector<token>& tokens, int& i, size_t& node_id) {
-        if (!scopeManager.containsTypeRecursive(tokens[i].data)) return {"No such typename " + tokens[i].data};
-        const u64 return_type = scopeManager.findTypeRecursive(tokens[i].data);
-
-        if (scopeManager.containsId(tokens[i + 1].data))
-            return {"Variable " + tokens[i + 1].data + " is already defined in this scope"};
+        if (scopeManager.containsId(tokens[i + 1].sym))
+            return error::fail(REDEFINITION, "Variable {} is already defined in this scope", tokens[i + 1].sym);
 
-        const u64 func_id = scopeManager.addId(tokens[i + 1].data, return_type, true, nodes[node_id].body);
+        const u64 func_id = scopeManager.addId(tokens[i + 1].sym, return_type, true, nodes[node_id].body);
+        current_function = tokens[i + 1];
 
         size_t func_node_id = nodes.size();
         nodes.emplace_back();
@@ -62,57 +201,122 @@ namespace eraxc::JIR {
 
         //parse arguments declaration
         while (tokens[i].t != token::R_BRACKET) {
-            if (tokens[i].t == token::NONE) return {"Unexpected EOF in arguments list"};
+            if (tokens[i].t == token::NONE) return error::fail(SYNTAX_ERROR, "Unexpected EOF in arguments list");
             if (tokens[i].t == token::IDENTIFIER) {
-                u64 arg_type = scopeManager.findTypeRecursive(tokens[i].data);
-                if (arg_type == ScopeManager::NOT_FOUND) return {"No such typename " + tokens[i].data};
+                u64 arg_type = scopeManager.findTypeRecursive(tokens[i].sym);
+                if (arg_type == ScopeManager::NOT_FOUND)
+                    return error::fail(UNKNOWN_TYPENAME, "No such typename ", tokens[i].sym);
 
                 if (tokens[i + 1].t != token::IDENTIFIER)
-                    return {"Expected variable name in arguments list instead of " + tokens[i + 1].data};
-                u64 arg_id = scopeManager.addIdWithoutAllocation(tokens[i + 1].data, arg_type, false);
+                    return error::fail(SYNTAX_ERROR, "Expected variable name in arguments list instead of ",
+                                       tokens[i + 1].sym);
+                u64 arg_id = scopeManager.addIdWithoutAllocation(tokens[i + 1].sym, arg_type, false);
                 args.emplace_back(arg_type, arg_id, false, false);
             } else
-                return {"Expected function variable list or end of function declaration instead of " + tokens[i].data};
+                return error::fail(SYNTAX_ERROR,
+                                   "Expected function variable list or end of function declaration instead of ",
+                                   tokens[i].sym);
             if (tokens[i + 2].t == token::R_BRACKET) {
                 i += 2;
                 break;
             }
             if (tokens[i + 2].t != token::COMMA)
-                return {"Expected comma ',' or right bracket instead of " + tokens[i + 2].data};
+                return error::fail(SYNTAX_ERROR, "Expected comma ',' or right bracket instead of ", tokens[i + 2].sym);
             i += 3;
         }
 
         i++;
         //parse function body
-        if (tokens[i].t != token::L_F_BRACKET) return {"Expected function body '{' instead of " + tokens[i].data};
+        if (tokens[i].t != token::L_F_BRACKET) {
+            return error::fail(SYNTAX_ERROR, "Expected function body '{' instead of ", tokens[i].sym);
+        }
         i++;
 
-        global_funcs[func_id] = CFG_Func {return_type, func_node_id, args};
+        global_funcs[func_id] = CFG_Func {return_type, func_node_id, std::move(args)};
 
         auto body = parse_statements(tokens, i, func_node_id);
-        if (!body) return {body.error};
+        if (!body) return body;
+        current_function = {};
 
-        if (nodes[func_node_id].body.back().op != Operation::RET) {
+        //function without return at the end returns nothing
+        if (nodes[func_node_id].exit.kind == terminator::NONE) {
             scopeManager.dealloc_top(nodes[func_node_id].body);
-            nodes[func_node_id].body.emplace_back(Operation::RET, Operand {}, Operand {});
+            terminate(func_node_id, {terminator::RETURN});
         }
         scopeManager.pop();
 
-        return {""};
+        auto& func = global_funcs[func_id];
+        func.blocks = layout_blocks(func.node_id, [&](size_t id) -> const CFG_Node& { return nodes[id]; }, &memory);
+
+        //JIR of a file with errors is never translated
+        if (on_function_parsed && !diags.has_errors()) on_function_parsed(func_id, func);
+
+        return {};
+    }
+
+    CFG_FuncSnapshot CFG::snapshot_function(const CFG_Func& func) const {
+        CFG_FuncSnapshot snapshot {func.node_id};
+        //blocks of a function are created after its entry and before the next function, unreachable ones after the
+        //last reachable block aren't needed
+        const size_t end = *std::max_element(func.blocks.begin(), func.blocks.end()) + 1;
+        snapshot.nodes.assign(nodes.begin() + func.node_id, nodes.begin() + end);
+        snapshot.index_edges();
+        return snapshot;
+    }
+
+    void CFG::dead_code_elimination_pass() {
+        //blocks of no function except global node are unreachable
+        std::vector<bool> reachable(nodes.size(), false);
+        reachable[0] = true;
+        for (auto& [func_id, func] : global_funcs) {
+            auto fn = snapshot_function(func);
+            //blocks pass adds get ids after the last node of CFG instead of the snapshot
+            const size_t end = fn.first_node_id + fn.nodes.size();
+            const size_t added = nodes.size();
+            run_function_passes(fn, func, 1);
+            auto id = [&](u32 n) { return n < end ? n : u32(added + n - end); };
+            for (size_t n = 0; n < fn.nodes.size(); n++) {
+                CFG_Node& node = fn.first_node_id + n < end ? nodes[fn.first_node_id + n] : nodes.emplace_back();
+                node.body.assign(fn.nodes[n].body.begin(), fn.nodes[n].body.end());
+                node.exit = fn.nodes[n].exit;
+                node.exit.target = id(node.exit.target);
+                node.exit.next = id(node.exit.next);
+            }
+            reachable.resize(nodes.size(), false);
+            for (auto& block : func.blocks) {
+                block = id(block);
+                reachable[block] = true;
+            }
+        }
+
+        edges = adjacency {&memory};
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (!reachable[n]) {
+                nodes[n].body.clear();
+                nodes[n].exit = {};
+            }
+            const terminator& exit = nodes[n].exit;
+            if (exit.kind == terminator::BRANCH) edges.add(n, exit.next);
+            if (exit.kind == terminator::JUMP || exit.kind == terminator::BRANCH) edges.add(n, exit.target);
+        }
+        edges.build(nodes.size());
     }
 
-    error::errable<void> CFG::parse_if(const std::vector<token>& tokens, int& i, size_t& node_id) {
-        if (tokens[i + 1].t != token::L_BRACKET) return {"Expected left bracket after if: `if(cond) {body}`"};
+    error::expected<void> CFG::parse_if(token_stream& tokens, int& i, size_t& node_id) {
+        if (tokens[i + 1].t != token::L_BRACKET)
+            return error::fail(SYNTAX_ERROR, "Expected left bracket after if: `if(cond) {body}`");
         i += 2;
 
         size_t node_id_before = node_id;
 
         auto expr = parse_expression(tokens, i, node_id, {token::R_BRACKET});
-        if (!expr) return {expr.error};
+        if (!expr) return expr.error();
 
-        if (node_id_before == node_id) return {"Expected conditional expression inside of if()"};
+        if (node_id_before == node_id)
+            return error::fail(SYNTAX_ERROR, "Expected conditional expression inside of if()");
 
         // now node_id stands for positive branch (see push_expr_stack() for clarification)
+        const size_t positive_branch_id = node_id;
 
         scopeManager.push();
 
@@ -126,7 +330,8 @@ namespace eraxc::JIR {
             if (!body) return body;
         }
 
-        scopeManager.dealloc_top(nodes[node_id].body);
+        //positive branch may have returned already
+        if (nodes[node_id].exit.kind == terminator::NONE) scopeManager.dealloc_top(nodes[node_id].body);
         scopeManager.pop();
 
         Operation jump_op = jump_ops.top();
@@ -136,14 +341,10 @@ namespace eraxc::JIR {
         size_t negative_branch_id = nodes.size();
         nodes.emplace_back();
 
-        edges.emplace(node_id_before, node_id);
-        edges.emplace(node_id_before, negative_branch_id);
+        //jump from condition to negative leaving positive branch not executed
+        terminate(node_id_before, {terminator::BRANCH, jump_op, u32(negative_branch_id), u32(positive_branch_id)});
 
-        //jump from last cfg node to negative leaving positive branch not executed
-        nodes[node_id_before].body.emplace_back(jump_op, Operand {u64(-1), negative_branch_id, true, false},
-                                                Operand {});
-
-        if (tokens[i].t == token::IDENTIFIER && tokens[i].data == "else") {
+        if (tokens[i].t == token::IDENTIFIER && tokens[i].sym == sym::ELSE) {
             //else branch
 
             //create cfg node that comes after else body
@@ -151,12 +352,8 @@ namespace eraxc::JIR {
             nodes.emplace_back();
             scopeManager.push();
 
-            // edges.emplace(node_id, new_branch_id);
-            edges.emplace(negative_branch_id, new_branch_id);
-
             //jump from positive to new branch leaving negative branch not executed
-            nodes[node_id].body.emplace_back(Operation::JUMP, Operand {u64(-1), new_branch_id, true, false},
-                                             Operand {});
+            terminate(node_id, {terminator::JUMP, Operation::NONE, u32(new_branch_id)});
 
             //parse else body
             i++;
@@ -172,150 +369,177 @@ namespace eraxc::JIR {
 
             scopeManager.dealloc_top(nodes[new_branch_id].body);
             scopeManager.pop();
+            //negative branch falls through to new branch
+            terminate(negative_branch_id, {terminator::JUMP, Operation::NONE, u32(new_branch_id)});
 
             //shift current node to new branch
             node_id = new_branch_id;
-        } else node_id = negative_branch_id;
+        } else {
+            //positive branch falls through to negative, which is where the code after if goes
+            terminate(node_id, {terminator::JUMP, Operation::NONE, u32(negative_branch_id)});
+            node_id = negative_branch_id;
+        }
 
-        return {""};
+        return {};
     }
 
-    error::errable<void> CFG::parse_statements(const std::vector<token>& tokens, int& i, size_t& node_id) {
+    error::expected<void> CFG::parse_statements(token_stream& tokens, int& i, size_t& node_id) {
         //all the stuff should have CFG node arg for alloc & dealloc purposes
         if (tokens[i].t == token::L_F_BRACKET) { i++; }
         while (tokens[i].t != token::R_F_BRACKET) {
+            const token first = tokens[i];
+            const size_t scopes = scopeManager.size();
+            const size_t jumps = jump_ops.size();
             auto statement = parse_statement(tokens, i, node_id);
-            if (!statement) return statement;
+            if (statement) continue;
+
+            //report and go on with the next statement, dropping what the failed one left unfinished
+            report(diagnostics::severity::CRITICAL, statement.error(), tokens, first, i);
+            while (scopeManager.size() > scopes) scopeManager.pop();
+            while (jump_ops.size() > jumps) jump_ops.pop();
+            recover(tokens, i);
+            if (tokens[i].t == token::NONE) return error::fail(SYNTAX_ERROR, "Unexpected EOF, expected `}`");
+            if (diags.limit_reached()) return error::fail(TOO_MANY_ERRORS, "Too many errors, compilation stopped");
         }
         i++;
-        return {""};
+        return {};
     }
 
-    error::errable<void> CFG::parse_statement(const std::vector<token>& tokens, int& i, size_t& node_id) {
+    error::expected<void> CFG::parse_statement(token_stream& tokens, int& i, size_t& node_id) {
         if (tokens[i].t == token::IDENTIFIER) {
-            if (tokens[i].data == "return") {
+            if (tokens[i].sym == sym::RETURN) {
                 i++;
                 auto to_return = parse_expression(tokens, i, node_id);
-                if (!to_return) return to_return.error;
+                if (!to_return) return to_return.error();
 
                 auto& body = nodes[node_id].body;
 
-                body.emplace_back(Operation::PASS_RET, to_return.value, Operand {});
+                body.emplace_back(Operation::PASS_RET, to_return.value(), Operand {});
                 scopeManager.dealloc_all(body);
-                body.emplace_back(Operation::RET, Operand {}, Operand {});
-            } else if (tokens[i].data == "if") {
+                terminate(node_id, {terminator::RETURN});
+
+                //statements after return go to a block nothing jumps to
+                if (tokens[i].t != token::R_F_BRACKET) {
+                    node_id = nodes.size();
+                    nodes.emplace_back();
+                }
+            } else if (tokens[i].sym == sym::IF) {
                 //parse if
                 auto ifn = parse_if(tokens, i, node_id);
                 if (!ifn) return ifn;
-            } else if (tokens[i].data == "for") {
+            } else if (tokens[i].sym == sym::FOR) {
                 //parse for
-            } else if (tokens[i].data == "while") {
+            } else if (tokens[i].sym == sym::WHILE) {
                 //parse while
-            } else if (tokens[i].data == "do") {
+            } else if (tokens[i].sym == sym::DO) {
                 //parse do
             } else {
                 if (tokens[i + 1].t == token::IDENTIFIER) {
                     //declaration
                     auto decl = parse_declaration(tokens, i, node_id);
                     if (!decl) return decl;
-                    return {""};
+                    return {};
                 }
                 //expr
                 auto expr = parse_expression(tokens, i, node_id);
-                if (!expr) return expr.error;
+                if (!expr) return expr.error();
             }
-        } else return {"Expected statement instead of: " + tokens[i].data};
-        return {""};
+        } else return error::fail(SYNTAX_ERROR, "Expected statement instead of: ", tokens[i].sym);
+        return {};
     }
 
-    error::errable<void> CFG::parse_declaration(const std::vector<token>& tokens, int& i, size_t node_id) {
-        if (!scopeManager.containsTypeRecursive(tokens[i].data)) return {"Unknown type identifier: " + tokens[i].data};
-        if (scopeManager.containsId(tokens[i + 1].data))
-            return {"This identifier is already defined: " + tokens[i + 1].data};
+    error::expected<void> CFG::parse_declaration(token_stream& tokens, int& i, size_t node_id) {
+        if (!scopeManager.containsTypeRecursive(tokens[i].sym)) {
+            return error::fail(UNKNOWN_TYPENAME, "Unknown type identifier: ", tokens[i].sym);
+        }
+        if (scopeManager.containsId(tokens[i + 1].sym))
+            return error::fail(REDEFINITION, "This identifier is already defined: ", tokens[i + 1].sym);
 
-        const u64 type = scopeManager.findTypeRecursive(tokens[i].data);
+        const u64 type = scopeManager.findTypeRecursive(tokens[i].sym);
 
-        scopeManager.addId(tokens[i + 1].data, type, false, nodes[node_id].body);
+        scopeManager.addId(tokens[i + 1].sym, type, false, nodes[node_id].body);
 
         if (tokens[i + 2].t == token::OPERATOR) {
-            std::string name = tokens[i + 1].data;
+            const symbol name = tokens[i + 1].sym;
             //parsing initialization
             size_t old_size = scopeManager.top().allocatedIds;
             i++;
             auto init = parse_expression(tokens, i, node_id);
 
-            if (!init) return init.error;
+            if (!init) return init.error();
 
             if (scopeManager.top().allocatedIds == old_size) {
                 const u64 id = scopeManager.addId(name, type, false, nodes[node_id].body);
             }
 
-            return {""};
+            return {};
         }
 
-        const u64 id = scopeManager.addId(tokens[i + 1].data, type, false, nodes[node_id].body);
+        const u64 id = scopeManager.addId(tokens[i + 1].sym, type, false, nodes[node_id].body);
 
         if (tokens[i + 2].t != token::SEMICOLON)
-            return {"Expected semicolon after declaration instead of: " + tokens[i + 3].data};
+            return error::fail(SYNTAX_ERROR, "Expected semicolon after declaration instead of: ", tokens[i + 3].sym);
         i += 3;
 
-        return {""};
+        return {};
     }
 
 
-    error::errable<std::pair<Operand, Nodes>> CFG::parse_expr_operand(const std::vector<token>& tokens, int& i,
-                                                                      size_t node_id) {
+    error::expected<std::pair<Operand, Nodes>> CFG::parse_expr_operand(token_stream& tokens, int& i,
+                                                                       size_t node_id) {
 
         //Now multiple prefix & postfix operators!
-        std::vector<Operation> prefix_ops;
-        Nodes postfix_ops;
+        std::pmr::vector<Operation> prefix_ops {&memory};
+        Nodes postfix_ops {&memory};
 
         while (tokens[i].t == token::OPERATOR) {
             //prefix operators
             Operation prefix_op = prefix_op_to_jir_op(tokens[i]);
             if (prefix_op == Operation::ERR)
-                return {"No such prefix operator: " + tokens[i].data + ". Expected prefix operator or variable", {}};
+                return error::fail(SYNTAX_ERROR, "No such prefix operator: {}. Expected prefix operator or variable",
+                                   tokens[i].sym);
             prefix_ops.emplace_back(prefix_op);
             i++;
         }
 
         if (tokens[i].t != token::IDENTIFIER)
-            return {"Expected identifier in expression operand instead of: " + tokens[i].data, {}};
+            return error::fail(SYNTAX_ERROR, "Expected identifier in expression operand instead of: ", tokens[i].sym);
 
-        auto decl = scopeManager.findDeclarationRecursive(tokens[i].data);
+        auto decl = scopeManager.findDeclarationRecursive(tokens[i].sym);
         if (decl.getId() == -1 && decl.getType() == -1)
-            return {"Unknown identifier in this scope: " + tokens[i].data, {}};
+            return error::fail(UNKNOWN_IDENTIFIER, "Unknown identifier in this scope: ", tokens[i].sym);
         i++;
 
         Operand operand {decl.getType(), decl.getId(), false, false};
         for (auto op : prefix_ops) { nodes[node_id].body.emplace_back(op, operand, Operand {}); }
 
-        while ((tokens[i].t == token::OPERATOR && syntax::postfix_operators.contains(tokens[i].data)) ||
+        while ((tokens[i].t == token::OPERATOR && syntax::postfix_operators.contains(tokens[i].data())) ||
                tokens[i].t == token::L_BRACKET || tokens[i].t == token::L_SQ_BRACKET) {
 
             if (tokens[i].t == token::L_BRACKET) {
                 //function call
-                if (!decl.isFunc()) return {"Function declaration expected", {}};
+                if (!decl.isFunc()) return error::fail(TYPE_MISMATCH, "Function declaration expected");
                 u64 args_passed = 0;
                 i++;
                 //parse args
                 while (tokens[i - 1].t != token::R_BRACKET) {
                     auto arg = parse_expression(tokens, i, node_id, {token::R_BRACKET, token::COMMA});
-                    if (!arg) return {"Error while parsing function call argument" + arg.error, {}};
+                    if (!arg) return arg.error().within("Error while parsing function call argument");
 
-                    auto arg1 = arg.value;
+                    auto arg1 = arg.value();
 
                     if (global_funcs[decl.getId()].params[args_passed].type != arg1.type) {
-                        return {"Invalid argument type in function call.\nExpected: " +
-                                    std::to_string(global_funcs[decl.getId()].params[args_passed].type) +
-                                    ", got:" + std::to_string(arg1.type),
-                                {}};
+                        const u64 param_type = global_funcs[decl.getId()].params[args_passed].type;
+                        return error::fail(TYPE_MISMATCH,
+                                           "Invalid argument type in function call.\nExpected: " +
+                                               std::to_string(param_type) + ", got:" + std::to_string(arg1.type));
                     }
                     args_passed++;
                     nodes[node_id].body.emplace_back(Operation::PASS, arg1, Operand {});
                 }
                 if (args_passed < global_funcs[decl.getId()].params.size()) {
-                    return {"Not enough arguments for function: $" + std::to_string(decl.getId()), {}};
+                    return error::fail(ARGUMENTS_COUNT, "Not enough arguments for function: $",
+                                       std::to_string(decl.getId()));
                 }
 
                 u64 call_result_id = scopeManager.addAnonymousId(decl.getType(), false, nodes[node_id].body);
@@ -331,18 +555,20 @@ namespace eraxc::JIR {
             }
 
             Operation postfix_op = postfix_op_to_jir_op(tokens[i]);
-            if (postfix_op == Operation::ERR) return {"No such postfix operator: " + tokens[i].data, {}};
+            if (postfix_op == Operation::ERR) {
+                return error::fail(SYNTAX_ERROR, "No such postfix operator: ", tokens[i].sym);
+            }
             i++;
             postfix_ops.emplace_back(postfix_op, operand, Operand {});
         }
 
-        return {"", {operand, postfix_ops}};
+        return std::pair {operand, std::move(postfix_ops)};
     }
 
-    error::errable<void> CFG::push_expr_stack(std::stack<syntax::operator_type>& operations,
-                                              std::stack<Operand>& operands, size_t& node_id) {
+    error::expected<void> CFG::push_expr_stack(expr_stack<syntax::operator_type>& operations,
+                                               expr_stack<Operand>& operands, size_t& node_id) {
         auto to_add = op_to_jir_op(operations.top());
-        if (to_add.first == Operation::ERR) return {"Invalid operation encountered."};
+        if (to_add.first == Operation::ERR) return error::fail(INTERNAL_ERROR, "Invalid operation encountered.");
         operations.pop();
         //operands are on stack in backwards order so flip em
         Operand operand1 = operands.top();
@@ -388,93 +614,82 @@ namespace eraxc::JIR {
 
         //result is a new operand
         operands.push(result);
-        return {""};
+        return {};
     }
 
-    error::errable<Operand> CFG::parse_instant(const token& t) const {
-        //TODO handle out of range, etc. Best practise would be write my own parsing library with `error::errable`
-        Operand tr {};
-        if (t.data[t.data.size() - 2] == 'u') {
-            if (t.data.back() == 'l') {
-                //unsigned long, u64
-                tr = {scopeManager.findTypeRecursive("u64"), u64(std::stoull(t.data.substr(0, t.data.size() - 2))),
-                      true, true};
-            } else if (t.data.back() == 'i') {
-                //unsigned integer instant, u32
-                tr = {scopeManager.findTypeRecursive("u32"), u64(std::stol(t.data.substr(0, t.data.size() - 2))), true,
-                      true};
-            } else {
-                return {"Non-explicit or unknown constant type\nMake constant type explicit: e.g. `16i`", tr};
-            }
-        } else {
-            if (t.data.back() == 'l') {
-                //long, i64
-                tr = {scopeManager.findTypeRecursive("i64"), u64(std::stol(t.data.substr(0, t.data.size() - 1))), true,
-                      true};
-            } else if (t.data.back() == 'i') {
-                //integer instant, i32
-                tr = {scopeManager.findTypeRecursive("i32"), u64(std::stoi(t.data.substr(0, t.data.size() - 1))), true,
-                      true};
-            } else {
-                //if none is present, stick to i32
-                tr = {scopeManager.findTypeRecursive("i32"), u64(std::stoi(t.data.substr(0, t.data.size() - 1))), true,
-                      true};
-            }
+    error::expected<Operand> CFG::parse_instant(const token& t) const {
+        const std::string_view data = t.data();
+        //suffix makes the type: `ul` u64, `ui` u32, `l` i64, `i` or none i32
+        symbol type = sym::I32;
+        u64 max = std::numeric_limits<int>::max();
+        size_t suffix = 0;
+        if (data.ends_with("ul")) {
+            type = sym::U64;
+            max = std::numeric_limits<u64>::max();
+            suffix = 2;
+        } else if (data.ends_with("ui")) {
+            type = sym::U32;
+            max = std::numeric_limits<u32>::max();
+            suffix = 2;
+        } else if (data.size() > 1 && data[data.size() - 2] == 'u') {
+            return error::fail(SYNTAX_ERROR,
+                               "Non-explicit or unknown constant type\nMake constant type explicit: e.g. `16i`");
+        } else if (data.ends_with('l')) {
+            type = sym::I64;
+            max = std::numeric_limits<i64>::max();
+            suffix = 1;
+        } else if (data.ends_with('i')) {
+            suffix = 1;
         }
-        return {"", tr};
+
+        //parsed without exceptions, malformed constant is an error like any other
+        const std::string_view digits = data.substr(0, data.size() - suffix);
+        u64 value = 0;
+        const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        if (ec == std::errc::result_out_of_range || (ec == std::errc {} && value > max))
+            return error::fail(SYNTAX_ERROR, "Constant {} is out of range of its type", t.sym);
+        if (ec != std::errc {} || end != digits.data() + digits.size())
+            return error::fail(SYNTAX_ERROR, "Invalid constant ", t.sym);
+        return Operand {scopeManager.findTypeRecursive(type), value, true, true};
     }
 
-    error::errable<Operand> CFG::parse_expression(const std::vector<token>& tokens, int& i, size_t& node_id,
-                                                  const std::set<token::type>& end) {
+    error::expected<Operand> CFG::parse_expression(token_stream& tokens, int& i, size_t& node_id,
+                                                   std::initializer_list<token::type> end) {
+        auto is_end = [&](token::type t) { return std::ranges::find(end, t) != end.end(); };
 
         if (tokens[i + 1].t == token::OPERATOR &&
-            syntax::assign_operators.contains(syntax::operators.at(tokens[i + 1].data))) {
+            syntax::assign_operators.contains(syntax::operators.at(tokens[i + 1].data()))) {
             //Handle assign operators differently
 
             //parse assignee
             if (tokens[i].t != token::IDENTIFIER)
-                return {"Expected variable on the left side of assign operator", Operand {}};
+                return error::fail(SYNTAX_ERROR, "Expected variable on the left side of assign operator");
 
-            const auto& assignee = scopeManager.findDeclarationRecursive(tokens[i].data);
+            const auto& assignee = scopeManager.findDeclarationRecursive(tokens[i].sym);
             if (assignee == ScopeManager::NOT_FOUND_DECL)
-                return {"Unknown identifier in assignee: " + tokens[i].data, Operand {}};
-            const std::string& assignee_name = tokens[i].data;
+                return error::fail(UNKNOWN_IDENTIFIER, "Unknown identifier in assignee: ", tokens[i].sym);
 
             //parse assign operation
-            Operation assign_op = assign_op_to_common_op(syntax::operators.at(tokens[i + 1].data));
+            Operation assign_op = assign_op_to_common_op(syntax::operators.at(tokens[i + 1].data()));
             if (assign_op == Operation::ERR)
-                return {"??? Unsupported assign operator: " + tokens[i + 1].data + ". Please, contact devs",
-                        Operand {}};
+                return error::fail(UNSUPPORTED, "??? Unsupported assign operator: {}. Please, contact devs",
+                                   tokens[i + 1].sym);
 
             //parse expression of what to assign to
             i += 2;
             auto assign_to = parse_expression(tokens, i, node_id, end);
             if (!assign_to) return assign_to;
 
-            Operand tr {u64(-2), u64(-2), false, true};
-
-            //DO i need this assign logic??
-            if (!assign_to.value.is_rvalue && assign_op == Operation::MOVE) {
-                Operand new_assignee {
-                    assignee.getType(),
-                    // scopeManager.top().allocatedIds++,
-                    scopeManager.addAnonymousId(assignee.getType(), false, nodes[node_id].body, false), false, false};
-                // nodes[node_id].body.emplace_back(Operation::ALLOC, new_assignee, Operand {});
-                // scopeManager.addAllocation(new_assignee);
-                tr = new_assignee;
-                nodes[node_id].body.emplace_back(assign_op, new_assignee, assign_to.value);
-                scopeManager.setDeclaration(assignee_name, {assignee.getType(), new_assignee.value, false});
-            } else {
-                tr = Operand(assignee.getType(), assignee.getId(), false, false);
-                nodes[node_id].body.emplace_back(assign_op, tr, assign_to.value);
-            }
-            return {"", tr};
+            //assignment writes the variable itself, SSA construction gives every assignment its own version
+            const Operand tr {assignee.getType(), assignee.getId(), false, false};
+            nodes[node_id].body.emplace_back(assign_op, tr, assign_to.value());
+            return tr;
         }
 
-        Nodes postfix_ops;
+        Nodes postfix_ops {&memory};
 
-        std::stack<Operand> operands {};
-        std::stack<syntax::operator_type> operations {};
+        expr_stack<Operand> operands {&memory};
+        expr_stack<syntax::operator_type> operations {&memory};
 
         while (tokens[i].t == token::IDENTIFIER || tokens[i].t == token::L_BRACKET || tokens[i].t == token::OPERATOR ||
                tokens[i].t == token::INSTANT) {
@@ -486,38 +701,38 @@ namespace eraxc::JIR {
                 i++;
                 auto parentheses = parse_expression(tokens, i, node_id, {token::R_BRACKET});
                 if (!parentheses) return parentheses;
-                operand = parentheses.value;
+                operand = parentheses.value();
             } else if (tokens[i].t == token::INSTANT) {
                 auto instant = parse_instant(tokens[i]);
                 if (!instant) return instant;
-                operand = instant.value;
+                operand = instant.value();
                 i++;
             } else {
                 auto operand_err = parse_expr_operand(tokens, i, node_id);
-                if (!operand_err) return {"Error while parsing expression:\n" + operand_err.error, Operand {}};
+                if (!operand_err) return operand_err.error().within("Error while parsing expression:\n");
 
-                operand = operand_err.value.first;
-                postfix_ops.insert(postfix_ops.begin(), operand_err.value.second.begin(),
-                                   operand_err.value.second.end());
+                auto& [parsed, parsed_postfix] = operand_err.value();
+                operand = parsed;
+                postfix_ops.insert(postfix_ops.begin(), parsed_postfix.begin(), parsed_postfix.end());
             }
-            if (end.contains(tokens[i].t)) {
+            if (is_end(tokens[i].t)) {
                 operands.push(operand);
                 break;
             }
 
             if (tokens[i].t != token::OPERATOR)
-                return {"Expected end of expr or operator instead of " + tokens[i].data, Operand {}};
-            syntax::operator_type op = syntax::operators.at(tokens[i].data);
+                return error::fail(SYNTAX_ERROR, "Expected end of expr or operator instead of ", tokens[i].sym);
+            syntax::operator_type op = syntax::operators.at(tokens[i].data());
 
             if (syntax::assign_operators.contains(op))
-                return {"Cannot assign to rvalue $" + std::to_string(operand.value), Operand {}};
+                return error::fail(TYPE_MISMATCH, "Cannot assign to rvalue $", std::to_string(operand.value));
 
             operands.push(operand);
 
             while (!operations.empty() &&
                    syntax::operator_priorities.at(operations.top()) < syntax::operator_priorities.at(op)) {
                 auto r = push_expr_stack(operations, operands, node_id);
-                if (!r) return {r.error, {}};
+                if (!r) return r.error();
             }
 
             operations.push(op);
@@ -526,21 +741,22 @@ namespace eraxc::JIR {
 
         while (operands.size() > 1) {
             auto push_result = push_expr_stack(operations, operands, node_id);
-            if (!push_result) return {push_result.error, Operand {}};
+            if (!push_result) return push_result.error();
         }
         for (auto postfix : postfix_ops) { nodes[node_id].body.emplace_back(postfix); }
 
-        if (end.contains(tokens[i].t)) {
+        if (is_end(tokens[i].t)) {
             i++;
-            return {"", operands.top()};
+            return operands.top();
         }
-        return {"Expected end of expression instead of " + tokens[i].data, Operand {}};
+        return error::fail(SYNTAX_ERROR, "Expected end of expression instead of ", tokens[i].sym);
     }
 
     void CFG::print_nodes() const {
         for (int i = 0; i < nodes.size(); i++) {
             std::cout << '_' << i << ":\n";
             utils::print_JIR_nodes(nodes[i].body);
+            utils::print_terminator(nodes[i].exit);
         }
     }
 
@@ -557,7 +773,11 @@ namespace eraxc::JIR {
                           << ") {\n";
             } else std::cout << ") {\n";
 
-            utils::print_JIR_nodes(nodes[func.second.node_id].body);
+            for (const u32 block : func.second.blocks) {
+                if (block != func.second.node_id) std::cout << ".l" << block << ":\n";
+                utils::print_JIR_nodes(nodes[block].body);
+                utils::print_terminator(nodes[block].exit);
+            }
 
             std::cout << "}\n";
         }
@@ -1,68 +1,151 @@
 #ifndef CFG_H
 #define CFG_H
 
+#include <functional>
+#include <initializer_list>
 #include <stack>
 
 #include "../Node.h"
 #include "CFG_parts.h"
+#include "layout.h"
 #include "backend/JIR/ScopeManager.h"
+#include "frontend/diagnostics.h"
+#include "frontend/lexic/token_stream.h"
+#include "util/arena.h"
 
 #include <map>
 
 
 namespace eraxc::JIR {
 
-    typedef std::vector<Node> Nodes;
+    class module_image;
+
+    typedef std::pmr::vector<Node> Nodes;
+
+    //vector-backed, so expression parsing doesn't allocate stacks until something is pushed, and then takes
+    //recycled blocks of CFG arena
+    template<typename T>
+    using expr_stack = std::stack<T, std::pmr::vector<T>>;
 
     class CFG {
-        std::vector<CFG_Node> nodes;
+        //owns nodes, edges and scopes below, so it's declared first and destroyed last
+        arena memory {};
+
+        std::pmr::vector<CFG_Node> nodes {&memory};
 
-        // multimap <int from_id, int to_id>. every JUMP is an edge
-        std::multimap<size_t, size_t> edges;
+        //every edge comes from a terminator, indexed once the whole file is parsed
+        adjacency edges {&memory};
 
-        std::map<u64, CFG_Func> global_funcs;
-        ScopeManager scopeManager;
+        std::pmr::map<u64, CFG_Func> global_funcs {&memory};
+        ScopeManager scopeManager {&memory};
 
         std::stack<Operation> jump_ops;
 
-        error::errable<void> parse_declaration(const std::vector<token>& tokens, int& i, size_t node_id);
-        error::errable<void> parse_function(const std::vector<token>& tokens, int& i, size_t& node_id);
-        error::errable<void> parse_statements(const std::vector<token>& tokens, int& i, size_t& node_id);
-        error::errable<void> parse_statement(const std::vector<token>& tokens, int& i, size_t& node_id);
+        std::function<void(u64, const CFG_Func&)> on_function_parsed {};
+
+        //token parsing stopped at when it failed for the first time
+        token failed_at {};
+
+        diagnostics diags {};
+        //name of function being parsed, to note errors in its body with
+        token current_function {};
+
+        /// Reports error of code from token `begin` up to token `i` parsing stopped at
+        void report(diagnostics::severity level, const error::failure& what, token_stream& tokens, const token& begin,
+                    int i);
 
-        error::errable<void> parse_if(const std::vector<token>& tokens, int& i, size_t& node_id);
-        error::errable<void> parse_do(const std::vector<token>& tokens, int& i, size_t node_id);
-        error::errable<void> parse_while(const std::vector<token>& tokens, int& i, size_t node_id);
-        error::errable<void> parse_for(const std::vector<token>& tokens, int& i, size_t node_id);
+        /// Ends basic block with terminator and adds edges to the blocks it leads to. Block keeps the first one
+        void terminate(size_t node_id, terminator exit);
 
-        error::errable<Operand> parse_instant(const token& t) const;
-        error::errable<Operand> parse_expression(const std::vector<token>& tokens, int& i, size_t& node_id,
-                                                 const std::set<token::type>& end = {token::SEMICOLON});
-        error::errable<void> push_expr_stack(std::stack<syntax::operator_type>& operations,
-                                             std::stack<Operand>& operands, size_t& node_id);
-        error::errable<std::pair<Operand, Nodes>> parse_expr_operand(const std::vector<token>& tokens, int& i,
-                                                                     size_t node_id);
+        /// Panic mode recovery: skips the rest of failed statement up to `;` it ends with, or up to `}` closing
+        /// the block it's in, so parsing goes on with the next statement
+        static void recover(token_stream& tokens, int& i);
+
+        error::expected<void> parse_globals(token_stream& tokens);
+        error::expected<void> parse_declaration(token_stream& tokens, int& i, size_t node_id);
+        error::expected<void> parse_function(token_stream& tokens, int& i, size_t& node_id);
+        error::expected<void> parse_statements(token_stream& tokens, int& i, size_t& node_id);
+        error::expected<void> parse_statement(token_stream& tokens, int& i, size_t& node_id);
+
+        error::expected<void> parse_if(token_stream& tokens, int& i, size_t& node_id);
+        error::expected<void> parse_do(token_stream& tokens, int& i, size_t node_id);
+        error::expected<void> parse_while(token_stream& tokens, int& i, size_t node_id);
+        error::expected<void> parse_for(token_stream& tokens, int& i, size_t node_id);
+
+        error::expected<Operand> parse_instant(const token& t) const;
+        error::expected<Operand> parse_expression(token_stream& tokens, int& i, size_t& node_id,
+                                                  std::initializer_list<token::type> end = {token::SEMICOLON});
+        error::expected<void> push_expr_stack(expr_stack<syntax::operator_type>& operations,
+                                              expr_stack<Operand>& operands, size_t& node_id);
+        error::expected<std::pair<Operand, Nodes>> parse_expr_operand(token_stream& tokens, int& i,
+                                                                      size_t node_id);
 
 
     public:
         /// Builds full CFG from token stream, including main() detection and etc
         /// @param tokens Tokens to make CFG from
         /// @return error that happened if any did
-        error::errable<void> create(const std::vector<token>& tokens);
+        error::expected<void> create(const std::vector<token>& tokens);
+
+        /// Builds full CFG reading tokens as they come, so lexer can run concurrently on another thread
+        /// @param tokens Stream to read tokens from. Read until NONE token
+        /// @return error that happened if any did
+        error::expected<void> create(token_stream& tokens);
+
+        /// Builds CFG of a module imported by other files. Unlike create(), doesn't require main() and keeps
+        /// global variables allocated
+        /// @param tokens Stream to read tokens from. Read until NONE token
+        /// @return error that happened if any did
+        error::expected<void> create_module(token_stream& tokens);
+
+        /// Declares everything the module has in global scope, as if its source was placed here.
+        /// Has to be called before create(), module ids and nodes go after the ones CFG already has
+        /// @param module image written by write_module()
+        /// @return error if module declares something already declared
+        error::expected<void> import_module(const module_image& module);
 
         const CFG_Node& get_cfg_node(size_t node_id) const { return nodes[node_id]; };
-        const std::map<u64, CFG_Func>& get_funcs() const { return global_funcs; }
-        const auto& get_edges() const { return edges; }
+        const auto& get_funcs() const { return global_funcs; }
+        const adjacency& get_edges() const { return edges; }
+
+        /// Nodes `node_id` jumps or falls through to, not taken branch first. Valid after create()
+        std::span<const u32> successors(size_t node_id) const { return edges.successors(node_id); }
+
+        /// Nodes jumping or falling through to `node_id`. Valid after create()
+        std::span<const u32> predecessors(size_t node_id) const { return edges.predecessors(node_id); }
 
         const ScopeManager& getScopeManager() const { return scopeManager; }
 
+        /// Token parsing stopped at when create() failed, to point diagnostic at. NONE token if it's unknown
+        const token& error_token() const { return failed_at; }
+
+        /// Every error found by create(), create() itself returns the first one
+        const diagnostics& get_diagnostics() const { return diags; }
+
         void print_functions() const;
         void print_nodes() const;
 
 
-        const std::vector<CFG_Node>& get_nodes() const { return nodes; };
+        const auto& get_nodes() const { return nodes; };
+
+        /// Memory CFG took from its arena so far
+        arena::statistics memory_stats() const { return memory.stats(); }
+
+        /// Sets callback called right after every function body is parsed, while the rest of file isn't parsed yet
+        /// @param callback receives id and declaration of parsed function
+        void set_function_parsed_callback(std::function<void(u64, const CFG_Func&)> callback) {
+            on_function_parsed = std::move(callback);
+        }
+
+        /// Copies nodes and edges of parsed function
+        /// @param func function to copy
+        CFG_FuncSnapshot snapshot_function(const CFG_Func& func) const;
 
-        /// Eliminates all the nodes that aren't used from CFG
+        /// Eliminates all the nodes that aren't used from CFG: unreachable blocks, nodes computing values nothing
+        /// reads and storage of variables that are left unused, see eliminate_dead_code(). Constants are propagated
+        /// first, so branches on them leave the other branch unreachable, see propagate_constants(). Codegen runs
+        /// the same passes on function snapshots, this one is for CFG that's written as is, e.g. module.
+        /// Valid after create()
         void dead_code_elimination_pass();
     };
 }
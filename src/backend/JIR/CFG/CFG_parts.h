@@ -1,26 +1,83 @@
 #ifndef CFG_PARTS_H
 #define CFG_PARTS_H
 
+#include <memory_resource>
 #include <vector>
 #include "../../scope.h"
+#include "../Node.h"
+#include "adjacency.h"
 
 namespace eraxc::JIR {
 
-    struct CFG_Node {
-        std::vector<Node> body;
-        // std::vector<Operand> allocations;
+    /// The only way control leaves a basic block. Blocks being parsed have none yet, every block of parsed CFG has one
+    struct terminator {
+        enum kind_t : unsigned char { NONE, JUMP, BRANCH, RETURN };
+
+        kind_t kind = NONE;
+        //conditional jump of BRANCH, e.g. JL after CMP. Taken to `target`, otherwise control goes to `next`
+        Operation condition = Operation::NONE;
+        u32 target = 0;
+        u32 next = 0;
+
+        bool operator==(const terminator&) const = default;
     };
 
-    struct CFG_Edge {
-        size_t from_id;
-        size_t id_to;
-        size_t id_control_instruction;
+    /// Basic block: straight-line JIR nodes and terminator they're followed by.
+    /// Body of CFG node is allocated from the memory resource of container it's in, e.g. arena of the CFG.
+    /// Copy of a node gets default resource, so snapshots outlive the arena
+    struct CFG_Node {
+        using allocator_type = std::pmr::polymorphic_allocator<Node>;
+
+        std::pmr::vector<Node> body;
+        terminator exit {};
+
+        CFG_Node() = default;
+        CFG_Node(const CFG_Node&) = default;
+        CFG_Node(CFG_Node&&) = default;
+        CFG_Node& operator=(const CFG_Node&) = default;
+        CFG_Node& operator=(CFG_Node&&) = default;
+
+        explicit CFG_Node(const allocator_type& allocator) : body(allocator) {}
+        CFG_Node(const CFG_Node& other, const allocator_type& allocator)
+            : body(other.body, allocator), exit(other.exit) {}
+        CFG_Node(CFG_Node&& other, const allocator_type& allocator)
+            : body(std::move(other.body), allocator), exit(other.exit) {}
     };
 
     struct CFG_Func {
         u64 return_type;
         u64 node_id;
         std::vector<Operand> params;
+        //reachable blocks in the order they're emitted, entry block first. See layout_blocks()
+        std::vector<u32> blocks {};
+    };
+
+    /// Copy of the nodes and edges of one function, so it can be translated while CFG keeps growing, and passes can
+    /// change it on their own. Node ids stay the same as in CFG, blocks passes add get ids after the last one
+    struct CFG_FuncSnapshot {
+        size_t first_node_id = 0;
+        std::vector<CFG_Node> nodes {};
+        adjacency edges {};
+
+        CFG_Node& get_cfg_node(size_t node_id) { return nodes[node_id - first_node_id]; }
+        const CFG_Node& get_cfg_node(size_t node_id) const { return nodes[node_id - first_node_id]; }
+
+        /// Indexes edges from terminators of the nodes again, after they were copied or changed by a pass.
+        /// Edges to nodes out of the snapshot are left out
+        void index_edges() {
+            edges = adjacency {};
+            const size_t end = first_node_id + nodes.size();
+            for (size_t n = 0; n < nodes.size(); n++) {
+                const terminator& exit = nodes[n].exit;
+                if (exit.kind == terminator::BRANCH && exit.next < end) edges.add(first_node_id + n, exit.next);
+                if ((exit.kind == terminator::JUMP || exit.kind == terminator::BRANCH) && exit.target < end)
+                    edges.add(first_node_id + n, exit.target);
+            }
+            edges.build(nodes.size(), first_node_id);
+        }
+
+        std::span<const u32> successors(size_t node_id) const { return edges.successors(node_id); }
+        std::span<const u32> predecessors(size_t node_id) const { return edges.predecessors(node_id); }
     };
 }
 
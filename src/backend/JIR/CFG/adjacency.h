@@ -0,0 +1,91 @@
+#ifndef ADJACENCY_H
+#define ADJACENCY_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include "util/common.h"
+
+namespace eraxc::JIR {
+
+    struct CFG_Edge {
+        size_t from;
+        size_t to;
+
+        bool operator==(const CFG_Edge&) const = default;
+    };
+
+    /// Successors and predecessors of CFG nodes in compressed sparse row form. Parser appends edges as it goes,
+    /// build() then sorts them by node into flat arrays, so successors of node `id` are
+    /// `successor_ids[successor_offsets[id]]..successor_ids[successor_offsets[id + 1]]` and walking them touches
+    /// two adjacent cache lines instead of tree nodes. Edges of a node keep the order they were added in.
+    /// Spans returned by successors() and predecessors() see edges added before the last build()
+    class adjacency {
+        std::pmr::vector<CFG_Edge> added;
+        //ids of nodes adjacency was built for are [first, first + count)
+        size_t first = 0;
+        size_t count = 0;
+        std::pmr::vector<u32> successor_offsets;
+        std::pmr::vector<u32> successor_ids;
+        std::pmr::vector<u32> predecessor_offsets;
+        std::pmr::vector<u32> predecessor_ids;
+
+        /// Counting sort of edges by `key` node, stable so the order edges were added in is kept
+        template<typename key_t, typename value_t>
+        void index(std::pmr::vector<u32>& offsets, std::pmr::vector<u32>& ids, key_t key, value_t value) {
+            offsets.assign(count + 1, 0);
+            for (const auto& e : added) offsets[key(e) - first + 1]++;
+            for (size_t n = 0; n < count; n++) offsets[n + 1] += offsets[n];
+            ids.resize(added.size());
+            //offsets[n] is the insertion cursor of node n, it ends up at the start of node n + 1
+            for (const auto& e : added) ids[offsets[key(e) - first]++] = u32(value(e));
+            for (size_t n = count; n > 0; n--) offsets[n] = offsets[n - 1];
+            offsets[0] = 0;
+        }
+
+        static std::span<const u32> row(const std::pmr::vector<u32>& offsets, const std::pmr::vector<u32>& ids,
+                                        size_t n) {
+            return {ids.data() + offsets[n], ids.data() + offsets[n + 1]};
+        }
+
+    public:
+        explicit adjacency(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : added(memory), successor_offsets(memory), successor_ids(memory), predecessor_offsets(memory),
+              predecessor_ids(memory) {}
+
+        void add(size_t from, size_t to) { added.push_back({from, to}); }
+
+        /// Indexes every edge added so far
+        /// @param node_count number of nodes, every edge has to be between them
+        /// @param first_node id of the first node, e.g. of the first node of function snapshot
+        void build(size_t node_count, size_t first_node = 0) {
+            first = first_node;
+            count = node_count;
+            index(successor_offsets, successor_ids, [](const CFG_Edge& e) { return e.from; },
+                  [](const CFG_Edge& e) { return e.to; });
+            index(predecessor_offsets, predecessor_ids, [](const CFG_Edge& e) { return e.to; },
+                  [](const CFG_Edge& e) { return e.from; });
+        }
+
+        /// @return nodes node `id` jumps or falls through to, empty for a node adjacency wasn't built for
+        std::span<const u32> successors(size_t id) const {
+            if (id < first || id - first >= count) return {};
+            return row(successor_offsets, successor_ids, id - first);
+        }
+
+        /// @return nodes jumping or falling through to node `id`
+        std::span<const u32> predecessors(size_t id) const {
+            if (id < first || id - first >= count) return {};
+            return row(predecessor_offsets, predecessor_ids, id - first);
+        }
+
+        /// Every edge in the order it was added
+        const std::pmr::vector<CFG_Edge>& edges() const { return added; }
+
+        size_t size() const { return added.size(); }
+    };
+}
+
+#endif  //ADJACENCY_H
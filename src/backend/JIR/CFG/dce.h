@@ -0,0 +1,122 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include <memory_resource>
+#include <vector>
+
+#include "ssa.h"
+
+namespace eraxc::JIR {
+
+    /// Whether node only computes value of its first operand, so it can go if nothing reads the value.
+    /// CMP sets flags the terminator branches on, so it isn't
+    inline bool is_pure(Operation op) {
+        switch (op) {
+            case Operation::ADD:
+            case Operation::SUB:
+            case Operation::MUL:
+            case Operation::DIV:
+            case Operation::MOD:
+            case Operation::INC:
+            case Operation::DEC:
+            case Operation::NOT:
+            case Operation::NEG:
+            case Operation::AND:
+            case Operation::OR:
+            case Operation::XOR:
+            case Operation::LSHIFT:
+            case Operation::RSHIFT:
+            case Operation::MOVE:
+            case Operation::PHI: return true;
+            default: return false;
+        }
+    }
+
+    /// Removes code of function in SSA form that can't affect what it does:
+    /// - bodies and terminators of unreachable blocks;
+    /// - pure nodes whose versions nothing needs, found by marking from nodes with effects, i.e. calls, CMP,
+    ///   passing arguments and result, and writes to globals. Phi nodes of a loop that only feed each other go too;
+    /// - ALLOC and DEALLOC of locals nothing refers to anymore, e.g. temporaries of removed expressions
+    /// @param vars locals returned by construct_ssa()
+    /// @param memory resource for everything the pass needs only while it runs
+    /// @return count of removed nodes
+    inline size_t eliminate_dead_code(CFG_FuncSnapshot& fn, const CFG_Func& func, const ssa_variables& vars,
+                                      std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        const block_graph graph {fn, func.blocks, memory};
+        constexpr u32 NONE = ssa_variables::NONE;
+        size_t removed = 0;
+
+        bool unreachable = false;
+        for (size_t n = 0; n < fn.nodes.size(); n++) {
+            if (graph.position(fn.first_node_id + n) != block_graph::NONE) continue;
+            removed += fn.nodes[n].body.size();
+            fn.nodes[n].body.clear();
+            unreachable |= fn.nodes[n].exit.kind != terminator::NONE;
+            fn.nodes[n].exit = {};
+        }
+        if (unreachable) fn.index_edges();
+        if (vars.locals.empty()) return removed;
+        auto index = [&](const Operand& o) { return o.is_instant ? NONE : vars.index(o.value); };
+
+        //nodes assigning every version, which are needed once the version is
+        std::pmr::vector<const Node*> sites {memory};
+        adjacency assigned_by {memory};
+        var_set needed {vars.size(), memory};
+        std::pmr::vector<u32> worklist {memory};
+        auto need = [&](const Operand& o) {
+            const u32 v = index(o);
+            if (v == NONE || needed.contains(v)) return;
+            needed.insert(v);
+            worklist.push_back(v);
+        };
+        auto need_operands = [&](const Node& node) {
+            if (reads_operand1(node.op)) need(node.operand1);
+            if (reads_operand2(node.op)) need(node.operand2);
+        };
+        for (u32 b = 0; b < graph.size(); b++) {
+            for (const auto& node : fn.get_cfg_node(graph.id(b)).body) {
+                if (node.op == Operation::ALLOC || node.op == Operation::DEALLOC) continue;
+                if (is_pure(node.op) && index(node.operand1) != NONE) {
+                    assigned_by.add(index(node.operand1), sites.size());
+                    sites.push_back(&node);
+                } else need_operands(node);
+            }
+        }
+        assigned_by.build(std::max(vars.size(), sites.size()));
+        while (!worklist.empty()) {
+            const u32 v = worklist.back();
+            worklist.pop_back();
+            for (const u32 site : assigned_by.successors(v)) need_operands(*sites[site]);
+        }
+
+        //locals still referred to by a node, their storage stays
+        var_set referred {vars.locals.size(), memory};
+        for (u32 b = 0; b < graph.size(); b++) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const size_t size = body.size();
+            std::erase_if(body, [&](const Node& node) {
+                return is_pure(node.op) && index(node.operand1) != NONE && !needed.contains(index(node.operand1));
+            });
+            removed += size - body.size();
+            for (const auto& node : body) {
+                if (node.op == Operation::ALLOC || node.op == Operation::DEALLOC) continue;
+                for (const Operand* o : {&node.operand1, &node.operand2}) {
+                    if (!o->is_instant && vars.local(o->value) != NONE) referred.insert(vars.local(o->value));
+                }
+            }
+        }
+        for (u32 b = 0; b < graph.size(); b++) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const size_t size = body.size();
+            std::erase_if(body, [&](const Node& node) {
+                if (node.op != Operation::ALLOC && node.op != Operation::DEALLOC) return false;
+                const u32 l = vars.local(node.operand1.value);
+                return l != NONE && !referred.contains(l);
+            });
+            removed += size - body.size();
+        }
+        return removed;
+    }
+}
+
+#endif  //DCE_H
@@ -0,0 +1,150 @@
+#ifndef DOMINATORS_H
+#define DOMINATORS_H
+
+#include <algorithm>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include "CFG_parts.h"
+
+namespace eraxc::JIR {
+
+    /// Reachable blocks of one function numbered by their position in layout order, entry block is 0, and edges
+    /// between them. Predecessors of a block are ordered by their position, which is the order phi nodes of the
+    /// block take their values in
+    class block_graph {
+        size_t first_node_id;
+        std::pmr::vector<u32> order;
+        //position of every node of the snapshot, NONE for unreachable ones
+        std::pmr::vector<u32> positions;
+        adjacency edges;
+
+    public:
+        static constexpr u32 NONE = -1;
+
+        /// @param fn function snapshot or CFG, anything with get_cfg_node()
+        /// @param blocks reachable blocks in layout order, see layout_blocks()
+        /// @param memory resource for the graph, e.g. scratch memory of the pass
+        template<typename graph_t>
+        block_graph(const graph_t& fn, const std::vector<u32>& blocks,
+                    std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : first_node_id(blocks.empty() ? 0 : *std::min_element(blocks.begin(), blocks.end())),
+              order(blocks.begin(), blocks.end(), memory),
+              positions(blocks.empty() ? 0 : *std::max_element(blocks.begin(), blocks.end()) + 1 - first_node_id,
+                        NONE, memory),
+              edges(memory) {
+            for (u32 b = 0; b < order.size(); b++) positions[order[b] - first_node_id] = b;
+            for (u32 b = 0; b < order.size(); b++) {
+                const terminator& exit = fn.get_cfg_node(order[b]).exit;
+                if (exit.kind == terminator::BRANCH) edges.add(b, position(exit.next));
+                if (exit.kind == terminator::JUMP || exit.kind == terminator::BRANCH)
+                    edges.add(b, position(exit.target));
+            }
+            edges.build(order.size());
+        }
+
+        size_t size() const { return order.size(); }
+
+        /// @return node id of block at position `b`
+        u32 id(u32 b) const { return order[b]; }
+
+        /// @return position of block with node id, NONE if it's unreachable
+        u32 position(size_t node_id) const {
+            return node_id - first_node_id < positions.size() ? positions[node_id - first_node_id] : NONE;
+        }
+
+        std::span<const u32> successors(u32 b) const { return edges.successors(b); }
+        std::span<const u32> predecessors(u32 b) const { return edges.predecessors(b); }
+    };
+
+    /// Dominator tree and dominance frontiers of block graph, by iterative algorithm of Cooper, Harvey and Kennedy.
+    /// Layout order is reverse post-order, so blocks are processed in it and a single pass is enough for acyclic graph
+    class dominator_tree {
+        std::pmr::vector<u32> idoms;
+        adjacency tree;
+        adjacency frontiers;
+        //preorder and postorder numbers of blocks in the tree, to answer dominates() in constant time
+        std::pmr::vector<u32> pre;
+        std::pmr::vector<u32> post;
+
+        u32 intersect(u32 a, u32 b) const {
+            //block dominating another one comes before it in reverse post-order
+            while (a != b) {
+                while (a > b) a = idoms[a];
+                while (b > a) b = idoms[b];
+            }
+            return a;
+        }
+
+    public:
+        explicit dominator_tree(const block_graph& graph,
+                                std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : idoms(graph.size(), block_graph::NONE, memory), tree(memory), frontiers(memory),
+              pre(graph.size(), memory), post(graph.size(), memory) {
+            if (graph.size() == 0) return;
+            idoms[0] = 0;
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (u32 b = 1; b < graph.size(); b++) {
+                    u32 idom = block_graph::NONE;
+                    for (u32 p : graph.predecessors(b)) {
+                        if (idoms[p] == block_graph::NONE) continue;
+                        idom = idom == block_graph::NONE ? p : intersect(p, idom);
+                    }
+                    if (idoms[b] != idom) {
+                        idoms[b] = idom;
+                        changed = true;
+                    }
+                }
+            }
+            for (u32 b = 1; b < graph.size(); b++) tree.add(idoms[b], b);
+            tree.build(graph.size());
+
+            //frontier of every block on the way from predecessor of a join up to join's immediate dominator
+            std::pmr::vector<u32> last_join(graph.size(), block_graph::NONE, memory);
+            for (u32 b = 0; b < graph.size(); b++) {
+                if (graph.predecessors(b).size() < 2) continue;
+                for (u32 runner : graph.predecessors(b)) {
+                    while (runner != idoms[b] && last_join[runner] != b) {
+                        frontiers.add(runner, b);
+                        last_join[runner] = b;
+                        runner = idoms[runner];
+                    }
+                }
+            }
+            frontiers.build(graph.size());
+
+            u32 pre_number = 0;
+            u32 post_number = 0;
+            std::pmr::vector<std::pair<u32, u32>> stack {{{0, 0}}, memory};
+            pre[0] = pre_number++;
+            while (!stack.empty()) {
+                auto& [b, visited_children] = stack.back();
+                const auto children = tree.successors(b);
+                if (visited_children == children.size()) {
+                    post[b] = post_number++;
+                    stack.pop_back();
+                    continue;
+                }
+                const u32 child = children[visited_children++];
+                pre[child] = pre_number++;
+                stack.emplace_back(child, 0);
+            }
+        }
+
+        /// @return immediate dominator of block, entry block is its own
+        u32 idom(u32 b) const { return idoms[b]; }
+
+        /// Blocks `b` is immediate dominator of
+        std::span<const u32> children(u32 b) const { return tree.successors(b); }
+
+        /// Blocks where dominance of `b` ends: `b` dominates one of their predecessors but not them
+        std::span<const u32> frontier(u32 b) const { return frontiers.successors(b); }
+
+        /// Whether every path from entry to `b` goes through `a`. Block dominates itself
+        bool dominates(u32 a, u32 b) const { return pre[a] <= pre[b] && post[b] <= post[a]; }
+    };
+}
+
+#endif  //DOMINATORS_H
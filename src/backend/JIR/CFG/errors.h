@@ -2,11 +2,26 @@
 #define ERRORS_H
 #include <string>
 
+#include "util/common.h"
+
 namespace eraxc::JIR {
     const std::string NO_ENTRYPOINT_ERROR = "Entrypoint `int main() {...}` not found!";
     const std::string UNKNOWN_TYPENAME_ERROR = "Unknown typename: ";
     const std::string UNKNOWN_IDENTIFIER_ERROR = "Unknown identifier: ";
 
+    /// Codes of CFG diagnostics, printed as `E<code>`. Values are never reused, so tools can rely on them
+    enum error_code : u16 {
+        SYNTAX_ERROR = 1,
+        UNKNOWN_TYPENAME = 2,
+        UNKNOWN_IDENTIFIER = 3,
+        REDEFINITION = 4,
+        TYPE_MISMATCH = 5,
+        ARGUMENTS_COUNT = 6,
+        NO_ENTRYPOINT = 7,
+        UNSUPPORTED = 8,
+        INTERNAL_ERROR = 9,
+        TOO_MANY_ERRORS = 10,
+    };
 }
 
 #endif  //ERRORS_H
@@ -0,0 +1,61 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "CFG_parts.h"
+
+namespace eraxc::JIR {
+
+    /// Block layout pass: orders blocks of a function reachable from its entry in reverse post-order, so every block
+    /// except loop headers comes after all its predecessors. Branch successors are visited taken one first, which puts
+    /// the not taken one right after the branch whenever nothing else has to go in between, so it's reached by
+    /// falling through and codegen emits no jump to it. Unreachable blocks are left out
+    /// @param entry first block of the function
+    /// @param node returns CFG_Node of block id, e.g. get_cfg_node() of CFG or snapshot
+    /// @param scratch resource for the walk, e.g. arena of the CFG
+    /// @return block ids in emission order
+    template<typename node_getter>
+    std::vector<u32> layout_blocks(size_t entry, node_getter&& node,
+                                   std::pmr::memory_resource* scratch = std::pmr::get_default_resource()) {
+        //blocks of a function are created after its entry, so ids are indexed from it
+        std::pmr::vector<bool> visited(scratch);
+        auto visit = [&](size_t id) {
+            if (id - entry >= visited.size()) visited.resize(id - entry + 1);
+            if (visited[id - entry]) return false;
+            visited[id - entry] = true;
+            return true;
+        };
+
+        std::pmr::vector<u32> order {scratch};
+        //block and how many of its successors are visited already
+        std::pmr::vector<std::pair<u32, int>> stack {scratch};
+        stack.emplace_back(u32(entry), 0);
+        visit(entry);
+        while (!stack.empty()) {
+            auto& [id, visited_successors] = stack.back();
+            const terminator& exit = node(id).exit;
+            u32 successor = 0;
+            bool has_successor = false;
+            if (exit.kind == terminator::JUMP && visited_successors == 0) {
+                successor = exit.target;
+                has_successor = true;
+            } else if (exit.kind == terminator::BRANCH && visited_successors < 2) {
+                successor = visited_successors == 0 ? exit.target : exit.next;
+                has_successor = true;
+            }
+            if (!has_successor) {
+                order.push_back(id);
+                stack.pop_back();
+                continue;
+            }
+            visited_successors++;
+            if (visit(successor)) stack.emplace_back(successor, 0);
+        }
+        return {order.rbegin(), order.rend()};
+    }
+}
+
+#endif  //LAYOUT_H
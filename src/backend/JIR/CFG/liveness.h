@@ -0,0 +1,115 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <bit>
+#include <memory_resource>
+#include <vector>
+
+#include "dominators.h"
+
+namespace eraxc::JIR {
+
+    /// Set of variables numbered densely from 0
+    class var_set {
+        std::pmr::vector<u64> words;
+
+    public:
+        explicit var_set(size_t size, std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : words((size + 63) / 64, memory) {}
+
+        bool contains(u32 v) const { return words[v / 64] >> (v % 64) & 1; }
+        void insert(u32 v) { words[v / 64] |= u64(1) << (v % 64); }
+        void erase(u32 v) { words[v / 64] &= ~(u64(1) << (v % 64)); }
+
+        /// Adds every variable of `other` except ones in `except`
+        /// @return whether anything was added
+        bool unite(const var_set& other, const var_set* except = nullptr) {
+            bool changed = false;
+            for (size_t w = 0; w < words.size(); w++) {
+                const u64 added = other.words[w] & ~(except ? except->words[w] : 0) & ~words[w];
+                words[w] |= added;
+                changed |= added != 0;
+            }
+            return changed;
+        }
+
+        template<typename F>
+        void for_each(F&& f) const {
+            for (size_t w = 0; w < words.size(); w++) {
+                for (u64 bits = words[w]; bits != 0; bits &= bits - 1) f(u32(w * 64 + std::countr_zero(bits)));
+            }
+        }
+    };
+
+    /// Variables live on entry to and on exit from every block of a function, by backward data-flow.
+    /// Phi node defines its variable on entry to its block and reads its value on exit from the predecessor it's
+    /// for, so values phi nodes take are live out of predecessors but not in their block
+    class liveness {
+        std::pmr::vector<var_set> ins;
+        std::pmr::vector<var_set> outs;
+
+        static std::pmr::vector<var_set> sets(size_t count, size_t variables, std::pmr::memory_resource* memory) {
+            std::pmr::vector<var_set> result(memory);
+            result.reserve(count);
+            for (size_t i = 0; i < count; i++) result.emplace_back(variables, memory);
+            return result;
+        }
+
+    public:
+        /// @param fn function snapshot or CFG the graph is of
+        /// @param variables count of tracked variables
+        /// @param index dense number of variable id, NONE for ids that aren't tracked, e.g. globals
+        /// @param memory resource for the sets, e.g. scratch memory of the pass
+        template<typename graph_t, typename index_t>
+        liveness(const graph_t& fn, const block_graph& graph, size_t variables, index_t&& index,
+                 std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : ins(sets(graph.size(), variables, memory)), outs(sets(graph.size(), variables, memory)) {
+            //variables read before they're written in block and ones it writes
+            auto uses = sets(graph.size(), variables, memory);
+            auto defs = sets(graph.size(), variables, memory);
+            //values phi nodes of successors take from the block
+            auto phi_uses = sets(graph.size(), variables, memory);
+            auto tracked = [&](const Operand& o) { return !o.is_instant && index(o.value) != block_graph::NONE; };
+            for (u32 b = 0; b < graph.size(); b++) {
+                const auto& body = fn.get_cfg_node(graph.id(b)).body;
+                const auto preds = graph.predecessors(b);
+                u32 phis = 0;
+                for (const auto& node : body) {
+                    if (node.op == Operation::PHI) {
+                        const u32 from = preds[phis % preds.size()];
+                        if (tracked(node.operand2)) phi_uses[from].insert(index(node.operand2.value));
+                        if (tracked(node.operand1)) defs[b].insert(index(node.operand1.value));
+                        phis++;
+                        continue;
+                    }
+                    auto read = [&](const Operand& o) {
+                        if (tracked(o) && !defs[b].contains(index(o.value))) uses[b].insert(index(o.value));
+                    };
+                    if (reads_operand1(node.op)) read(node.operand1);
+                    if (reads_operand2(node.op)) read(node.operand2);
+                    if (writes_operand1(node.op) && tracked(node.operand1)) defs[b].insert(index(node.operand1.value));
+                    if (writes_operand2(node.op) && tracked(node.operand2)) defs[b].insert(index(node.operand2.value));
+                }
+            }
+
+            //successors come later in layout order except for loop back edges, so one backward sweep is usually enough
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (u32 b = graph.size(); b-- > 0;) {
+                    changed |= outs[b].unite(phi_uses[b]);
+                    for (u32 s : graph.successors(b)) changed |= outs[b].unite(ins[s]);
+                    changed |= ins[b].unite(uses[b]);
+                    changed |= ins[b].unite(outs[b], &defs[b]);
+                }
+            }
+        }
+
+        /// Variables live on entry to block at position `b`, results of its phi nodes excluded
+        const var_set& live_in(u32 b) const { return ins[b]; }
+
+        /// Variables live on exit from block at position `b`
+        const var_set& live_out(u32 b) const { return outs[b]; }
+    };
+}
+
+#endif  //LIVENESS_H
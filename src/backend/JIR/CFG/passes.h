@@ -0,0 +1,33 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+#include "dce.h"
+#include "sccp.h"
+#include "ssa.h"
+
+namespace eraxc::JIR {
+
+    /// Passes every function goes through between parsing and codegen. Function is put into SSA form for them and
+    /// taken out of it before codegen, which knows nothing about phi nodes
+    /// @param fn snapshot of the function, changed in place
+    /// @param func function the snapshot is of, its blocks may be laid out again
+    /// @param optimization_level `-O` option: 0 leaves nodes as they were parsed, 1 propagates constants
+    /// and eliminates dead code
+    inline void run_function_passes(CFG_FuncSnapshot& fn, CFG_Func& func, int optimization_level = 0) {
+        //what passes need only while they run, a function of usual size fits on the stack
+        std::array<std::byte, 16 << 10> buffer;
+        std::pmr::monotonic_buffer_resource scratch {buffer.data(), buffer.size()};
+        const ssa_variables vars = construct_ssa(fn, func, &scratch);
+        if (optimization_level >= 1) {
+            propagate_constants(fn, func, vars, &scratch);
+            eliminate_dead_code(fn, func, vars, &scratch);
+        }
+        destruct_ssa(fn, func, vars, &scratch);
+    }
+}
+
+#endif  //PASSES_H
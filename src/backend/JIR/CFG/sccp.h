@@ -0,0 +1,424 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "dce.h"
+
+namespace eraxc::JIR {
+
+    /// @return width of integer type in bits, 0 for types whose constants aren't folded, e.g. i128
+    inline u32 type_bits(u64 type) {
+        switch (type) {
+            case syntax::i8:
+            case syntax::u8: return 8;
+            case syntax::i16:
+            case syntax::u16: return 16;
+            case syntax::i32:
+            case syntax::u32: return 32;
+            case syntax::i64:
+            case syntax::u64: return 64;
+            default: return 0;
+        }
+    }
+
+    inline bool is_signed(u64 type) {
+        return type == syntax::i8 || type == syntax::i16 || type == syntax::i32 || type == syntax::i64;
+    }
+
+    /// @return value cut to width of type. Constants are kept that way, zero-extended
+    inline u64 truncate(u64 value, u64 type) {
+        const u32 bits = type_bits(type);
+        return bits == 0 || bits == 64 ? value : value & ((u64(1) << bits) - 1);
+    }
+
+    /// @return value of type extended to 64 bits by its signedness
+    inline u64 extend(u64 value, u64 type) {
+        const u32 bits = type_bits(type);
+        if (bits == 0 || bits == 64) return value;
+        const u64 sign = u64(1) << (bits - 1);
+        value = truncate(value, type);
+        return is_signed(type) && (value & sign) ? value | ~((sign << 1) - 1) : value;
+    }
+
+    /// Value node assigns to its first operand, computed in type of the operand. Operands of other types are extended
+    /// by their own signedness first, like codegen extends instants
+    /// @param a value of the first operand, if node reads it
+    /// @param b value of the second operand, if node reads it
+    /// @return nothing if node isn't arithmetic or MOVE, or result isn't defined, e.g. of division by zero
+    inline std::optional<u64> fold(const Node& node, u64 a, u64 b) {
+        const u64 type = node.operand1.type;
+        const u32 bits = type_bits(type);
+        if (bits == 0 || (reads_operand2(node.op) && type_bits(node.operand2.type) == 0)) return {};
+        const u64 x = extend(a, type);
+        const u64 y = extend(b, node.operand2.type);
+        //x86 masks shift counts to 5 bits, 6 for 64-bit operands
+        const u64 count = y & (bits == 64 ? 63 : 31);
+        u64 result;
+        switch (node.op) {
+            case Operation::MOVE: result = y; break;
+            case Operation::ADD: result = x + y; break;
+            case Operation::SUB: result = x - y; break;
+            case Operation::MUL: result = x * y; break;
+            case Operation::DIV:
+            case Operation::MOD: {
+                if (truncate(y, type) == 0) return {};
+                if (!is_signed(type)) {
+                    result = node.op == Operation::DIV ? truncate(x, type) / truncate(y, type)
+                                                       : truncate(x, type) % truncate(y, type);
+                    break;
+                }
+                //the smallest value divided by -1 overflows
+                if (i64(y) == -1 && x == extend(u64(1) << (bits - 1), type)) return {};
+                result = u64(node.op == Operation::DIV ? i64(x) / i64(y) : i64(x) % i64(y));
+                break;
+            }
+            case Operation::INC: result = x + 1; break;
+            case Operation::DEC: result = x - 1; break;
+            case Operation::NOT: result = ~x; break;
+            case Operation::NEG: result = u64(0) - x; break;
+            case Operation::AND: result = x & y; break;
+            case Operation::OR: result = x | y; break;
+            case Operation::XOR: result = x ^ y; break;
+            case Operation::LSHIFT: result = x << count; break;
+            case Operation::RSHIFT: result = is_signed(type) ? u64(i64(x) >> count) : x >> count; break;
+            default: return {};
+        }
+        return truncate(result, type);
+    }
+
+    /// Whether conditional jump after `CMP a, b` is taken. Codegen compares in type of the first operand
+    /// @return nothing for a condition that isn't a conditional jump
+    inline std::optional<bool> fold_condition(Operation condition, const Node& cmp, u64 a, u64 b) {
+        const u64 type = cmp.operand1.type;
+        if (type_bits(type) == 0 || type_bits(cmp.operand2.type) == 0) return {};
+        //jumps after CMP are signed ones
+        const u64 sign_type = type_bits(type) == 8 ? syntax::i8 : type_bits(type) == 16 ? syntax::i16
+                            : type_bits(type) == 32 ? syntax::i32 : syntax::i64;
+        const i64 x = i64(extend(a, sign_type));
+        const i64 y = i64(extend(extend(b, cmp.operand2.type), sign_type));
+        switch (condition) {
+            case Operation::JE: return x == y;
+            case Operation::JNE: return x != y;
+            case Operation::JG: return x > y;
+            case Operation::JGE: return x >= y;
+            case Operation::JL: return x < y;
+            case Operation::JLE: return x <= y;
+            default: return {};
+        }
+    }
+
+    /// Whether codegen can use constant as an instant operand of node instead of a variable. Arithmetic takes at most
+    /// 32-bit instants, sign-extended to 64 bits, and shifts an 8-bit count. MOVE and divisor take any
+    inline bool fits_instant(Operation op, u64 value, u64 type) {
+        switch (op) {
+            case Operation::LSHIFT:
+            case Operation::RSHIFT: return value <= 0xFF;
+            case Operation::ADD:
+            case Operation::SUB:
+            case Operation::MUL:
+            case Operation::AND:
+            case Operation::OR:
+            case Operation::XOR:
+            case Operation::CMP:
+                return type_bits(type) != 64 || (i64(value) >= std::numeric_limits<int32_t>::min() &&
+                                                 i64(value) <= std::numeric_limits<int32_t>::max());
+            default: return true;
+        }
+    }
+
+    /// Sparse conditional constant propagation of Wegman and Zadeck over function in SSA form. Every version is
+    /// unknown until a node assigning it runs, then constant or varying, and a block runs only once an edge to it does,
+    /// so constants flow only along paths that can be taken and a branch on constant condition takes one edge.
+    /// Then reads of constant versions become instants, nodes computing constants become MOVE of them, branches on
+    /// constant conditions become jumps, and blocks that can't run are emptied. Nodes left unread are up to
+    /// eliminate_dead_code().
+    ///
+    /// A version updated in place holds different values along its nodes, so block is evaluated node by node
+    /// and version gets the value it has after the last of them, the one its readers see
+    /// @param vars locals returned by construct_ssa()
+    /// @param memory resource for everything the pass needs only while it runs
+    /// @return count of folded nodes, removed ones and resolved branches
+    inline size_t propagate_constants(CFG_FuncSnapshot& fn, CFG_Func& func, const ssa_variables& vars,
+                                      std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        if (vars.locals.empty()) return 0;
+        const block_graph graph {fn, func.blocks, memory};
+        constexpr u32 NONE = ssa_variables::NONE;
+        auto index = [&](const Operand& o) { return o.is_instant ? NONE : vars.index(o.value); };
+
+        struct lattice {
+            enum state_t : unsigned char { UNKNOWN, CONSTANT, VARYING };
+            state_t state = UNKNOWN;
+            u64 value = 0;
+
+            bool operator==(const lattice&) const = default;
+        };
+        auto meet = [](const lattice& a, const lattice& b) -> lattice {
+            if (a.state == lattice::UNKNOWN) return b;
+            if (b.state == lattice::UNKNOWN || a == b) return a;
+            return {lattice::VARYING};
+        };
+        std::pmr::vector<lattice> values(vars.size(), memory);
+        //locals themselves are what's read before assignment, i.e. parameters and uninitialized variables
+        for (u32 l = 0; l < vars.locals.size(); l++) values[l].state = lattice::VARYING;
+
+        //blocks reading every version, evaluated again when its value changes
+        adjacency readers {memory};
+        std::pmr::vector<u32> last_reader(vars.size(), NONE, memory);
+        for (u32 b = 0; b < graph.size(); b++) {
+            for (const auto& node : fn.get_cfg_node(graph.id(b)).body) {
+                for (const u32 v : {reads_operand1(node.op) ? index(node.operand1) : NONE,
+                                    reads_operand2(node.op) ? index(node.operand2) : NONE}) {
+                    if (v == NONE || last_reader[v] == b) continue;
+                    last_reader[v] = b;
+                    readers.add(v, b);
+                }
+            }
+        }
+        readers.build(std::max(vars.size(), graph.size()));
+
+        //blocks and edges that can run, edge by block and its position in successors of the block
+        std::pmr::vector<bool> executable(graph.size(), false, memory);
+        std::pmr::vector<bool> executable_edges(graph.size() * 2, false, memory);
+        auto edge = [&](u32 from, u32 to) {
+            const auto successors = graph.successors(from);
+            return from * 2 + (std::find(successors.begin(), successors.end(), to) - successors.begin());
+        };
+
+        //values versions have at the current node of block being evaluated, valid for versions its walk assigned
+        std::pmr::vector<lattice> current(vars.size(), memory);
+        std::pmr::vector<u32> walked(vars.size(), NONE, memory);
+        std::pmr::vector<u32> assigned {memory};
+        u32 walk = 0;
+        auto value_of = [&](const Operand& o) -> lattice {
+            if (o.is_instant) return {lattice::CONSTANT, truncate(o.value, o.type)};
+            const u32 v = index(o);
+            if (v == NONE) return {lattice::VARYING};
+            return walked[v] == walk ? current[v] : values[v];
+        };
+        auto assign = [&](u32 v, const lattice& value) {
+            if (walked[v] != walk) assigned.push_back(v);
+            walked[v] = walk;
+            current[v] = value;
+        };
+        //what node assigns, phi nodes excluded
+        auto evaluate = [&](const Node& node) -> lattice {
+            const lattice a = reads_operand1(node.op) ? value_of(node.operand1) : lattice {lattice::CONSTANT};
+            const lattice b = reads_operand2(node.op) ? value_of(node.operand2) : lattice {lattice::CONSTANT};
+            if (a.state == lattice::VARYING || b.state == lattice::VARYING) return {lattice::VARYING};
+            if (a.state == lattice::UNKNOWN || b.state == lattice::UNKNOWN) return {};
+            const auto result = fold(node, a.value, b.value);
+            return result ? lattice {lattice::CONSTANT, *result} : lattice {lattice::VARYING};
+        };
+        //walks block in order, calling `visit` with index of every node once it's evaluated, and with CMP last before
+        //its terminator. Phi nodes take values only over edges that run
+        const Node* cmp = nullptr;
+        lattice flags[2];
+        auto walk_block = [&](u32 b, auto&& visit) {
+            walk++;
+            assigned.clear();
+            cmp = nullptr;
+            const auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const auto preds = graph.predecessors(b);
+            for (size_t n = 0; n < body.size(); n++) {
+                const Node& node = body[n];
+                const u32 v1 = writes_operand1(node.op) ? index(node.operand1) : NONE;
+                if (node.op == Operation::PHI) {
+                    const bool first = n == 0 || body[n - 1].operand1.value != node.operand1.value;
+                    if (v1 == NONE) continue;
+                    if (first) assign(v1, {});
+                    //value from predecessor is the one it had on exit from it, not the one assigned since
+                    if (executable_edges[edge(preds[n % preds.size()], b)]) {
+                        const u32 v2 = index(node.operand2);
+                        current[v1] = meet(current[v1], v2 == NONE ? value_of(node.operand2) : values[v2]);
+                    }
+                    visit(n);
+                    continue;
+                }
+                if (node.op == Operation::CMP) {
+                    cmp = &node;
+                    flags[0] = value_of(node.operand1);
+                    flags[1] = value_of(node.operand2);
+                }
+                if (v1 != NONE) assign(v1, evaluate(node));
+                if (writes_operand2(node.op) && index(node.operand2) != NONE)
+                    assign(index(node.operand2), {lattice::VARYING});
+                visit(n);
+            }
+        };
+        //taken successors of block walked last: both, one, or none while condition is unknown
+        auto taken = [&](u32 b, u32& target, u32& next) {
+            const terminator& exit = fn.get_cfg_node(graph.id(b)).exit;
+            target = next = NONE;
+            if (exit.kind == terminator::JUMP) target = graph.position(exit.target);
+            if (exit.kind != terminator::BRANCH) return;
+            std::optional<bool> condition;
+            if (cmp && flags[0].state == lattice::CONSTANT && flags[1].state == lattice::CONSTANT)
+                condition = fold_condition(exit.condition, *cmp, flags[0].value, flags[1].value);
+            else if (cmp && (flags[0].state == lattice::UNKNOWN || flags[1].state == lattice::UNKNOWN)) return;
+            if (!condition || *condition) target = graph.position(exit.target);
+            if (!condition || !*condition) next = graph.position(exit.next);
+        };
+
+        std::pmr::vector<u32> worklist {memory};
+        worklist.push_back(0);
+        std::pmr::vector<bool> queued(graph.size(), false, memory);
+        executable[0] = queued[0] = true;
+        while (!worklist.empty()) {
+            const u32 b = worklist.back();
+            worklist.pop_back();
+            queued[b] = false;
+            walk_block(b, [](size_t) {});
+            for (const u32 v : assigned) {
+                const lattice value = meet(values[v], current[v]);
+                if (value == values[v]) continue;
+                values[v] = value;
+                for (const u32 r : readers.successors(v)) {
+                    if (executable[r] && !queued[r]) {
+                        queued[r] = true;
+                        worklist.push_back(r);
+                    }
+                }
+            }
+            u32 target, next;
+            taken(b, target, next);
+            for (const u32 s : {target, next}) {
+                if (s == NONE || executable_edges[edge(b, s)]) continue;
+                executable_edges[edge(b, s)] = true;
+                executable[s] = true;
+                if (!queued[s]) {
+                    queued[s] = true;
+                    worklist.push_back(s);
+                }
+            }
+        }
+
+        //rewrite. Every node assigning a version links to the previous one assigning it in the block, so a node
+        //computing constant drops the nodes before it
+        size_t changed = 0;
+        bool resolved = false;
+        std::pmr::vector<Node> rewritten {memory};
+        std::pmr::vector<u32> previous_write {memory};
+        std::pmr::vector<u32> last_write(vars.size(), NONE, memory);
+        auto constant = [&](const Operand& o, Operation op) {
+            const u32 v = index(o);
+            return v != NONE && values[v].state == lattice::CONSTANT && fits_instant(op, values[v].value, o.type);
+        };
+        auto instant = [&](Operand& o) { o = {o.type, values[index(o)].value, true, true}; };
+        for (u32 b = 0; b < graph.size(); b++) {
+            CFG_Node& block = fn.get_cfg_node(graph.id(b));
+            if (!executable[b]) {
+                changed += block.body.size();
+                block.body.clear();
+                block.exit = {};
+                continue;
+            }
+            rewritten.clear();
+            previous_write.clear();
+            const auto preds = graph.predecessors(b);
+            walk_block(b, [&](size_t n) {
+                Node node = block.body[n];
+                const u32 v1 = writes_operand1(node.op) ? index(node.operand1) : NONE;
+                if (node.op == Operation::PHI && !executable_edges[edge(preds[n % preds.size()], b)]) {
+                    changed++;
+                    return;
+                }
+                if (node.op == Operation::PHI && constant(node.operand2, Operation::MOVE)) instant(node.operand2);
+                if (node.op != Operation::PHI) {
+                    if (reads_operand2(node.op) && constant(node.operand2, node.op)) instant(node.operand2);
+                    if (reads_operand1(node.op) && !writes_operand1(node.op) && constant(node.operand1, node.op))
+                        instant(node.operand1);
+                    const bool folded = node.op == Operation::MOVE && node.operand2.is_instant;
+                    if (v1 != NONE && current[v1].state == lattice::CONSTANT && !folded) {
+                        node = {Operation::MOVE, node.operand1, {node.operand1.type, current[v1].value, true, true}};
+                        changed++;
+                        for (u32 w = last_write[v1]; w != NONE; w = previous_write[w]) {
+                            rewritten[w].op = Operation::NONE;
+                            changed++;
+                        }
+                        last_write[v1] = NONE;
+                    }
+                }
+                previous_write.push_back(v1 == NONE ? NONE : last_write[v1]);
+                if (v1 != NONE) last_write[v1] = rewritten.size();
+                rewritten.push_back(node);
+            });
+            for (const u32 v : assigned) last_write[v] = NONE;
+
+            u32 target, next;
+            taken(b, target, next);
+            if (block.exit.kind == terminator::BRANCH && (target == NONE) != (next == NONE)) {
+                //CMP only set flags for the branch
+                for (size_t n = rewritten.size(); n-- > 0;) {
+                    if (rewritten[n].op != Operation::CMP) continue;
+                    rewritten[n].op = Operation::NONE;
+                    break;
+                }
+                block.exit = {terminator::JUMP, Operation::NONE, target == NONE ? block.exit.next : block.exit.target};
+                changed++;
+                resolved = true;
+            }
+            std::erase_if(rewritten, [](const Node& node) { return node.op == Operation::NONE; });
+            block.body.assign(rewritten.begin(), rewritten.end());
+        }
+        if (!resolved) return changed;
+
+        //blocks are laid out again without the pruned ones, and phi nodes follow new order of predecessors
+        func.blocks = layout_blocks(func.node_id, [&](size_t id) -> const CFG_Node& { return fn.get_cfg_node(id); },
+                                    memory);
+        fn.index_edges();
+        const block_graph pruned {fn, func.blocks, memory};
+        std::pmr::vector<u32> kept {memory};
+        std::pmr::vector<u32> order {memory};
+        for (u32 b = 0; b < graph.size(); b++) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            if (!executable[b] || body.empty() || body[0].op != Operation::PHI) continue;
+            kept.clear();
+            for (const u32 p : graph.predecessors(b)) {
+                if (executable_edges[edge(p, b)]) kept.push_back(graph.id(p));
+            }
+            if (kept.empty()) continue;
+            order.clear();
+            for (const u32 p : pruned.predecessors(pruned.position(graph.id(b)))) {
+                order.push_back(std::find(kept.begin(), kept.end(), pruned.id(p)) - kept.begin());
+            }
+            size_t phi_nodes = 0;
+            while (phi_nodes < body.size() && body[phi_nodes].op == Operation::PHI) phi_nodes++;
+            rewritten.assign(body.begin(), body.begin() + phi_nodes);
+            for (size_t n = 0; n < phi_nodes; n++) body[n] = rewritten[n - n % kept.size() + order[n % kept.size()]];
+        }
+        return changed;
+    }
+
+    /// Values straight-line code without inputs leaves in variables it assigns, e.g. initializers of globals in
+    /// node 0, so they can be data instead of code
+    /// @return value of every variable code assigns by its id, nothing if it does anything but constant arithmetic
+    inline std::optional<std::map<u64, u64>> fold_straight_line(std::span<const Node> body) {
+        std::map<u64, u64> values;
+        auto value_of = [&](const Operand& o) -> std::optional<u64> {
+            if (o.is_instant) return truncate(o.value, o.type);
+            const auto it = values.find(o.value);
+            return it == values.end() ? std::nullopt : std::optional {it->second};
+        };
+        for (const auto& node : body) {
+            if (node.op == Operation::ALLOC || node.op == Operation::DEALLOC) continue;
+            if (!is_pure(node.op) || node.op == Operation::PHI || node.operand1.is_instant) return {};
+            std::optional<u64> a = 0, b = 0;
+            if (reads_operand1(node.op)) a = value_of(node.operand1);
+            if (reads_operand2(node.op)) b = value_of(node.operand2);
+            if (!a || !b) return {};
+            const auto result = fold(node, *a, *b);
+            if (!result) return {};
+            values[node.operand1.value] = *result;
+        }
+        return values;
+    }
+}
+
+#endif  //SCCP_H
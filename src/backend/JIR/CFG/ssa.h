@@ -0,0 +1,437 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <algorithm>
+#include <memory_resource>
+#include <tuple>
+#include <vector>
+
+#include "dominators.h"
+#include "layout.h"
+#include "liveness.h"
+
+namespace eraxc::JIR {
+
+    /// Variables of a function in SSA form. Locals are the variables renamed into versions: parameters and variables
+    /// allocated in function blocks. Globals are memory any call may change, so they keep their ids.
+    /// Every local and version has a dense index for bitsets, locals come first
+    struct ssa_variables {
+        static constexpr u32 NONE = block_graph::NONE;
+
+        std::pmr::vector<Operand> locals;
+        //index of every local by `id - first_local`, ids function uses are close to each other
+        u64 first_local = 0;
+        std::pmr::vector<u32> local_indices;
+        //versions get ids after every id the function used
+        u64 first_version = 0;
+        //local every version is of
+        std::pmr::vector<u32> version_of;
+
+        explicit ssa_variables(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : locals(memory), local_indices(memory), version_of(memory) {}
+
+        /// @return index of local with id, NONE for a global
+        u32 local_index(u64 id) const {
+            if (id < first_local || id - first_local >= local_indices.size()) return NONE;
+            return local_indices[id - first_local];
+        }
+
+        /// @return index of local `id` is a version of or the local itself, NONE for a global
+        u32 local(u64 id) const {
+            if (id >= first_version && id - first_version < version_of.size()) return version_of[id - first_version];
+            return local_index(id);
+        }
+
+        /// @return dense index of local or version, NONE for a global
+        u32 index(u64 id) const {
+            if (id >= first_version && id - first_version < version_of.size())
+                return u32(locals.size() + id - first_version);
+            return local_index(id);
+        }
+
+        u64 id(u32 index) const {
+            return index < locals.size() ? locals[index].value : first_version + index - locals.size();
+        }
+
+        /// Count of locals and versions
+        size_t size() const { return locals.size() + version_of.size(); }
+
+        u64 add_version(u32 local) {
+            version_of.push_back(local);
+            return first_version + version_of.size() - 1;
+        }
+    };
+
+    /// Puts function into pruned SSA form: every local gets a new version at each assignment, and a phi node at every
+    /// block of iterated dominance frontier of its assignments it's live in. Reads are renamed to the version reaching
+    /// them along the dominator tree.
+    ///
+    /// Phi node of a local is a run of PHI nodes at the start of block, one for every predecessor in block_graph
+    /// order, all with the new version as the first operand and the value coming from that predecessor as the second.
+    /// Arithmetic is two-address, so a version is written by one node and then may be updated in place by the nodes
+    /// right after it in the same block, as long as nothing else reads it in between. Otherwise the update gets a new
+    /// version, copied from the current one first. Reads before any assignment keep id of the local.
+    /// ALLOC and DEALLOC keep the local too, they're about its storage, not value
+    /// @param func function the snapshot is of, its blocks are in layout order
+    /// @param memory resource for the variables and everything the pass needs only while it runs
+    /// @return locals and their versions, for destruct_ssa() and passes working on SSA form
+    inline ssa_variables construct_ssa(CFG_FuncSnapshot& fn, const CFG_Func& func,
+                                       std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        const block_graph graph {fn, func.blocks, memory};
+        const dominator_tree dom {graph, memory};
+        constexpr u32 NONE = ssa_variables::NONE;
+
+        ssa_variables vars {memory};
+        u64 min_id = u64(-1);
+        u64 max_id = 0;
+        for (const auto& param : func.params) {
+            vars.locals.push_back(param);
+            min_id = std::min(min_id, param.value);
+            max_id = std::max(max_id, param.value);
+        }
+        for (const u32 block : func.blocks) {
+            for (const auto& node : fn.get_cfg_node(block).body) {
+                if (node.op == Operation::ALLOC) {
+                    vars.locals.push_back(node.operand1);
+                    min_id = std::min(min_id, node.operand1.value);
+                }
+                if (!node.operand1.is_instant) max_id = std::max(max_id, node.operand1.value);
+                if (!node.operand2.is_instant) max_id = std::max(max_id, node.operand2.value);
+            }
+        }
+        vars.first_version = max_id + 1;
+        if (vars.locals.empty()) return vars;
+        vars.first_local = min_id;
+        vars.local_indices.assign(max_id + 1 - min_id, NONE);
+        //the same variable may be allocated more than once
+        size_t local_count = 0;
+        for (const auto& o : vars.locals) {
+            if (vars.local_indices[o.value - min_id] != NONE) continue;
+            vars.local_indices[o.value - min_id] = local_count;
+            vars.locals[local_count++] = o;
+        }
+        vars.locals.resize(local_count);
+        auto local = [&](const Operand& o) { return o.is_instant ? NONE : vars.local(o.value); };
+
+        //blocks assigning every local. Adjacency indexes both ends of edges, so it's built for locals and blocks
+        adjacency assigned_in {memory};
+        std::pmr::vector<u32> last_assigned(local_count, NONE, memory);
+        for (u32 b = 0; b < graph.size(); b++) {
+            for (const auto& node : fn.get_cfg_node(graph.id(b)).body) {
+                u32 l = NONE;
+                if (writes_operand1(node.op)) l = local(node.operand1);
+                else if (writes_operand2(node.op)) l = local(node.operand2);
+                if (l == NONE || last_assigned[l] == b) continue;
+                last_assigned[l] = b;
+                assigned_in.add(l, b);
+            }
+        }
+        assigned_in.build(std::max(local_count, graph.size()));
+
+        //phi placement. Phi is needed only where the local is live, the rest would be dead
+        const liveness live {fn, graph, local_count, [&](u64 id) { return vars.index(id); }, memory};
+        //locals every block has phi for, in the order of locals
+        adjacency phis {memory};
+        std::pmr::vector<u32> has_phi(graph.size(), NONE, memory);
+        std::pmr::vector<u32> queued(graph.size(), NONE, memory);
+        std::pmr::vector<u32> worklist {memory};
+        for (u32 l = 0; l < local_count; l++) {
+            worklist.assign(assigned_in.successors(l).begin(), assigned_in.successors(l).end());
+            for (u32 b : worklist) queued[b] = l;
+            while (!worklist.empty()) {
+                const u32 b = worklist.back();
+                worklist.pop_back();
+                for (u32 f : dom.frontier(b)) {
+                    if (has_phi[f] == l || !live.live_in(f).contains(l)) continue;
+                    has_phi[f] = l;
+                    phis.add(f, l);
+                    if (queued[f] != l) {
+                        queued[f] = l;
+                        worklist.push_back(f);
+                    }
+                }
+            }
+        }
+        phis.build(std::max(local_count, graph.size()));
+        for (u32 b = 0; b < graph.size(); b++) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const size_t preds = graph.predecessors(b).size();
+            size_t at = 0;
+            for (u32 l : phis.successors(b)) {
+                const Operand value {vars.locals[l].type, vars.locals[l].value, false, false};
+                body.insert(body.begin() + at, preds, Node {Operation::PHI, value, value});
+                at += preds;
+            }
+        }
+
+        //renaming, in preorder of dominator tree. Versions reaching the current block, and every version it replaced
+        //so the walk restores them when it leaves block
+        std::pmr::vector<u64> reaching(memory);
+        for (const auto& o : vars.locals) reaching.push_back(o.value);
+        std::pmr::vector<std::pair<u32, u64>> replaced {memory};
+        //version assigned in the current block that nothing read yet, so it can be updated in place
+        std::pmr::vector<u64> open(local_count, u64(-1), memory);
+        std::pmr::vector<u32> opened {memory};
+        auto assign = [&](Operand& o, u32 l) {
+            const u64 version = vars.add_version(l);
+            o.value = version;
+            replaced.emplace_back(l, reaching[l]);
+            reaching[l] = version;
+            open[l] = version;
+            opened.push_back(l);
+        };
+        auto read = [&](Operand& o) {
+            const u32 l = local(o);
+            if (l == NONE) return;
+            o.value = reaching[l];
+            open[l] = u64(-1);
+        };
+
+        std::pmr::vector<Node> renamed {memory};
+        auto rename_block = [&](u32 b) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const size_t preds = graph.predecessors(b).size();
+            const size_t phi_nodes = phis.successors(b).size() * preds;
+            renamed.assign(body.begin(), body.begin() + phi_nodes);
+            for (size_t p = 0; p < phis.successors(b).size(); p++) {
+                const u32 l = phis.successors(b)[p];
+                assign(renamed[p * preds].operand1, l);
+                for (size_t n = 1; n < preds; n++) renamed[p * preds + n].operand1.value = reaching[l];
+            }
+            for (size_t n = phi_nodes; n < body.size(); n++) {
+                Node node = body[n];
+                const u32 l1 = local(node.operand1);
+                const bool update = l1 != NONE && reads_operand1(node.op) && writes_operand1(node.op);
+                if (update && open[l1] == reaching[l1]) node.operand1.value = open[l1];
+                else if (update) {
+                    //in place update of a version something else reads, so it's copied to a new one first
+                    Operand copy = node.operand1;
+                    copy.value = reaching[l1];
+                    assign(node.operand1, l1);
+                    renamed.push_back({Operation::MOVE, node.operand1, copy});
+                }
+                //`ADD a, a` reads the value being updated, which is the same in the copy
+                if (update && reads_operand2(node.op) && local(node.operand2) == l1)
+                    node.operand2.value = node.operand1.value;
+                else if (reads_operand2(node.op)) read(node.operand2);
+                if (!update && writes_operand1(node.op) && l1 != NONE) assign(node.operand1, l1);
+                else if (!update && reads_operand1(node.op)) read(node.operand1);
+                const u32 l2 = local(node.operand2);
+                if (writes_operand2(node.op) && l2 != NONE) assign(node.operand2, l2);
+                renamed.push_back(node);
+            }
+            body.assign(renamed.begin(), renamed.end());
+            for (u32 l : opened) open[l] = u64(-1);
+            opened.clear();
+
+            //values phi nodes of successors take from this block
+            for (u32 s : graph.successors(b)) {
+                const auto locals = phis.successors(s);
+                if (locals.empty()) continue;
+                const auto preds = graph.predecessors(s);
+                const size_t from = std::find(preds.begin(), preds.end(), b) - preds.begin();
+                auto& successor = fn.get_cfg_node(graph.id(s)).body;
+                for (size_t p = 0; p < locals.size(); p++) {
+                    successor[p * preds.size() + from].operand2.value = reaching[locals[p]];
+                }
+            }
+        };
+
+        //block, how many of the blocks it dominates are renamed and count of versions replaced before it
+        std::pmr::vector<std::tuple<u32, size_t, size_t>> stack {{{0, 0, 0}}, memory};
+        rename_block(0);
+        while (!stack.empty()) {
+            auto& [b, renamed_children, mark] = stack.back();
+            const auto dominated = dom.children(b);
+            if (renamed_children < dominated.size()) {
+                const u32 child = dominated[renamed_children++];
+                stack.emplace_back(child, 0, replaced.size());
+                rename_block(child);
+                continue;
+            }
+            for (; replaced.size() > mark; replaced.pop_back()) {
+                reaching[replaced.back().first] = replaced.back().second;
+            }
+            stack.pop_back();
+        }
+        return vars;
+    }
+
+    /// Takes function out of SSA form. Versions of a local that never interfere, i.e. none is live where another one
+    /// is assigned, are coalesced back into the local. That's all of them unless a pass moved code around, and then
+    /// SSA form leaves the code as it was. Interfering versions are split into groups that don't interfere, every group
+    /// except the one of the local gets its own variable allocated next to the local. Phi nodes whose value ends up
+    /// in a different variable become copies on the edge from predecessor, which is split if it's critical
+    /// @param vars locals returned by construct_ssa()
+    /// @param memory resource for everything the pass needs only while it runs
+    inline void destruct_ssa(CFG_FuncSnapshot& fn, CFG_Func& func, const ssa_variables& vars,
+                             std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        if (vars.locals.empty()) return;
+        const block_graph graph {fn, func.blocks, memory};
+        const size_t count = vars.size();
+        constexpr u32 NONE = ssa_variables::NONE;
+        auto index = [&](const Operand& o) { return o.is_instant ? NONE : vars.index(o.value); };
+        auto local_of = [&](u32 i) { return i < vars.locals.size() ? i : vars.version_of[i - vars.locals.size()]; };
+
+        //interference of versions of the same local, found walking every block backwards from what's live out of it
+        const liveness live {fn, graph, count, [&](u64 id) { return vars.index(id); }, memory};
+        std::pmr::vector<u64> interfering {memory};
+        var_set live_now {count, memory};
+        auto pair = [](u32 a, u32 b) { return u64(std::min(a, b)) << 32 | std::max(a, b); };
+        auto assigned = [&](u32 d) {
+            live_now.for_each([&](u32 x) {
+                if (x != d && local_of(x) == local_of(d)) interfering.push_back(pair(x, d));
+            });
+        };
+        for (u32 b = 0; b < graph.size(); b++) {
+            const auto& body = fn.get_cfg_node(graph.id(b)).body;
+            live_now = live.live_out(b);
+            size_t n = body.size();
+            for (; n > 0 && body[n - 1].op != Operation::PHI; n--) {
+                const Node& node = body[n - 1];
+                for (const u32 d : {writes_operand1(node.op) ? index(node.operand1) : NONE,
+                                    writes_operand2(node.op) ? index(node.operand2) : NONE}) {
+                    if (d == NONE) continue;
+                    assigned(d);
+                    live_now.erase(d);
+                }
+                if (reads_operand1(node.op) && index(node.operand1) != NONE) live_now.insert(index(node.operand1));
+                if (reads_operand2(node.op) && index(node.operand2) != NONE) live_now.insert(index(node.operand2));
+            }
+            //phi nodes assign their versions at once on entry
+            for (size_t p = 0; p < n; p++) {
+                if (index(body[p].operand1) != NONE) assigned(index(body[p].operand1));
+            }
+        }
+        std::sort(interfering.begin(), interfering.end());
+        auto interfere = [&](u32 a, u32 b) {
+            return std::binary_search(interfering.begin(), interfering.end(), pair(a, b));
+        };
+
+        //every local and version gets variable of the first group of its local it doesn't interfere with
+        std::pmr::vector<u64> names(count, memory);
+        for (u32 i = 0; i < count; i++) names[i] = vars.locals[local_of(i)].value;
+        //variables of groups other than the one of the local, allocated next to it
+        adjacency split {memory};
+        std::pmr::vector<Operand> split_variables {memory};
+        if (!interfering.empty()) {
+            adjacency versions {memory};
+            for (u32 i = 0; i < count; i++) versions.add(local_of(i), i);
+            versions.build(count);
+            //group every version of the current local is in, and the first version of every group
+            std::pmr::vector<u32> group_of(count, NONE, memory);
+            std::pmr::vector<u32> groups {memory};
+            for (u32 l = 0; l < vars.locals.size(); l++) {
+                const auto of_local = versions.successors(l);
+                groups.clear();
+                for (size_t i = 0; i < of_local.size(); i++) {
+                    const u32 v = of_local[i];
+                    u32 g = 0;
+                    for (; g < groups.size(); g++) {
+                        if (std::none_of(of_local.begin(), of_local.begin() + i,
+                                         [&](u32 member) { return group_of[member] == g && interfere(member, v); }))
+                            break;
+                    }
+                    if (g == groups.size()) {
+                        groups.push_back(v);
+                        if (g > 0) {
+                            split.add(l, split_variables.size());
+                            split_variables.push_back({vars.locals[l].type, vars.id(v), false, false});
+                        }
+                    }
+                    group_of[v] = g;
+                    names[v] = vars.id(groups[g]);
+                }
+            }
+        }
+        split.build(std::max(vars.locals.size(), split_variables.size()));
+        auto allocate_split = [&](u32 l, std::pmr::vector<Node>& body) {
+            for (u32 v : split.successors(l)) body.push_back({Operation::ALLOC, split_variables[v], {}});
+        };
+        auto rename = [&](Operand& o) {
+            if (index(o) != NONE) o.value = names[index(o)];
+        };
+
+        //copies phi nodes turn into, on edge from predecessor to block
+        struct edge_copy {
+            u32 from;
+            u32 to;
+            Node copy;
+        };
+        std::pmr::vector<edge_copy> edge_copies {memory};
+        for (u32 b = 0; b < graph.size(); b++) {
+            const auto& body = fn.get_cfg_node(graph.id(b)).body;
+            const auto preds = graph.predecessors(b);
+            for (size_t p = 0; p < body.size() && body[p].op == Operation::PHI; p++) {
+                Node copy {Operation::MOVE, body[p].operand1, body[p].operand2};
+                rename(copy.operand1);
+                rename(copy.operand2);
+                if (!copy.operand2.is_instant && copy.operand1.value == copy.operand2.value) continue;
+                edge_copies.push_back({preds[p % preds.size()], b, copy});
+            }
+        }
+        //copies of one edge are of different locals, so none of them reads what another one writes
+        std::stable_sort(edge_copies.begin(), edge_copies.end(), [](const edge_copy& a, const edge_copy& b) {
+            return std::pair {a.to, a.from} < std::pair {b.to, b.from};
+        });
+
+        std::pmr::vector<Node> renamed {memory};
+        for (u32 b = 0; b < graph.size(); b++) {
+            auto& body = fn.get_cfg_node(graph.id(b)).body;
+            renamed.clear();
+            //parameters aren't allocated, their other variables are allocated on entry
+            if (b == 0) {
+                for (const auto& param : func.params) allocate_split(vars.local(param.value), renamed);
+            }
+            for (Node node : body) {
+                if (node.op == Operation::PHI) continue;
+                if (node.op == Operation::ALLOC) {
+                    renamed.push_back(node);
+                    const u32 l = vars.local(node.operand1.value);
+                    if (l != NONE && vars.locals[l].value == node.operand1.value) allocate_split(l, renamed);
+                    continue;
+                }
+                if (reads_operand1(node.op) || writes_operand1(node.op)) rename(node.operand1);
+                if (reads_operand2(node.op) || writes_operand2(node.op)) rename(node.operand2);
+                //copy of a version into another one of the same group
+                const bool self_copy = !node.operand2.is_instant && node.operand1.value == node.operand2.value;
+                if (node.op == Operation::MOVE && self_copy) continue;
+                renamed.push_back(node);
+            }
+            body.assign(renamed.begin(), renamed.end());
+        }
+
+        bool split_edges = false;
+        for (size_t e = 0, end = 0; e < edge_copies.size(); e = end) {
+            end = e + 1;
+            while (end < edge_copies.size() && edge_copies[end].from == edge_copies[e].from &&
+                   edge_copies[end].to == edge_copies[e].to)
+                end++;
+            const u32 from = graph.id(edge_copies[e].from);
+            const u32 to = graph.id(edge_copies[e].to);
+            auto copy_to = [&](std::pmr::vector<Node>& body) {
+                for (size_t c = e; c < end; c++) body.push_back(edge_copies[c].copy);
+            };
+            if (graph.successors(edge_copies[e].from).size() == 1) {
+                copy_to(fn.get_cfg_node(from).body);
+                continue;
+            }
+            //critical edge, copies would run on the way to the other successor too
+            const u32 block = u32(fn.first_node_id + fn.nodes.size());
+            CFG_Node& middle = fn.nodes.emplace_back();
+            copy_to(middle.body);
+            middle.exit = {terminator::JUMP, Operation::NONE, to};
+            terminator& exit = fn.get_cfg_node(from).exit;
+            if (exit.target == to) exit.target = block;
+            else exit.next = block;
+            split_edges = true;
+        }
+        if (split_edges) {
+            func.blocks = layout_blocks(func.node_id,
+                                        [&](size_t id) -> const CFG_Node& { return fn.get_cfg_node(id); }, memory);
+            fn.index_edges();
+        }
+    }
+}
+
+#endif  //SSA_H
@@ -10,6 +10,76 @@ namespace eraxc::JIR {
         Operand operand1;
         Operand operand2;
     };
+
+    /// Whether node reads value of its first operand. Arithmetic is two-address, e.g. `ADD a, b` is `a = a + b`
+    inline bool reads_operand1(Operation op) {
+        switch (op) {
+            case Operation::ADD:
+            case Operation::SUB:
+            case Operation::MUL:
+            case Operation::DIV:
+            case Operation::MOD:
+            case Operation::INC:
+            case Operation::DEC:
+            case Operation::NOT:
+            case Operation::NEG:
+            case Operation::AND:
+            case Operation::OR:
+            case Operation::XOR:
+            case Operation::LSHIFT:
+            case Operation::RSHIFT:
+            case Operation::CMP:
+            case Operation::PASS:
+            case Operation::PASS_RET: return true;
+            default: return false;
+        }
+    }
+
+    /// Whether node assigns its first operand
+    inline bool writes_operand1(Operation op) {
+        switch (op) {
+            case Operation::ADD:
+            case Operation::SUB:
+            case Operation::MUL:
+            case Operation::DIV:
+            case Operation::MOD:
+            case Operation::INC:
+            case Operation::DEC:
+            case Operation::NOT:
+            case Operation::NEG:
+            case Operation::AND:
+            case Operation::OR:
+            case Operation::XOR:
+            case Operation::LSHIFT:
+            case Operation::RSHIFT:
+            case Operation::MOVE:
+            case Operation::PHI: return true;
+            default: return false;
+        }
+    }
+
+    /// Whether node reads value of its second operand
+    inline bool reads_operand2(Operation op) {
+        switch (op) {
+            case Operation::ADD:
+            case Operation::SUB:
+            case Operation::MUL:
+            case Operation::DIV:
+            case Operation::MOD:
+            case Operation::AND:
+            case Operation::OR:
+            case Operation::XOR:
+            case Operation::LSHIFT:
+            case Operation::RSHIFT:
+            case Operation::CMP:
+            case Operation::MOVE:
+            case Operation::PHI: return true;
+            default: return false;
+        }
+    }
+
+    /// Whether node assigns its second operand, only CALL does with its result
+    inline bool writes_operand2(Operation op) { return op == Operation::CALL; }
 }
 
-#endif
\ No newline at end of file
+#endif
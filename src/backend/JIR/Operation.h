@@ -43,6 +43,8 @@ namespace eraxc::JIR {
         ALLOC,
         DEALLOC,
         STORE,
+        //value of variable coming from one predecessor of block in SSA form, see construct_ssa()
+        PHI,
 
         NONE,
         ERR
@@ -99,9 +101,9 @@ namespace eraxc::JIR {
     /// @param t token to convert from
     /// @return operation::ERR if prefix operation unsupported, operation otherwise
     inline Operation prefix_op_to_jir_op(const token& t) {
-        if (!syntax::prefix_operators.contains(t.data)) return Operation::ERR;
+        if (!syntax::prefix_operators.contains(t.data())) return Operation::ERR;
 
-        auto op = syntax::prefix_operators.at(t.data);
+        auto op = syntax::prefix_operators.at(t.data());
 
         if (op == syntax::POSITIVE) return Operation::NONE;
         if (op == syntax::NEGATIVE) return Operation::NEG;
@@ -112,8 +114,8 @@ namespace eraxc::JIR {
     }
 
     inline Operation postfix_op_to_jir_op(const token& t) {
-        if (!syntax::postfix_operators.contains(t.data)) return Operation::ERR;
-        const auto op = syntax::postfix_operators.at(t.data);
+        if (!syntax::postfix_operators.contains(t.data())) return Operation::ERR;
+        const auto op = syntax::postfix_operators.at(t.data());
         if (op == syntax::INCREMENT) return Operation::INC;
         if (op == syntax::DECREMENT) return Operation::DEC;
         return Operation::ERR;
@@ -6,106 +6,137 @@
 
 #include "backend/Scope.h"
 #include "frontend/syntax/enums.h"
+#include "util/interner.h"
 
+#include <array>
+#include <memory_resource>
 #include <ranges>
 
 namespace eraxc::JIR {
     class ScopeManager {
-        std::vector<Scope> scopes;
+        std::pmr::memory_resource* memory;
 
-        std::vector<std::vector<Operand>> allocations;
+        std::pmr::vector<Scope> scopes;
 
-        typedef std::vector<Node> Nodes;
+        std::pmr::vector<std::pmr::vector<Operand>> allocations;
 
-    public:
-        ScopeManager() {
-            scopes.emplace_back();
-            allocations.emplace_back();
-            //init global scope with default types
-            scopes.back().typenames = std::unordered_map<std::string, size_t> {
-                {"i8", syntax::i8},     {"i16", syntax::i16},   {"i32", syntax::i32},
-                {"i64", syntax::i64},   {"i128", syntax::i128}, {"i256", syntax::i256},
+        //popped scopes keep their buffers for the next pushed ones, as arena never reuses freed memory
+        std::pmr::vector<Scope> spare_scopes;
+        std::pmr::vector<std::pmr::vector<Operand>> spare_allocations;
 
-                {"u8", syntax::u8},     {"u16", syntax::u16},   {"u32", syntax::u32},
-                {"u64", syntax::u64},   {"u128", syntax::u128}, {"u256", syntax::u256},
+        typedef std::pmr::vector<Node> Nodes;
 
-                {"int", syntax::i32},   {"long", syntax::i64},  {"char", syntax::i8},
-                {"bool", syntax::BOOL}, {"short", syntax::i16}, {"void", syntax::VOID}};
+    public:
+        /// @param memory resource scopes are allocated from, arena of the compilation
+        explicit ScopeManager(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : memory(memory), scopes(memory), allocations(memory), spare_scopes(memory), spare_allocations(memory) {
+            scopes.emplace_back(memory);
+            allocations.emplace_back();
         }
 
+        /// Builtin typenames of the global scope, indexed by their symbols. Built at compile time and shared
+        /// read-only by all ScopeManagers, so compiling on many threads doesn't copy them for every file
+        static constexpr std::array<u64, sym::MAIN> builtin_types = [] {
+            std::array<u64, sym::MAIN> types {};
+            types[sym::I8] = syntax::i8;
+            types[sym::I16] = syntax::i16;
+            types[sym::I32] = syntax::i32;
+            types[sym::I64] = syntax::i64;
+            types[sym::I128] = syntax::i128;
+            types[sym::I256] = syntax::i256;
+
+            types[sym::U8] = syntax::u8;
+            types[sym::U16] = syntax::u16;
+            types[sym::U32] = syntax::u32;
+            types[sym::U64] = syntax::u64;
+            types[sym::U128] = syntax::u128;
+            types[sym::U256] = syntax::u256;
+
+            types[sym::INT] = syntax::i32;
+            types[sym::LONG] = syntax::i64;
+            types[sym::CHAR] = syntax::i8;
+            types[sym::BOOL] = syntax::BOOL;
+            types[sym::SHORT] = syntax::i16;
+            types[sym::VOID] = syntax::VOID;
+            return types;
+        }();
+
+        static bool is_builtin_type(symbol type) { return type < builtin_types.size(); }
+
         size_t size() { return scopes.size(); }
 
-        u64 addType(const std::string& type) {
-            u64 tr = top().typenames.size();
+        u64 addType(symbol type) {
+            //global scope type ids go after builtin ones
+            u64 tr = top().typenames.size() + (scopes.size() == 1 ? builtin_types.size() : 0);
             top().typenames.emplace(type, tr);
             return tr;
         }
 
-        void addTypes(const std::vector<std::string>& typenames) {
+        void addTypes(const std::vector<symbol>& typenames) {
             for (const auto& type : typenames) { addType(type); }
         }
 
-        bool containsTypeRecursive(const std::string& type) const {
+        bool containsTypeRecursive(symbol type) const {
             for (const auto& scope : std::ranges::views::reverse(scopes)) {
                 if (scope.typenames.contains(type)) return true;
             }
-            return false;
+            return is_builtin_type(type);
         }
 
-        bool containsType(const std::string& type) const { return top().typenames.contains(type); }
+        bool containsType(symbol type) const {
+            return top().typenames.contains(type) || (scopes.size() == 1 && is_builtin_type(type));
+        }
 
-        bool containsIdRecursive(const std::string& id) const {
+        bool containsIdRecursive(symbol id) const {
             for (const auto& scope : std::ranges::views::reverse(scopes)) {
                 if (scope.identifiers.contains(id)) return true;
             }
             return false;
         }
 
-        bool containsId(const std::string& id) const { return top().identifiers.contains(id); }
+        bool containsId(symbol id) const { return top().identifiers.contains(id); }
 
         static constexpr u64 NOT_FOUND = -1llu;
 
-        u64 findIdRecursive(const std::string& id) const {
+        u64 findIdRecursive(symbol id) const {
             for (const auto& scope : std::ranges::views::reverse(scopes)) {
-                if (const auto it = scope.identifiers.find(id); it != scope.identifiers.end()) {
-                    return it->second.getId();
-                }
+                if (const auto* decl = scope.identifiers.find(id)) return decl->getId();
             }
             return NOT_FOUND;
         }
 
-        u64 findId(const std::string& id) const {
-            if (const auto it = top().identifiers.find(id); it != top().identifiers.end()) {
-                return it->second.getId();
-            }
+        u64 findId(symbol id) const {
+            if (const auto* decl = top().identifiers.find(id)) return decl->getId();
             return NOT_FOUND;
         }
 
         static inline const Scope::Declaration NOT_FOUND_DECL {NOT_FOUND, NOT_FOUND, false};
 
-        auto findDeclarationRecursive(const std::string& name) const {
+        auto findDeclarationRecursive(symbol name) const {
             for (auto& scope : std::ranges::views::reverse(scopes)) {
-                if (auto it = scope.identifiers.find(name); it != scope.identifiers.end()) { return it->second; }
+                if (const auto* decl = scope.identifiers.find(name)) return *decl;
             }
             return NOT_FOUND_DECL;
         }
 
-        auto findDeclaration(const std::string& name) const {
-            if (auto it = top().identifiers.find(name); it != top().identifiers.end()) { return it->second; }
+        auto findDeclaration(symbol name) const {
+            if (const auto* decl = top().identifiers.find(name)) return *decl;
             return NOT_FOUND_DECL;
         }
 
-        void setDeclaration(const std::string& name, const Scope::Declaration& decl) { top().identifiers[name] = decl; }
+        void setDeclaration(symbol name, const Scope::Declaration& decl) { top().identifiers[name] = decl; }
 
-        u64 findTypeRecursive(const std::string& type) const {
+        u64 findTypeRecursive(symbol type) const {
             for (const auto& scope : std::ranges::views::reverse(scopes)) {
-                if (auto it = scope.typenames.find(type); it != scope.typenames.end()) { return it->second; }
+                if (const auto* t = scope.typenames.find(type)) return *t;
             }
+            if (is_builtin_type(type)) return builtin_types[type];
             return NOT_FOUND;
         }
 
-        u64 findType(const std::string& type) const {
-            if (auto it = top().typenames.find(type); it != top().typenames.end()) return it->second;
+        u64 findType(symbol type) const {
+            if (const auto* t = top().typenames.find(type)) return *t;
+            if (scopes.size() == 1 && is_builtin_type(type)) return builtin_types[type];
             return NOT_FOUND;
         }
 
@@ -115,7 +146,7 @@ namespace eraxc::JIR {
         /// \param is_func is this identifier a function
         /// \param nodes nodes list where allocation operation will be added
         /// \return the index of declaration
-        size_t addId(const std::string& id, size_t type, bool is_func, Nodes& nodes, bool rValue = false) {
+        size_t addId(symbol id, size_t type, bool is_func, Nodes& nodes, bool rValue = false) {
             top().identifiers.emplace(id, Scope::Declaration {type, top().allocatedIds, is_func});
             if (!is_func) {
                 Operand allocatee {type, top().allocatedIds, false, rValue};
@@ -125,14 +156,14 @@ namespace eraxc::JIR {
             return top().allocatedIds++;
         }
 
-        size_t addIdWithoutAllocation(const std::string& id, size_t type, bool is_func, bool rValue = false) {
+        size_t addIdWithoutAllocation(symbol id, size_t type, bool is_func, bool rValue = false) {
             top().identifiers.emplace(id, Scope::Declaration {type, top().allocatedIds, is_func});
             return top().allocatedIds++;
         }
 
         size_t addAnonymousId(const u64 type, bool is_func, Nodes& nodes, bool rValue = false) {
+            //anonymous ids are never looked up by name, so they don't get into identifiers
             u64& id = top().allocatedIds;
-            top().identifiers.emplace("$anonymous" + std::to_string(id), Scope::Declaration {type, id, is_func});
             if (!is_func) {
                 Operand allocatee {type, id, false, rValue};
                 allocations.back().emplace_back(allocatee);
@@ -148,9 +179,37 @@ namespace eraxc::JIR {
 
         const auto& top_allocations() const { return allocations.back(); }
 
+        const Scope& global() const { return scopes.front(); }
+        const auto& global_allocations() const { return allocations.front(); }
+
+        /// Declares identifier of imported module in global scope, keeping its already assigned id
+        /// @return false if identifier is already declared
+        bool importId(symbol name, const Scope::Declaration& decl) {
+            return scopes.front().identifiers.emplace(name, decl);
+        }
+
+        bool importType(symbol name, u64 type) { return scopes.front().typenames.emplace(name, type); }
+
+        void importAllocation(const Operand& op) { allocations.front().emplace_back(op); }
+
+        /// Takes ids for imported module declarations
+        /// @return the first taken id
+        u64 reserveIds(u64 count) {
+            const u64 first = scopes.front().allocatedIds;
+            scopes.front().allocatedIds += count;
+            return first;
+        }
+
         void push() {
-            scopes.emplace_back();
-            allocations.emplace_back();
+            if (spare_scopes.empty()) {
+                scopes.emplace_back(memory);
+                allocations.emplace_back();
+            } else {
+                scopes.push_back(std::move(spare_scopes.back()));
+                allocations.push_back(std::move(spare_allocations.back()));
+                spare_scopes.pop_back();
+                spare_allocations.pop_back();
+            }
             if (scopes.size() > 1) { scopes.back().allocatedIds = scopes[scopes.size() - 2].allocatedIds; }
         }
 
@@ -180,6 +239,10 @@ namespace eraxc::JIR {
         }
 
         void pop() {
+            scopes.back().clear();
+            allocations.back().clear();
+            spare_scopes.push_back(std::move(scopes.back()));
+            spare_allocations.push_back(std::move(allocations.back()));
             scopes.pop_back();
             allocations.pop_back();
         }
@@ -0,0 +1,351 @@
+#ifndef MODULE_IMAGE_H
+#define MODULE_IMAGE_H
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "CFG/CFG.h"
+#include "frontend/lexic/source_buffer.h"
+
+namespace eraxc::JIR {
+
+    /// Binary layout of module image: global scope of a module, its functions and JIR nodes, so a shared file is
+    /// parsed once and memory-mapped by every compilation importing it. Records are fixed-size and 8-byte aligned,
+    /// so the mapped file is read in place. Ids and node ids are the module's own, they are shifted on import
+    namespace module_format {
+        //"ERAXJIRM"
+        inline constexpr u64 MAGIC = 0x4D52494A58415245ull;
+        //bump on any change of the layout or of Operation numbering
+        inline constexpr u32 VERSION = 3;
+        //numbers are written as they are in memory, so image of another byte order is rejected
+        inline constexpr u32 ENDIANNESS = 0x01020304;
+
+        struct section {
+            u64 offset;
+            u64 count;
+        };
+
+        struct header {
+            u64 magic;
+            u32 version;
+            u32 endianness;
+            //ids allocated in module global scope
+            u64 id_count;
+            section identifiers;
+            section types;
+            section allocations;
+            section functions;
+            section params;
+            section nodes;
+            //JIR nodes of every CFG node, CFG node 0 is global initialization
+            section bodies;
+            //terminator of every CFG node, edges are made from them on import
+            section terminators;
+            section strings;
+        };
+
+        struct name_ref {
+            u32 offset;
+            u32 size;
+        };
+
+        struct identifier {
+            name_ref name;
+            u64 type;
+            u64 id;
+            u64 is_func;
+        };
+
+        struct type_name {
+            name_ref name;
+            u64 type;
+        };
+
+        //how operand value is shifted on import
+        enum operand_kind : unsigned char { EMPTY, INSTANT, NODE_ID, ID };
+
+        struct operand {
+            u64 type;
+            u64 value;
+            unsigned char kind;
+            unsigned char is_rvalue;
+            unsigned char padding[6];
+        };
+
+        struct node {
+            u64 op;
+            operand operand1;
+            operand operand2;
+        };
+
+        struct body {
+            u64 first;
+            u64 count;
+        };
+
+        struct function {
+            u64 id;
+            u64 return_type;
+            u64 node_id;
+            u64 first_param;
+            u64 param_count;
+        };
+
+        struct terminator {
+            u32 kind;
+            u32 condition;
+            u64 target;
+            u64 next;
+        };
+
+        static_assert(std::is_trivially_copyable_v<header> && sizeof(header) % 8 == 0);
+        static_assert(sizeof(identifier) % 8 == 0 && sizeof(type_name) % 8 == 0 && sizeof(operand) % 8 == 0);
+        static_assert(sizeof(node) % 8 == 0 && sizeof(function) % 8 == 0 && sizeof(terminator) % 8 == 0);
+
+        /// Operand {} in a slot the operation doesn't use isn't an id and mustn't be shifted
+        inline operand_kind kind_of(Operation op, const Operand& o, bool second) {
+            if (o.is_instant) return o.type == u64(-1) ? NODE_ID : INSTANT;
+            if (o.type != 0 || o.value != 0 || o.is_rvalue) return ID;
+            if (op == Operation::RET || op == Operation::LABEL || op == Operation::NONE || op == Operation::ERR)
+                return EMPTY;
+            if (!second) return ID;
+            switch (op) {
+                case Operation::ALLOC:
+                case Operation::DEALLOC:
+                case Operation::PASS:
+                case Operation::PASS_RET:
+                case Operation::INC:
+                case Operation::DEC:
+                case Operation::NOT:
+                case Operation::NEG:
+                case Operation::JUMP:
+                case Operation::JE:
+                case Operation::JNE:
+                case Operation::JG:
+                case Operation::JGE:
+                case Operation::JL:
+                case Operation::JLE: return EMPTY;
+                default: return ID;
+            }
+        }
+    }
+
+    /// Writes module image of CFG built by CFG::create_module
+    /// @param filename image file, replaced atomically so concurrent compilations never map a partial one
+    inline error::errable<void> write_module(const CFG& cfg, const std::string& filename) {
+        namespace mf = module_format;
+        const auto& scopes = cfg.getScopeManager();
+        const auto& global = scopes.global();
+
+        std::string strings {};
+        auto add_name = [&](symbol s) {
+            const std::string_view text = interner::global().text(s);
+            const mf::name_ref ref {u32(strings.size()), u32(text.size())};
+            strings += text;
+            return ref;
+        };
+        auto add_operand = [](Operation op, const Operand& o, bool second) {
+            return mf::operand {o.type, o.value, mf::kind_of(op, o, second), o.is_rvalue, {}};
+        };
+
+        std::vector<mf::identifier> identifiers {};
+        global.identifiers.for_each([&](symbol name, const Scope::Declaration& decl) {
+            identifiers.push_back({add_name(name), decl.getType(), decl.getId(), decl.isFunc()});
+        });
+        std::vector<mf::type_name> types {};
+        global.typenames.for_each([&](symbol name, size_t type) { types.push_back({add_name(name), type}); });
+
+        std::vector<mf::operand> allocations {};
+        for (const auto& a : scopes.global_allocations()) {
+            allocations.push_back(add_operand(Operation::ALLOC, a, false));
+        }
+
+        std::vector<mf::function> functions {};
+        std::vector<mf::operand> params {};
+        for (const auto& [id, func] : cfg.get_funcs()) {
+            functions.push_back({id, func.return_type, func.node_id, params.size(), func.params.size()});
+            for (const auto& p : func.params) params.push_back(add_operand(Operation::ALLOC, p, false));
+        }
+
+        std::vector<mf::node> nodes {};
+        std::vector<mf::body> bodies {};
+        std::vector<mf::terminator> terminators {};
+        for (const auto& cfg_node : cfg.get_nodes()) {
+            bodies.push_back({nodes.size(), 0});
+            for (const auto& n : cfg_node.body) {
+                nodes.push_back({u64(n.op), add_operand(n.op, n.operand1, false), add_operand(n.op, n.operand2, true)});
+            }
+            bodies.back().count = nodes.size() - bodies.back().first;
+            const auto& exit = cfg_node.exit;
+            terminators.push_back({exit.kind, u32(exit.condition), exit.target, exit.next});
+        }
+
+        std::string image(sizeof(mf::header), '\0');
+        mf::header head {mf::MAGIC, mf::VERSION, mf::ENDIANNESS, global.allocatedIds};
+        auto append = [&](mf::section& section, const auto& records) {
+            image.resize((image.size() + 7) & ~size_t(7), '\0');
+            section = {image.size(), records.size()};
+            image.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(records[0]));
+        };
+        append(head.identifiers, identifiers);
+        append(head.types, types);
+        append(head.allocations, allocations);
+        append(head.functions, functions);
+        append(head.params, params);
+        append(head.nodes, nodes);
+        append(head.bodies, bodies);
+        append(head.terminators, terminators);
+        append(head.strings, strings);
+        std::memcpy(image.data(), &head, sizeof(head));
+
+        const std::string tmp = filename + ".tmp";
+        {
+            std::ofstream file {tmp, std::ios::binary};
+            if (!file) return {"Failed to open module file " + tmp};
+            file.write(image.data(), image.size());
+            if (!file) return {"Failed to write module file " + tmp};
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, filename, ec);
+        if (ec) return {"Failed to write module file " + filename + ": " + ec.message()};
+        return {""};
+    }
+
+    /// Memory-mapped module image. Validated once when mapped, read-only afterwards, so one image can be imported
+    /// by compilations on many threads
+    class module_image {
+        source_buffer buffer {};
+        module_format::header head {};
+
+        template<typename T>
+        std::span<const T> records(const module_format::section& section) const {
+            return {reinterpret_cast<const T*>(buffer.begin() + section.offset), section.count};
+        }
+
+        template<typename T>
+        bool fits(const module_format::section& section) const {
+            return section.offset % alignof(T) == 0 && section.offset <= buffer.size() &&
+                   section.count <= (buffer.size() - section.offset) / sizeof(T);
+        }
+
+        bool valid_operand(const module_format::operand& o) const {
+            return o.kind <= module_format::ID && (o.kind != module_format::NODE_ID || o.value < head.bodies.count);
+        }
+
+        error::errable<void> validate(const std::string& filename) const {
+            namespace mf = module_format;
+            const std::string invalid = "Invalid module file " + filename + ": ";
+            if (!fits<mf::identifier>(head.identifiers) || !fits<mf::type_name>(head.types) ||
+                !fits<mf::operand>(head.allocations) || !fits<mf::function>(head.functions) ||
+                !fits<mf::operand>(head.params) || !fits<mf::node>(head.nodes) || !fits<mf::body>(head.bodies) ||
+                !fits<mf::terminator>(head.terminators) || !fits<char>(head.strings)) {
+                return {invalid + "section out of file"};
+            }
+            if (head.bodies.count == 0) return {invalid + "no global node"};
+            if (head.terminators.count != head.bodies.count) return {invalid + "terminators don't match nodes"};
+
+            auto valid_name = [&](mf::name_ref name) { return u64(name.offset) + name.size <= head.strings.count; };
+            for (const auto& i : identifiers()) {
+                if (!valid_name(i.name)) return {invalid + "name out of string table"};
+            }
+            for (const auto& t : types()) {
+                if (!valid_name(t.name)) return {invalid + "name out of string table"};
+            }
+            for (const auto& a : allocations()) {
+                if (!valid_operand(a)) return {invalid + "bad operand"};
+            }
+            for (const auto& p : params()) {
+                if (!valid_operand(p)) return {invalid + "bad operand"};
+            }
+            for (const auto& f : functions()) {
+                if (f.node_id >= head.bodies.count || f.first_param > head.params.count ||
+                    f.param_count > head.params.count - f.first_param) {
+                    return {invalid + "bad function"};
+                }
+            }
+            for (const auto& b : bodies()) {
+                if (b.first > head.nodes.count || b.count > head.nodes.count - b.first) {
+                    return {invalid + "body out of nodes"};
+                }
+            }
+            for (const auto& n : nodes()) {
+                if (n.op > u64(Operation::ERR) || !valid_operand(n.operand1) || !valid_operand(n.operand2)) {
+                    return {invalid + "bad node"};
+                }
+            }
+            for (const auto& t : terminators()) {
+                if (t.kind > terminator::RETURN || t.condition > u32(Operation::ERR) || t.target >= head.bodies.count ||
+                    t.next >= head.bodies.count) {
+                    return {invalid + "bad terminator"};
+                }
+            }
+            return {""};
+        }
+
+    public:
+        module_image() = default;
+        module_image(const module_image&) = delete;
+        module_image& operator=(const module_image&) = delete;
+
+        /// Maps and validates image written by write_module
+        error::errable<void> map(const std::string& filename) {
+            auto mapped = buffer.map(filename);
+            if (!mapped) return mapped;
+            if (buffer.size() < sizeof(head)) return {"Invalid module file " + filename + ": too small"};
+            std::memcpy(&head, buffer.begin(), sizeof(head));
+            if (head.magic != module_format::MAGIC) return {"Not a module file: " + filename};
+            if (head.version != module_format::VERSION || head.endianness != module_format::ENDIANNESS) {
+                return {"Module file " + filename + " was written by another compiler version or platform"};
+            }
+            return validate(filename);
+        }
+
+        u64 id_count() const { return head.id_count; }
+
+        std::span<const module_format::identifier> identifiers() const {
+            return records<module_format::identifier>(head.identifiers);
+        }
+
+        std::span<const module_format::type_name> types() const {
+            return records<module_format::type_name>(head.types);
+        }
+
+        std::span<const module_format::operand> allocations() const {
+            return records<module_format::operand>(head.allocations);
+        }
+
+        std::span<const module_format::function> functions() const {
+            return records<module_format::function>(head.functions);
+        }
+
+        std::span<const module_format::operand> params() const {
+            return records<module_format::operand>(head.params);
+        }
+
+        std::span<const module_format::node> nodes() const {
+            return records<module_format::node>(head.nodes);
+        }
+
+        std::span<const module_format::body> bodies() const {
+            return records<module_format::body>(head.bodies);
+        }
+
+        std::span<const module_format::terminator> terminators() const {
+            return records<module_format::terminator>(head.terminators);
+        }
+
+        std::string_view text(module_format::name_ref name) const {
+            return {buffer.begin() + head.strings.offset + name.offset, name.size};
+        }
+
+        /// Whole image, e.g. to make it a part of compile cache key
+        std::string_view bytes() const { return buffer.view(); }
+    };
+}
+
+#endif  //MODULE_IMAGE_H
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Node.h"
@@ -24,7 +25,7 @@ namespace eraxc::JIR::utils {
         return result;
     }
 
-    inline void print_JIR_nodes(const std::vector<Node>& nodes) {
+    inline void print_JIR_nodes(const std::pmr::vector<Node>& nodes) {
         for (const auto& node : nodes) {
             if (node.op == Operation::MOVE) {
                 std::cout << "MOVE " << operand_to_string(node.operand1) << ' ' << operand_to_string(node.operand2)
@@ -95,6 +96,9 @@ namespace eraxc::JIR::utils {
                 std::cout << "INC " << operand_to_string(node.operand1) << std::endl;
             } else if (node.op == Operation::DEC) {
                 std::cout << "DEC " << operand_to_string(node.operand1) << std::endl;
+            } else if (node.op == Operation::PHI) {
+                std::cout << "PHI " << operand_to_string(node.operand1) << ' ' << operand_to_string(node.operand2)
+                          << std::endl;
             } else if (node.op == Operation::ALLOC) {
                 std::cout << "ALLOC " << operand_to_string(node.operand1) << std::endl;
             } else if (node.op == Operation::DEALLOC) {
@@ -103,6 +107,28 @@ namespace eraxc::JIR::utils {
         }
     }
 
+    inline std::string_view condition_name(Operation condition) {
+        switch (condition) {
+            case Operation::JE: return "JE";
+            case Operation::JNE: return "JNE";
+            case Operation::JG: return "JG";
+            case Operation::JGE: return "JGE";
+            case Operation::JL: return "JL";
+            case Operation::JLE: return "JLE";
+            default: return "J?";
+        }
+    }
+
+    inline void print_terminator(const terminator& exit) {
+        if (exit.kind == terminator::JUMP) {
+            std::cout << "JMP .l" << exit.target << std::endl;
+        } else if (exit.kind == terminator::BRANCH) {
+            std::cout << condition_name(exit.condition) << " .l" << exit.target << " else .l" << exit.next << std::endl;
+        } else if (exit.kind == terminator::RETURN) {
+            std::cout << "RET" << std::endl;
+        }
+    }
+
     inline void print_CFG_nodes(const std::unordered_map<u64, CFG_Node>& nodes) {
         for (const auto& node : nodes) {
             // std::cout << node.second. << " $" << func.second.id << " (";
@@ -1,9 +1,7 @@
 #pragma once
 
-#include <unordered_map>
-#include <string>
-
 #include "util/common.h"
+#include "util/symbol_map.h"
 
 namespace eraxc {
 
@@ -31,9 +29,16 @@ namespace eraxc {
 
         //number of allocations (including anonymous)
         u64 allocatedIds = 0;
-        std::unordered_map<std::string, Declaration> identifiers {};
-        std::unordered_map<std::string, size_t> typenames {};
+        symbol_map<Declaration> identifiers;
+        symbol_map<size_t> typenames;
+
+        explicit Scope(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+            : identifiers(memory), typenames(memory) {}
 
-        Scope() = default;
+        void clear() {
+            allocatedIds = 0;
+            identifiers.clear();
+            typenames.clear();
+        }
     };
 }
@@ -0,0 +1,79 @@
+#ifndef ASM_PARALLEL_H
+#define ASM_PARALLEL_H
+
+#include <fstream>
+#include <future>
+#include <map>
+#include <set>
+
+#include "asm_x86.h"
+#include "../JIR/CFG/passes.h"
+#include "../../util/thread_pool.h"
+
+namespace eraxc {
+
+    /// Translates every function on worker pool as soon as CFG finishes parsing it, while the rest of file is parsed.
+    /// Function asm is written in function id order, so output is the same as of asm_translator::translate
+    template<ARCH arch>
+    class parallel_asm_translator {
+        thread_pool& pool;
+        int optimization_level;
+        struct function_asm {
+            std::string code;
+            peephole_stats peephole;
+        };
+        std::map<u64, std::future<error::expected<function_asm>>> functions {};
+        peephole_stats peephole {};
+
+    public:
+        /// @param optimization_level passes functions go through, see run_function_passes()
+        explicit parallel_asm_translator(thread_pool& pool, int optimization_level = 0)
+            : pool(pool), optimization_level(optimization_level) {}
+
+        /// Hooks translator into CFG. Has to be called before CFG::create
+        void attach(JIR::CFG& cfg) {
+            cfg.set_function_parsed_callback([this, &cfg](u64 func_id, const JIR::CFG_Func& func) {
+                //function sees only globals declared before it
+                std::set<u64> globals {};
+                for (const auto& global : cfg.getScopeManager().top_allocations()) globals.insert(global.value);
+
+                functions.emplace(func_id, pool.submit([func_id, func = func, snapshot = cfg.snapshot_function(func),
+                                                        globals = std::move(globals),
+                                                        level = optimization_level]() mutable
+                                                       -> error::expected<function_asm> {
+                    JIR::run_function_passes(snapshot, func, level);
+                    peephole_stats hits {};
+                    auto code =
+                        asm_translator<arch>::translate_function(func_id, func, snapshot, globals, level, &hits);
+                    if (!code) return code.error();
+                    return function_asm {std::move(code.value()), hits};
+                }));
+            });
+        }
+
+        /// Waits for all functions and writes whole program
+        /// @param cfg CFG created after attach()
+        error::expected<void> write(const JIR::CFG& cfg, const std::string& o_filename) {
+            std::ofstream file {o_filename};
+            if (!file) return error::fail("Failed to open output file ", o_filename);
+
+            asm_translator<arch> prologue_translator {};
+            auto prologue = prologue_translator.print_prologue(cfg, file, optimization_level);
+            if (!prologue) return prologue;
+            peephole += prologue_translator.peephole_hits;
+
+            for (auto& [func_id, function] : functions) {
+                auto asm_code = pool.wait(function);
+                if (!asm_code) return asm_code.error();
+                file << asm_code.value().code;
+                peephole += asm_code.value().peephole;
+            }
+            return {};
+        }
+
+        /// Rewrites of peephole pass over functions write() waited for
+        const peephole_stats& peephole_hits() const { return peephole; }
+    };
+}
+
+#endif  //ASM_PARALLEL_H
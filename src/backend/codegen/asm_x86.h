@@ -1,11 +1,22 @@
 #ifndef BLCK_COMPILER_ASM_X86_H
 #define BLCK_COMPILER_ASM_X86_H
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <optional>
 #include <ostream>
 #include <set>
+#include <sstream>
+#include <string_view>
 
 #include "asm_translator.h"
 #include "asm_x86_mem.h"
+#include "asm_x86_peephole.h"
+#include "asm_x86_regalloc.h"
+#include "asm_x86_select.h"
+#include "../JIR/CFG/passes.h"
 
 namespace eraxc {
     template<>
@@ -34,274 +45,619 @@ namespace eraxc {
         }
 
         memory_state mem {};
-        std::set<size_t> printed_nodes;
+        //rewrites of peephole pass over everything translator printed
+        peephole_stats peephole_hits {};
 
-        error::errable<void> print_JIR_node_asm(const JIR::Node& node, std::ostream& os) {
-            if (node.op == JIR::Operation::NONE) { return {""}; }
+        error::expected<void> print_JIR_node_asm(const JIR::Node& node, x86_code& code) {
+            if (node.op == JIR::Operation::NONE) { return {}; }
 
             if (node.op == JIR::Operation::LABEL) {
-                os << ".l" << node.operand1.value << ":\n";
-                return {""};
+                code.label(".l" + std::to_string(node.operand1.value));
+                return {};
             }
 
-            if (node.op == JIR::Operation::INC) {
-                auto op1 = get_operand(node.operand1);
-                if (!op1) return {op1.error};
-
-                os << "inc " << op1.value << '\n';
-
-                return {""};
-            }
-            if (node.op == JIR::Operation::DEC) {
-                auto op1 = get_operand(node.operand1);
-                if (!op1) return {op1.error};
-
-                os << "dec " << op1.value << '\n';
-
-                return {""};
-            }
-            if (node.op == JIR::Operation::RET) {
-                os << "add rsp, " << mem.used_stack_space << '\n';
-                return {""};
-            }
             if (node.op == JIR::Operation::PASS) {
                 //pass arguments
                 auto op1 = get_operand(node.operand1);
-                if (!op1) return {op1.error};
-                os << "mov " << reg_name(pass_ABI[mem.args_in_registers_count++], size(node.operand1.type)) << ", "
-                   << op1.value << '\n';
-                return {""};
+                if (!op1) return op1.error();
+                code.emit("mov", reg_name(pass_ABI[mem.args_in_registers_count++], size(node.operand1.type)),
+                          op1.value());
+                return {};
             }
             if (node.op == JIR::Operation::PASS_RET) {
                 auto op1 = get_operand(node.operand1);
-                if (!op1) return {op1.error};
-                os << "mov " << reg_name(x86_reg::RAX, size(node.operand1.type)) << ", " << op1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JUMP) {
-                //handle jump differently
-                os << "jmp .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JE) {
-                //handle jump differently
-                os << "je .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JNE) {
-                //handle jump differently
-                os << "jne .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JG) {
-                //handle jump differently
-                os << "jg .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JGE) {
-                //handle jump differently
-                os << "jge .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JL) {
-                //handle jump differently
-                os << "jl .l" << node.operand1.value << '\n';
-                return {""};
-            }
-            if (node.op == JIR::Operation::JLE) {
-                //handle jump differently
-                os << "jle .l" << node.operand1.value << '\n';
-                return {""};
+                if (!op1) return op1.error();
+                code.emit("mov", reg_name(x86_reg::RAX, size(node.operand1.type)), op1.value());
+                return {};
             }
             if (node.op == JIR::Operation::CALL) {
                 auto op2 = mem.get_var(node.operand2.value, size(node.operand2.type));
-                if (!op2) return {op2.error};
-                const auto diff = (mem.used_stack_space + 8) % 16;
-                if (diff != 0) os << "sub rsp, " << 16 - diff << '\n';
-                os << "call $f_" << node.operand1.value << '\n';
-                if (diff != 0) os << "add rsp, " << 16 - diff << '\n';
-                std::string reg = reg_name(x86_reg::RAX, size(node.operand1.type));
-                os << "mov " << op2.value << ", " << reg << '\n';
+                if (!op2) return op2.error();
+                //frame keeps rsp aligned, see allocate_registers()
+                code.emit("call", "$f_" + std::to_string(node.operand1.value));
+                code.emit("mov", op2.value(), reg_name(x86_reg::RAX, size(node.operand1.type)));
                 mem.args_in_registers_count = 0;
-                return {""};
+                return {};
             }
-            if (node.op == JIR::Operation::ALLOC) {
-                auto assignee = mem.allocate_stack_space(size(node.operand1.type), node.operand1.value);
-                if (!assignee) return {"Failed to allocate stack space: " + assignee.error};
-                os << assignee.value;
-                return {""};
+            if (node.op == JIR::Operation::ALLOC || node.op == JIR::Operation::DEALLOC) {
+                //variables got registers or slots of the frame on function entry, see print_entry()
+                return {};
             }
-            if (node.op == JIR::Operation::DEALLOC) {
-                // auto assignee = mem.try_dealloc(size(node.operand1.type), node.operand1.value);
-                // if (!assignee) return {"Failed to deallocate stack space: " + assignee.error};
-                // os << assignee.value;
-                return {""};
+
+            switch (node.op) {
+                case JIR::Operation::MOVE: return print_move(node, code);
+                case JIR::Operation::INC:
+                case JIR::Operation::DEC:
+                case JIR::Operation::NOT:
+                case JIR::Operation::NEG: {
+                    auto op1 = get_operand(node.operand1);
+                    if (!op1) return op1.error();
+                    code.emit(mnemonic(node.op, node.operand1.type), op1.value());
+                    return {};
+                }
+                case JIR::Operation::ADD:
+                case JIR::Operation::SUB:
+                case JIR::Operation::AND:
+                case JIR::Operation::OR:
+                case JIR::Operation::XOR:
+                case JIR::Operation::CMP: return print_binary(node, code);
+                case JIR::Operation::MUL: return print_multiply(node, code);
+                case JIR::Operation::DIV:
+                case JIR::Operation::MOD: return print_division(node, code);
+                case JIR::Operation::LSHIFT:
+                case JIR::Operation::RSHIFT: return print_shift(node, code);
+                default: return error::fail("No x86 instructions for JIR operation");
             }
+        }
 
-            //TODO choose instruction better. Check if instant.
+        /// x86 instruction computing JIR operation in place on its first operand, empty if there's none
+        static std::string_view mnemonic(JIR::Operation op, u64 type) {
+            switch (op) {
+                case JIR::Operation::ADD: return "add";
+                case JIR::Operation::SUB: return "sub";
+                case JIR::Operation::MUL: return "imul";
+                case JIR::Operation::AND: return "and";
+                case JIR::Operation::OR: return "or";
+                case JIR::Operation::XOR: return "xor";
+                case JIR::Operation::CMP: return "cmp";
+                case JIR::Operation::INC: return "inc";
+                case JIR::Operation::DEC: return "dec";
+                case JIR::Operation::NOT: return "not";
+                case JIR::Operation::NEG: return "neg";
+                case JIR::Operation::LSHIFT: return "shl";
+                case JIR::Operation::RSHIFT: return JIR::is_signed(type) ? "sar" : "shr";
+                default: return {};
+            }
+        }
+
+        /// Instant as immediate of instruction of its type, i.e. sign-extended from 32 bits for 64-bit instructions
+        static i64 immediate(const JIR::Operand& op) {
+            const i64 value = i64(JIR::extend(op.value, op.type));
+            return size(op.type) == 4 ? i64(int32_t(value)) : value;
+        }
+
+        /// Whether instant takes more than 32-bit immediate, which only `mov` to register has
+        static bool wide(const JIR::Operand& op) { return op.is_instant && !fits_imm32(op.value, op.type); }
+
+        /// Argument registers already passed to the call being prepared that code about to be printed clobbers are
+        /// pushed, and stack slots are that much further from rsp until restore_arguments()
+        /// @return registers to give to restore_arguments()
+        std::vector<x86_reg> save_arguments(std::initializer_list<x86_reg> clobbered, x86_code& code) {
+            std::vector<x86_reg> saved;
+            for (int a = 0; a < mem.args_in_registers_count; a++) {
+                if (std::find(clobbered.begin(), clobbered.end(), pass_ABI[a]) == clobbered.end()) continue;
+                code.emit("push", reg_name(pass_ABI[a], 8));
+                mem.pushed += 8;
+                saved.push_back(pass_ABI[a]);
+            }
+            return saved;
+        }
 
-            // if (node.operand1.is_instant)
-            // if (node.operand2.is_instant)
+        void restore_arguments(const std::vector<x86_reg>& saved, x86_code& code) {
+            for (auto reg = saved.rbegin(); reg != saved.rend(); ++reg) {
+                code.emit("pop", reg_name(*reg, 8));
+                mem.pushed -= 8;
+            }
+        }
 
+        error::expected<void> print_move(const JIR::Node& node, x86_code& code) {
             auto op1 = get_operand(node.operand1);
             auto op2 = get_operand(node.operand2);
-            if (!op1) return {op1.error};
-            if (!op2) return {op2.error};
+            if (!op1) return op1.error();
+            if (!op2) return op2.error();
+            //copy coalesced into the same register
+            if (op1.value() == op2.value()) return {};
+            if (mem.in_register(node.operand1) || mem.in_register(node.operand2) ||
+                (node.operand2.is_instant && !wide(node.operand2))) {
+                code.emit("mov", op1.value(), op2.value());
+                return {};
+            }
+            //memory takes neither other memory nor 64-bit instant, so value goes through rax
+            const std::string reg = reg_name(x86_reg::RAX, size(node.operand1.type));
+            code.emit("mov", reg, op2.value());
+            code.emit("mov", op1.value(), reg);
+            return {};
+        }
 
-            if (node.op == JIR::Operation::MOVE) {
-                if (node.operand2.is_instant) {
-                    os << "mov " << op1.value << ", " << node.operand2.value << '\n';
+        /// ADD, SUB, AND, OR, XOR and CMP take register, memory or 32-bit immediate as the second operand, and
+        /// memory as the first one unless the second is memory too
+        error::expected<void> print_binary(const JIR::Node& node, x86_code& code) {
+            auto op1 = get_operand(node.operand1);
+            auto op2 = get_operand(node.operand2);
+            if (!op1) return op1.error();
+            if (!op2) return op2.error();
+            const std::string_view instruction = mnemonic(node.op, node.operand1.type);
+            const std::string reg = reg_name(x86_reg::RAX, size(node.operand1.type));
+            if (node.operand1.is_instant) {
+                //constant compared with variable, x86 takes instant only as the second operand
+                if (wide(node.operand2)) return error::fail("Comparison of two constants isn't folded");
+                code.emit("mov", reg, op1.value());
+                code.emit(instruction, reg, op2.value());
+                return {};
+            }
+            std::string source = op2.value();
+            if (wide(node.operand2) || (!node.operand2.is_instant && !mem.in_register(node.operand1) &&
+                                        !mem.in_register(node.operand2))) {
+                code.emit("mov", reg, source);
+                source = reg;
+            }
+            code.emit(instruction, op1.value(), source);
+            return {};
+        }
+
+        /// Multiplication by power of two is a shift. imul gives the product only in register, so product of memory
+        /// operand is computed in rax
+        error::expected<void> print_multiply(const JIR::Node& node, x86_code& code) {
+            auto op1 = get_operand(node.operand1);
+            auto op2 = get_operand(node.operand2);
+            if (!op1) return op1.error();
+            if (!op2) return op2.error();
+            const std::string reg = reg_name(x86_reg::RAX, size(node.operand1.type));
+            if (node.operand2.is_instant) {
+                const int shift = power_of_two(JIR::truncate(node.operand2.value, node.operand1.type));
+                if (shift == 0) return {};
+                if (shift > 0) {
+                    code.emit("shl", op1.value(), shift);
+                    return {};
+                }
+            }
+            if (node.operand2.is_instant && !wide(node.operand2)) {
+                if (mem.in_register(node.operand1)) {
+                    code.emit("imul", op1.value(), op1.value(), immediate(node.operand2));
+                } else {
+                    code.emit("imul", reg, op1.value(), immediate(node.operand2));
+                    code.emit("mov", op1.value(), reg);
+                }
+                return {};
+            }
+            if (mem.in_register(node.operand1) && !wide(node.operand2)) {
+                code.emit("imul", op1.value(), op2.value());
+                return {};
+            }
+            code.emit("mov", reg, op2.value());
+            if (mem.in_register(node.operand1)) {
+                code.emit("imul", op1.value(), reg);
+                return {};
+            }
+            code.emit("imul", reg, op1.value());
+            code.emit("mov", op1.value(), reg);
+            return {};
+        }
+
+        /// Shift by constant takes it as immediate, masked like x86 masks it, other counts go through cl
+        error::expected<void> print_shift(const JIR::Node& node, x86_code& code) {
+            const std::string_view instruction = mnemonic(node.op, node.operand1.type);
+            if (node.operand2.is_instant) {
+                auto op1 = get_operand(node.operand1);
+                if (!op1) return op1.error();
+                const u64 count = node.operand2.value & (size(node.operand1.type) == 8 ? 63 : 31);
+                if (count != 0) code.emit(instruction, op1.value(), count);
+                return {};
+            }
+            const auto saved = save_arguments({x86_reg::RCX}, code);
+            auto op1 = get_operand(node.operand1);
+            auto op2 = get_operand(node.operand2);
+            if (!op1) return op1.error();
+            if (!op2) return op2.error();
+            code.emit("mov", reg_name(x86_reg::RCX, size(node.operand2.type)), op2.value());
+            code.emit(instruction, op1.value(), "cl");
+            restore_arguments(saved, code);
+            return {};
+        }
+
+        /// Division by constant is multiplication by its magic number, or a shift for power of two, and the
+        /// remainder is what's left of the dividend after subtracting quotient times divisor. Other division is
+        /// div or idiv by signedness of the type, which divide rdx:rax
+        error::expected<void> print_division(const JIR::Node& node, x86_code& code) {
+            const u64 bytes = size(node.operand1.type);
+            const u32 bits = bytes * 8;
+            const bool is_signed = JIR::is_signed(node.operand1.type);
+            const bool remainder = node.op == JIR::Operation::MOD;
+            const std::string rax = reg_name(x86_reg::RAX, bytes);
+            const std::string rdx = reg_name(x86_reg::RDX, bytes);
+            const u64 divisor = JIR::truncate(node.operand2.value, node.operand1.type);
+            const i64 signed_divisor = i64(JIR::extend(divisor, node.operand1.type));
+            const bool constant = node.operand2.is_instant && divisor != 0;
+
+            if (constant && (divisor == 1 || (is_signed && signed_divisor == -1))) {
+                auto op1 = get_operand(node.operand1);
+                if (!op1) return op1.error();
+                if (remainder) code.emit("mov", op1.value(), 0);
+                else if (divisor != 1) code.emit("neg", op1.value());
+                return {};
+            }
+            //negative divisor that's a power of two as unsigned goes through the magic number
+            const int shift = power_of_two(is_signed && signed_divisor < 0 ? 0 : divisor);
+            if (constant && shift > 0 && !is_signed) {
+                auto op1 = get_operand(node.operand1);
+                if (!op1) return op1.error();
+                if (!remainder) {
+                    code.emit("shr", op1.value(), shift);
+                } else if (shift < 32) {
+                    code.emit("and", op1.value(), divisor - 1);
                 } else {
-                    //if move operand is located on stack, spill him to rax and then do move
-                    if (mem.stack_offsets.contains(node.operand2.value)) {
-                        std::string reg = reg_name(x86_reg::RAX, size(node.operand2.type));
-                        os << "mov " << reg << ", " << op2.value << '\n';
-                        os << "mov " << op1.value << ", " << reg << '\n';
+                    code.emit("mov", rax, divisor - 1);
+                    code.emit("and", op1.value(), rax);
+                }
+                return {};
+            }
+
+            const auto saved = save_arguments({x86_reg::RCX, x86_reg::RDX}, code);
+            auto op1 = get_operand(node.operand1);
+            auto op2 = get_operand(node.operand2);
+            if (!op1) return op1.error();
+            if (!op2) return op2.error();
+            const std::string_view extend_sign = bits == 64 ? "cqo" : "cdq";
+
+            if (constant && shift > 0) {
+                //negative dividend is rounded towards zero by adding divisor - 1, which rdx is made of its sign
+                code.emit("mov", rax, op1.value());
+                code.emit(extend_sign);
+                code.emit("shr", rdx, bits - shift);
+                code.emit("add", rax, rdx);
+                if (!remainder) {
+                    code.emit("sar", rax, shift);
+                    code.emit("mov", op1.value(), rax);
+                } else {
+                    if (shift < 32) {
+                        code.emit("and", rax, -(i64(1) << shift));
                     } else {
-                        //move operand contained in register
-                        os << "mov " << op1.value << ", " << op2.value << '\n';
+                        code.emit("shr", rax, shift);
+                        code.emit("shl", rax, shift);
                     }
+                    code.emit("sub", op1.value(), rax);
+                }
+            } else if (constant) {
+                const division_magic magic =
+                    is_signed ? signed_magic(signed_divisor, bits) : unsigned_magic(divisor, bits);
+                std::ostringstream multiplier;
+                multiplier << "0x" << std::hex << magic.multiplier;
+                code.emit("mov", rax, multiplier.str());
+                code.emit(is_signed ? "imul" : "mul", op1.value());
+                //quotient ends up in rdx, or in rax when unsigned multiplier didn't fit
+                std::string quotient = rdx;
+                if (is_signed) {
+                    const bool negative_multiplier = magic.multiplier >> (bits - 1) & 1;
+                    if (signed_divisor > 0 && negative_multiplier) code.emit("add", rdx, op1.value());
+                    if (signed_divisor < 0 && !negative_multiplier) code.emit("sub", rdx, op1.value());
+                    if (magic.shift != 0) code.emit("sar", rdx, magic.shift);
+                    //quotient of negative dividend is rounded up
+                    code.emit("mov", rax, rdx);
+                    code.emit("shr", rax, bits - 1);
+                    code.emit("add", rdx, rax);
+                } else if (magic.add) {
+                    code.emit("mov", rax, op1.value());
+                    code.emit("sub", rax, rdx);
+                    code.emit("shr", rax, 1);
+                    code.emit("add", rax, rdx);
+                    if (magic.shift > 1) code.emit("shr", rax, magic.shift - 1);
+                    quotient = rax;
+                } else if (magic.shift != 0) {
+                    code.emit("shr", rdx, magic.shift);
+                }
+                if (!remainder) {
+                    code.emit("mov", op1.value(), quotient);
+                } else {
+                    const std::string scratch = quotient == rax ? rdx : rax;
+                    if (fits_imm32(divisor, node.operand1.type)) {
+                        code.emit("imul", quotient, quotient, immediate(node.operand2));
+                    } else {
+                        code.emit("mov", scratch, op2.value());
+                        code.emit("imul", quotient, scratch);
+                    }
+                    code.emit("sub", op1.value(), quotient);
+                }
+            } else {
+                code.emit("mov", rax, op1.value());
+                if (is_signed) code.emit(extend_sign);
+                else code.emit("xor", "edx", "edx");
+                std::string source = op2.value();
+                if (node.operand2.is_instant) {
+                    //division by zero, left to fault at runtime
+                    source = reg_name(x86_reg::RCX, bytes);
+                    code.emit("mov", source, op2.value());
                 }
-                return {""};
-            }
-
-            //mov op1 to rax
-            //TODO if already in register there's no need in this
-            std::string reg = reg_name(x86_reg::RAX, size(node.operand1.type));
-            os << "mov " << reg << ", " << op1.value << '\n';
-
-            if (node.op == JIR::Operation::ADD) {
-                os << "add " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::SUB) {
-                os << "sub " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::MUL) {
-                os << "imul " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::DIV) {
-                //For now use idiv (that's slow)
-                os << "xor rdx, rdx ;Divide operation\n";  //Dividend top half
-                os << "mov rbx, " << op2.value << '\n';  //Divisor
-                os << "idiv rbx\n";  // Do divide. Modulo is now in rdx.
-            } else if (node.op == JIR::Operation::MOD) {
-                //For now use idiv (that's slow)
-                os << "xor rdx, rdx ;Modulo operation\n";  //Dividend top half
-                os << "mov rbx, " << op2.value << '\n';  //Divisor
-                os << "idiv rbx\n";  // Do divide. Modulo is now in rdx
-                os << "mov " << op1.value << ", rdx\n";
-                return {""};
-            } else if (node.op == JIR::Operation::NOT) {
-                os << "not " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::NEG) {
-                os << "neg " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::AND) {
-                os << "and " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::OR) {
-                os << "or " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::XOR) {
-                os << "xor " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::LSHIFT) {
-                os << "shl " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::RSHIFT) {
-                os << "shr " << reg << ", " << op2.value << '\n';
-            } else if (node.op == JIR::Operation::CMP) {
-                os << "cmp " << reg << ", " << op2.value << '\n';
-                return {""};  //return without saving from reg to stack
-            }
-            //save result to assignee
-            os << "mov " << op1.value << ", " << reg << "\n";
-
-            return {""};
+                code.emit(is_signed ? "idiv" : "div", source);
+                code.emit("mov", op1.value(), remainder ? rdx : rax);
+            }
+            restore_arguments(saved, code);
+            return {};
         }
 
-        error::errable<std::string> get_operand(const JIR::Operand& op) {
-            if (op.is_instant) { return {"", std::to_string(op.value)}; }
-            return mem.get_var(op.value, size(op.type));
+        /// Copy to register followed by arithmetic on it is one instruction of three-operand form: lea for addition
+        /// and multiplication by 2, 3, 4, 5, 8 or 9 of register, e.g. `MOVE c, a` and `ADD c, b` is `lea c, [a+b]`,
+        /// and imul for other multiplication by constant, which takes memory too
+        /// @return whether the two nodes were printed
+        bool print_three_operand(const JIR::Node& copy, const JIR::Node& node, x86_code& code) {
+            const JIR::Operand& to = copy.operand1;
+            const JIR::Operand& from = copy.operand2;
+            const JIR::Operand& by = node.operand2;
+            if (copy.op != JIR::Operation::MOVE || !mem.in_register(to) || node.operand1.is_instant ||
+                node.operand1.value != to.value)
+                return false;
+            auto reg = [&](const JIR::Operand& o) { return mem.used_regs.at(o.value); };
+            auto displacement = [](i64 value) { return (value < 0 ? "-" : "+") + std::to_string(std::abs(value)); };
+            const i64 value = by.is_instant ? immediate(by) : 0;
+            const bool lea_factor = value == 2 || value == 3 || value == 4 || value == 5 || value == 8 || value == 9;
+            if (node.op == JIR::Operation::MUL && by.is_instant && !wide(by) && !from.is_instant &&
+                !(lea_factor && mem.in_register(from)) && power_of_two(JIR::truncate(by.value, to.type)) < 0) {
+                auto source = get_operand(from);
+                if (!source) return false;
+                code.emit("imul", reg_name(reg(to), size(to.type)), source.value(), immediate(by));
+                return true;
+            }
+            std::string address;
+            if (from.is_instant) {
+                //constant copied and variable added to it
+                if (node.op != JIR::Operation::ADD || !mem.in_register(by) || reg(by) == reg(to) || wide(from))
+                    return false;
+                address = reg_name(reg(by), 8) + displacement(immediate(from));
+            } else {
+                if (!mem.in_register(from) || reg(from) == reg(to)) return false;
+                const std::string base = reg_name(reg(from), 8);
+                if (node.op == JIR::Operation::ADD && by.is_instant && !wide(by)) {
+                    address = base + displacement(value);
+                } else if (node.op == JIR::Operation::ADD && mem.in_register(by)) {
+                    //`ADD c, c` right after the copy adds a to itself
+                    address = base + '+' + (reg(by) == reg(to) ? base : reg_name(reg(by), 8));
+                } else if (node.op == JIR::Operation::SUB && by.is_instant && !wide(by) &&
+                           value != std::numeric_limits<int32_t>::min()) {
+                    address = base + displacement(-value);
+                } else if (node.op == JIR::Operation::MUL && by.is_instant &&
+                           (value == 3 || value == 5 || value == 9)) {
+                    address = base + '+' + base + '*' + std::to_string(value - 1);
+                } else if (node.op == JIR::Operation::MUL && by.is_instant && value == 2) {
+                    address = base + '+' + base;
+                } else if (node.op == JIR::Operation::MUL && by.is_instant && (value == 4 || value == 8)) {
+                    address = base + '*' + std::to_string(value);
+                } else if (node.op == JIR::Operation::LSHIFT && by.is_instant && value >= 1 && value <= 3) {
+                    address = base + '*' + std::to_string(1 << value);
+                } else return false;
+            }
+            code.emit("lea", reg_name(reg(to), size(to.type)), '[' + address + ']');
+            return true;
         }
 
+        error::expected<std::string> get_operand(const JIR::Operand& op) {
+            //64-bit instants are sign-extended from 32 bits, so folded negative constants are printed as such
+            if (op.is_instant && size(op.type) == 8) { return std::to_string(i64(op.value)); }
+            if (op.is_instant) { return std::to_string(op.value); }
+            return mem.get_var(op.value, size(op.type));
+        }
 
-        error::errable<void> print_cfg_node(const JIR::CFG& cfg, size_t node_id, std::ostream& os) {
 
-            // if (printed_nodes.contains(node_id)) return {""};
+        static std::string_view jump_name(JIR::Operation condition) {
+            switch (condition) {
+                case JIR::Operation::JE: return "je";
+                case JIR::Operation::JNE: return "jne";
+                case JIR::Operation::JG: return "jg";
+                case JIR::Operation::JGE: return "jge";
+                case JIR::Operation::JL: return "jl";
+                case JIR::Operation::JLE: return "jle";
+                default: return "jmp";
+            }
+        }
 
-            const JIR::CFG_Node& node = cfg.get_cfg_node(node_id);
+        static JIR::Operation inverted(JIR::Operation condition) {
+            switch (condition) {
+                case JIR::Operation::JE: return JIR::Operation::JNE;
+                case JIR::Operation::JNE: return JIR::Operation::JE;
+                case JIR::Operation::JG: return JIR::Operation::JLE;
+                case JIR::Operation::JGE: return JIR::Operation::JL;
+                case JIR::Operation::JL: return JIR::Operation::JGE;
+                case JIR::Operation::JLE: return JIR::Operation::JG;
+                default: return condition;
+            }
+        }
 
-            //body
-            for (const auto& JIR_node : node.body) {
-                auto print = print_JIR_node_asm(JIR_node, os);
+        error::expected<void> print_body(const JIR::CFG_Node& node, x86_code& code) {
+            const auto& body = node.body;
+            auto no_code = [](const JIR::Node& n) {
+                return n.op == JIR::Operation::ALLOC || n.op == JIR::Operation::DEALLOC || n.op == JIR::Operation::NONE;
+            };
+            for (size_t n = 0; n < body.size(); n++) {
+                //nodes without code, e.g. allocation of the next temporary, don't split a tile
+                size_t next = n + 1;
+                while (next < body.size() && no_code(body[next])) next++;
+                if (next < body.size() && print_three_operand(body[n], body[next], code)) {
+                    n = next;
+                    continue;
+                }
+                auto print = print_JIR_node_asm(body[n], code);
                 if (!print) return print;
             }
+            return {};
+        }
 
-            //print subnodes
-            const auto& edges = cfg.get_edges().equal_range(node_id);
-            for (auto i = edges.first; i != edges.second; ++i) {
-                os << ".l" << i->second << ":\n";
-                auto r1 = print_cfg_node(cfg, i->second, os);
-                if (!r1) return r1;
-                // os << "add rsp, 8\nret\n";
+        /// Prints jumps of block terminator. Jump to the block printed right after is left out, and if it's the taken
+        /// one of a branch, the condition is inverted so the branch falls through to it
+        /// @param next block printed after this one, -1 if none
+        void print_terminator(const JIR::terminator& exit, u64 next, x86_code& code) {
+            using JIR::terminator;
+            if (exit.kind == terminator::RETURN) {
+                print_exit(code);
+            } else if (exit.kind == terminator::JUMP) {
+                if (exit.target != next) code.emit("jmp", ".l" + std::to_string(exit.target));
+            } else if (exit.kind == terminator::BRANCH) {
+                if (exit.target == next) {
+                    code.emit(jump_name(inverted(exit.condition)), ".l" + std::to_string(exit.next));
+                    return;
+                }
+                code.emit(jump_name(exit.condition), ".l" + std::to_string(exit.target));
+                if (exit.next != next) code.emit("jmp", ".l" + std::to_string(exit.next));
             }
+        }
 
-            printed_nodes.insert(node_id);
+        /// Gives variables of function registers and stack slots, and prints pushes of callee-saved registers it uses
+        /// and allocation of its whole stack frame
+        /// @param cfg CFG or snapshot of function nodes
+        template<typename graph>
+        void print_entry(const JIR::CFG_Func& func, const graph& cfg, x86_code& code) {
+            const register_allocation allocation = allocate_registers(func, cfg, mem.globals);
+            mem.used_regs.insert(allocation.registers.begin(), allocation.registers.end());
+            mem.stack_offsets.insert(allocation.slots.begin(), allocation.slots.end());
+            mem.saved_regs = allocation.saved;
+            mem.frame_size = allocation.frame_size;
+            for (const x86_reg reg : mem.saved_regs) code.emit("push", reg_name(reg, 8));
+            if (mem.frame_size != 0) code.emit("sub", "rsp", mem.frame_size);
+        }
 
-            return {""};
+        /// Frees stack frame, restores callee-saved registers and returns
+        void print_exit(x86_code& code) const {
+            if (mem.frame_size != 0) code.emit("add", "rsp", mem.frame_size);
+            for (auto reg = mem.saved_regs.rbegin(); reg != mem.saved_regs.rend(); ++reg) {
+                code.emit("pop", reg_name(*reg, 8));
+            }
+            code.emit("ret");
         }
 
-        error::errable<void> translate(const JIR::CFG& cfg, const std::string& o_filename) {
-            std::ofstream file {o_filename};
+        /// Prints function label and its blocks in layout order
+        /// @param cfg CFG or snapshot of function nodes
+        template<typename graph>
+        error::expected<void> print_function(u64 func_id, const JIR::CFG_Func& func, const graph& cfg,
+                                             x86_code& code) {
+            //TODO handle args pass correctly (only 4 params would fit in ABI)
+            if (func.params.size() > std::size(pass_ABI)) {
+                return error::fail("Function $f_{} has more parameters than registers to pass them",
+                                   std::to_string(func_id));
+            }
+            code.label("$f_" + std::to_string(func_id));
+            print_entry(func, cfg, code);
+            //arguments come in registers calls reuse, so parameters are moved out of them first
+            for (size_t p = 0; p < func.params.size(); p++) {
+                const JIR::Operand& param = func.params[p];
+                auto to = mem.get_var(param.value, size(param.type));
+                if (!to) return to.error();
+                code.emit("mov", to.value(), reg_name(pass_ABI[p], size(param.type)));
+            }
+            for (size_t b = 0; b < func.blocks.size(); b++) {
+                const u64 id = func.blocks[b];
+                const JIR::CFG_Node& node = cfg.get_cfg_node(id);
+                if (b != 0) code.label(".l" + std::to_string(id));
+                auto r = print_body(node, code);
+                if (!r) return r;
+                print_terminator(node.exit, b + 1 < func.blocks.size() ? func.blocks[b + 1] : u64(-1), code);
+            }
+
+            mem.reset();
+            return {};
+        }
 
-            if (!file) return {"Failed to open output file " + o_filename};
+        /// Writes code of function, after peephole pass over it from optimization level 1
+        void write_code(x86_code& code, std::ostream& os, int optimization_level) {
+            if (optimization_level >= 1) peephole_hits += peephole(code);
+            code.print(os);
+        }
+
+        /// Translates single function with its own memory state, so functions can be translated on different threads
+        /// @param cfg CFG or snapshot of function nodes
+        /// @param globals ids of global variables function can access
+        /// @param optimization_level peephole pass runs from level 1
+        /// @param stats rewrites of peephole pass are added to, if not null
+        /// @return function asm
+        template<typename graph>
+        static error::expected<std::string> translate_function(u64 func_id, const JIR::CFG_Func& func,
+                                                               const graph& cfg, const std::set<u64>& globals,
+                                                               int optimization_level = 0,
+                                                               peephole_stats* stats = nullptr) {
+            asm_translator translator {};
+            translator.mem.globals = globals;
+            x86_code code;
+            auto r = translator.print_function(func_id, func, cfg, code);
+            if (!r) return r.error();
+            std::ostringstream os;
+            translator.write_code(code, os, optimization_level);
+            if (stats) *stats += translator.peephole_hits;
+            return os.str();
+        }
 
+        /// Prints data section, entrypoint and globals initialization, i.e. everything except functions
+        /// @param optimization_level from 1 on, globals initialized with constants are data instead of code, and
+        /// code initializing the rest goes through peephole pass
+        error::expected<void> print_prologue(const JIR::CFG& cfg, std::ostream& file, int optimization_level = 0) {
             file << "global main\nbits 64\nextern printf\nsection .data\n";
 
+            const auto& init = cfg.get_nodes()[0].body;
+            std::optional<std::map<u64, u64>> initial_values;
+            if (optimization_level >= 1) initial_values = JIR::fold_straight_line(init);
+            const bool init_code = !init.empty() && !initial_values;
+
             //print globals
             for (const auto& it : cfg.getScopeManager().top_allocations()) {
-                file << "var$" << it.value << ' ' << type(it.type) << " 0\n";
+                u64 value = 0;
+                if (initial_values && initial_values->contains(it.value)) value = initial_values->at(it.value);
+                file << "var$" << it.value << ' ' << type(it.type) << ' ' << value << '\n';
                 mem.globals.insert(it.value);
             }
 
             file << "DBG_PRINT: db \"{%d}: %d\", 0x0A, 0x00\n"
                     "section .text\n"
                     "main:\n"
-                    "sub rsp, 0x28\n"
-                    "call $f_0\n";
+                    "sub rsp, 0x28\n";
+            if (init_code) file << "call $f_0\n";
             //TODO move global initialization to separate cfg node that is always presented
 
-            if (const auto main_id = cfg.getScopeManager().findIdRecursive("main"); main_id != 0) {
+            if (const auto main_id = cfg.getScopeManager().findIdRecursive(sym::MAIN); main_id != 0) {
                 file << "call $f_" << main_id << '\n';
             }
 
-            //now return rsp to where it's been before allocations
-            file << "add rsp, 0x" << std::hex << mem.used_stack_space + 0x28 << std::dec << '\n';
-            mem.reset();
-
-            file << "ret;\n";
+            file << "add rsp, 0x28\n"
+                    "ret;\n";
 
-            //print global init
-            if (!cfg.get_nodes()[0].body.empty()) {
-                file << "$f_0:\nsub rsp, 8\n";
-                auto r = print_cfg_node(cfg, 0, file);
+            //print global init, laid out as function of the single global node
+            if (init_code) {
+                x86_code code;
+                code.label("$f_0");
+                print_entry(JIR::CFG_Func {0, 0, {}, {0}}, cfg, code);
+                auto r = print_body(cfg.get_nodes()[0], code);
                 if (!r) return r;
-                file << "add rsp, " << 8 + mem.used_stack_space << "\nret\n";
-                mem.used_stack_space = 0;
-                // file << "add rsp, 8\nret\n";
+                print_exit(code);
                 mem.reset();
+                write_code(code, file, optimization_level);
             }
+            return {};
+        }
 
-            //now print all functions
-            for (const auto& func : cfg.get_funcs()) {
-                //TODO handle args pass correctly (only 4 params would fit in ABI)
-                for (const auto& param : func.second.params) {
-                    mem.used_regs.emplace(param.value, pass_ABI[mem.args_in_registers_count++]);
-                }
-                mem.args_in_registers_count = 0;
+        /// @param optimization_level passes functions go through, see run_function_passes()
+        error::expected<void> translate(const JIR::CFG& cfg, const std::string& o_filename,
+                                        int optimization_level = 0) {
+            std::ofstream file {o_filename};
 
-                file << "$f_" << func.first << ":\nsub rsp, 8\n";
-                auto r = print_cfg_node(cfg, func.second.node_id, file);
-                file << "add rsp, 8\nret\n";
+            if (!file) return error::fail("Failed to open output file ", o_filename);
 
-                if (!r) return r;
+            auto prologue = print_prologue(cfg, file, optimization_level);
+            if (!prologue) return prologue;
 
-                mem.reset();
+            //now print all functions, going through the same passes as with parallel_asm_translator
+            for (const auto& [func_id, parsed] : cfg.get_funcs()) {
+                JIR::CFG_Func func = parsed;
+                auto snapshot = cfg.snapshot_function(func);
+                JIR::run_function_passes(snapshot, func, optimization_level);
+                auto r = translate_function(func_id, func, snapshot, mem.globals, optimization_level, &peephole_hits);
+                if (!r) return r.error();
+                file << r.value();
             }
-            return {""};
+            return {};
         }
     };
 }
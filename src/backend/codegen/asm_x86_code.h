@@ -0,0 +1,59 @@
+#ifndef ASM_X86_CODE_H
+#define ASM_X86_CODE_H
+
+#include <concepts>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace eraxc {
+
+    /// Line of x86 asm, instruction with its operands in NASM syntax or label
+    struct x86_instruction {
+        //mnemonic, or name label defines
+        std::string op;
+        std::vector<std::string> operands {};
+        bool label = false;
+
+        bool is(std::string_view mnemonic) const { return !label && op == mnemonic; }
+    };
+
+    /// Asm of function kept as instructions until passes over it are done, then printed
+    class x86_code {
+        std::vector<x86_instruction> lines {};
+
+        static std::string operand(std::string_view o) { return std::string {o}; }
+
+        template<std::integral T>
+        static std::string operand(T o) {
+            return std::to_string(o);
+        }
+
+    public:
+        /// Appends instruction, integer operands are printed in decimal
+        template<typename... T>
+        void emit(std::string_view mnemonic, const T&... operands) {
+            lines.push_back({std::string {mnemonic}, {operand(operands)...}});
+        }
+
+        void label(std::string name) { lines.push_back({std::move(name), {}, true}); }
+
+        std::vector<x86_instruction>& instructions() { return lines; }
+        const std::vector<x86_instruction>& instructions() const { return lines; }
+
+        void print(std::ostream& os) const {
+            for (const auto& line : lines) {
+                os << line.op;
+                if (line.label) {
+                    os << ":\n";
+                    continue;
+                }
+                for (size_t o = 0; o < line.operands.size(); o++) os << (o == 0 ? " " : ", ") << line.operands[o];
+                os << '\n';
+            }
+        }
+    };
+}
+
+#endif  //ASM_X86_CODE_H
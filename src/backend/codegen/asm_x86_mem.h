@@ -40,16 +40,18 @@ namespace eraxc {
             case x86_reg::RSP: r += "sp"; break;
             case x86_reg::RSI: r += "si"; break;
             case x86_reg::RDI: r += "di"; break;
-            case x86_reg::R8: r += "8"; break;
-            case x86_reg::R9: r += "9"; break;
-            case x86_reg::R10: r += "10"; break;
-            case x86_reg::R11: r += "11"; break;
-            case x86_reg::R12: r += "12"; break;
-            case x86_reg::R13: r += "13"; break;
-            case x86_reg::R14: r += "14"; break;
-            case x86_reg::R15: r += "15"; break;
+            case x86_reg::R8: r = "r8"; break;
+            case x86_reg::R9: r = "r9"; break;
+            case x86_reg::R10: r = "r10"; break;
+            case x86_reg::R11: r = "r11"; break;
+            case x86_reg::R12: r = "r12"; break;
+            case x86_reg::R13: r = "r13"; break;
+            case x86_reg::R14: r = "r14"; break;
+            case x86_reg::R15: r = "r15"; break;
             default: return "ILLREG";
         }
+        //lower half of numbered registers is r8d, not e8
+        if (reg >= x86_reg::R8 && type_size == 4) r += 'd';
         return r;
     }
 
@@ -66,72 +68,50 @@ namespace eraxc {
         std::unordered_map<u64, x86_reg> used_regs {};
 
 
-        //also represents rsp change from start of stack allocating
-        u64 used_stack_space = 0;
+        //callee-saved registers function pushed on entry, popped in reverse on return
+        std::vector<x86_reg> saved_regs {};
+        //bytes of stack frame allocated on entry after the pushes, rsp doesn't move in function body otherwise
+        u64 frame_size = 0;
         int args_in_registers_count = 0;
+        //bytes pushed in function body on top of the frame, which move slots away from rsp
+        u64 pushed = 0;
 
-        //For mapping used vars to stack
+        //For mapping used vars to stack, offsets from rsp inside the frame
         std::unordered_map<u64, u64> stack_offsets {};
 
         std::set<u64> globals {};
 
-        error::errable<std::string> get_var(u64 var, u64 type_size) {
+        error::expected<std::string> get_var(u64 var, u64 type_size) {
             if (globals.contains(var)) {
-                if (type_size == 8) return {"", "QWORD[rel var$" + std::to_string(var) + "]"};
-                if (type_size == 4) return {"", "DWORD[rel var$" + std::to_string(var) + "]"};
-                return {"Unsupported size", ""};
+                if (type_size == 8) return "QWORD[rel var$" + std::to_string(var) + "]";
+                if (type_size == 4) return "DWORD[rel var$" + std::to_string(var) + "]";
+                return error::fail("Unsupported size");
             }
             if (stack_offsets.contains(var)) {
-                u64 offset = used_stack_space - stack_offsets.at(var);
+                const u64 offset = stack_offsets.at(var) + pushed;
                 if (offset == 0) {
-                    if (type_size == 8) return {"", "QWORD[rsp]"};
-                    if (type_size == 4) return {"", "DWORD[rsp]"};
-                    return {"Unsupported size", {}};
+                    if (type_size == 8) return std::string {"QWORD[rsp]"};
+                    if (type_size == 4) return std::string {"DWORD[rsp]"};
+                    return error::fail("Unsupported size");
                 }
-                if (type_size == 8) return {"", "QWORD[rsp+" + std::to_string(offset) + ']'};
-                if (type_size == 4) return {"", "DWORD[rsp+" + std::to_string(offset) + ']'};
-                return {"Unsupported size", {}};
+                if (type_size == 8) return "QWORD[rsp+" + std::to_string(offset) + ']';
+                if (type_size == 4) return "DWORD[rsp+" + std::to_string(offset) + ']';
+                return error::fail("Unsupported size");
             }
-            if (used_regs.contains(var)) { return {"", reg_name(used_regs[var], type_size)}; }
-            return {"Variable " + std::to_string(var) + " is not allocated", ""};
-        }
-
-        error::errable<std::string> allocate_stack_space(int size, u64 var) {
-            #ifdef DEBUG  //some spare check
-            if (stack_offsets.contains(var) || used_regs.contains(var)) {
-                return {"Variable $" + std::to_string(var) + " is already allocated\n", ""};
-            }
-            #endif
-            stack_offsets[var] = used_stack_space;
-            used_stack_space += size;
-            return {"", "sub rsp, " + std::to_string(size) + "; allocate $" + std::to_string(var) + '\n'};
-        }
-
-        error::errable<std::string> try_dealloc(int size, u64 var) {
-            if (used_regs.contains(var)) {
-                used_regs.erase(var);
-                return {"", ""};
-            }
-            if (stack_offsets.contains(var)) { return try_dealloc_stack_space(size, var); }
-            return {"Variable " + std::to_string(var) + " is not allocated", ""};
-        }
-
-        error::errable<std::string> try_dealloc_stack_space(int size, u64 var) {
-            if (stack_offsets[var] + size != used_stack_space) {
-                //is not top stack element => cannot dealloc
-                return {"Variable $" + std::to_string(var) + " is not on top of stack", ""};
-            }
-            used_stack_space = stack_offsets[var];
-            stack_offsets.erase(var);
-            return {"", "add rsp, " + JIR::utils::int_to_hex(size) + "; dealloc $" + std::to_string(var) + '\n'};
+            if (used_regs.contains(var)) { return reg_name(used_regs[var], type_size); }
+            return error::fail("Variable {} is not allocated", std::to_string(var));
         }
 
         bool is_allocated(u64 var) const { return used_regs.contains(var) || stack_offsets.contains(var); }
 
+        bool in_register(const JIR::Operand& o) const { return !o.is_instant && used_regs.contains(o.value); }
+
         void reset() {
-            used_stack_space = 0;
+            saved_regs.clear();
+            frame_size = 0;
             used_regs.clear();
             args_in_registers_count = 0;
+            pushed = 0;
             stack_offsets.clear();
         }
     };
@@ -0,0 +1,150 @@
+#ifndef ASM_X86_PEEPHOLE_H
+#define ASM_X86_PEEPHOLE_H
+
+#include <array>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+#include "asm_x86_code.h"
+#include "asm_x86_mem.h"
+
+namespace eraxc {
+
+    /// Register operand is named as, e.g. x86_reg::R8 for "r8d"
+    inline std::optional<x86_reg> register_of(std::string_view operand) {
+        for (int r = int(x86_reg::RAX); r <= int(x86_reg::R15); r++) {
+            for (const u64 size : {8, 4}) {
+                if (reg_name(x86_reg(r), size) == operand) return x86_reg(r);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// Whether instruction leaves flags for the ones after it. Shift by cl keeps them when cl is 0, so it's not
+    /// one of them
+    inline bool sets_flags(const x86_instruction& i) {
+        for (const std::string_view op : {"add", "sub", "and", "or", "xor", "cmp", "test", "neg", "imul", "mul",
+                                          "div", "idiv"}) {
+            if (i.is(op)) return true;
+        }
+        return (i.is("shl") || i.is("shr") || i.is("sar")) && i.operands.size() == 2 && i.operands[1] != "cl";
+    }
+
+    /// Whether flags left by instruction at `at` are never read. Code after it is followed as it falls through, and
+    /// anything unknown is taken as read, so is a jump, whose target isn't followed
+    inline bool flags_dead(const std::vector<x86_instruction>& code, size_t at) {
+        for (size_t i = at + 1; i < code.size(); i++) {
+            const x86_instruction& next = code[i];
+            if (next.label || next.is("mov") || next.is("lea") || next.is("push") || next.is("pop") ||
+                next.is("cqo") || next.is("cdq") || next.is("not"))
+                continue;
+            //flags aren't preserved over calls
+            return sets_flags(next) || next.is("call") || next.is("ret");
+        }
+        return true;
+    }
+
+    /// `mov a, b` right after `mov b, a` copies value back where it already is, e.g. load of variable just stored
+    inline bool redundant_move(std::vector<x86_instruction>& code, size_t at) {
+        if (at + 1 >= code.size() || !code[at].is("mov") || !code[at + 1].is("mov")) return false;
+        const auto& store = code[at].operands;
+        const auto& load = code[at + 1].operands;
+        if (store.size() != 2 || load.size() != 2 || store[0] != load[1] || store[1] != load[0]) return false;
+        code.erase(code.begin() + at + 1);
+        return true;
+    }
+
+    /// Addition, subtraction, or, xor and shifts of 0, e.g. `add rsp, 0`, unless flags they set are read
+    inline bool identity_arithmetic(std::vector<x86_instruction>& code, size_t at) {
+        const x86_instruction& i = code[at];
+        if (i.operands.size() != 2 || i.operands[1] != "0") return false;
+        if (!i.is("add") && !i.is("sub") && !i.is("or") && !i.is("xor") && !i.is("shl") && !i.is("shr") &&
+            !i.is("sar"))
+            return false;
+        if (!flags_dead(code, at)) return false;
+        code.erase(code.begin() + at);
+        return true;
+    }
+
+    /// Jump, taken or not, to label among the ones right after it
+    inline bool jump_to_next(std::vector<x86_instruction>& code, size_t at) {
+        const x86_instruction& jump = code[at];
+        if (jump.label || jump.op.empty() || jump.op[0] != 'j' || jump.operands.size() != 1) return false;
+        for (size_t i = at + 1; i < code.size() && code[i].label; i++) {
+            if (code[i].op == jump.operands[0]) {
+                code.erase(code.begin() + at);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// `mov reg, 0` is `xor reg32, reg32`, which is shorter and clears the whole register too, unless flags it
+    /// sets are read
+    inline bool zero_with_xor(std::vector<x86_instruction>& code, size_t at) {
+        x86_instruction& i = code[at];
+        if (!i.is("mov") || i.operands.size() != 2 || i.operands[1] != "0") return false;
+        const auto reg = register_of(i.operands[0]);
+        if (!reg || !flags_dead(code, at)) return false;
+        const std::string low = reg_name(*reg, 4);
+        i = {"xor", {low, low}};
+        return true;
+    }
+
+    /// `cmp reg, 0` is `test reg, reg`, which sets the same flags and has no immediate
+    inline bool compare_with_test(std::vector<x86_instruction>& code, size_t at) {
+        x86_instruction& i = code[at];
+        if (!i.is("cmp") || i.operands.size() != 2 || i.operands[1] != "0" || !register_of(i.operands[0]))
+            return false;
+        i = {"test", {i.operands[0], i.operands[0]}};
+        return true;
+    }
+
+    /// Rewrite of instructions at a position
+    struct peephole_rule {
+        std::string_view name;
+        //rewrites code at position, or returns false and leaves it as is
+        bool (*apply)(std::vector<x86_instruction>& code, size_t at);
+    };
+
+    inline constexpr peephole_rule peephole_rules[] = {
+        {"redundant load/store", redundant_move},   {"identity arithmetic", identity_arithmetic},
+        {"jump to next", jump_to_next},             {"mov reg, 0 to xor", zero_with_xor},
+        {"cmp reg, 0 to test", compare_with_test},
+    };
+
+    /// How many times every rule of peephole_rules rewrote code
+    struct peephole_stats {
+        std::array<u64, std::size(peephole_rules)> hits {};
+
+        peephole_stats& operator+=(const peephole_stats& other) {
+            for (size_t r = 0; r < hits.size(); r++) hits[r] += other.hits[r];
+            return *this;
+        }
+
+        void print(std::ostream& os) const {
+            for (size_t r = 0; r < hits.size(); r++) os << peephole_rules[r].name << ": " << hits[r] << '\n';
+        }
+    };
+
+    /// Applies every rule at every instruction until none applies, since removal of instruction makes the ones
+    /// around it adjacent, e.g. store and load once `add rax, 0` between them is gone
+    inline peephole_stats peephole(x86_code& code) {
+        peephole_stats stats {};
+        auto& lines = code.instructions();
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = 0; i < lines.size(); i++) {
+                for (size_t r = 0; r < std::size(peephole_rules) && i < lines.size(); r++) {
+                    if (!peephole_rules[r].apply(lines, i)) continue;
+                    stats.hits[r]++;
+                    changed = true;
+                }
+            }
+        }
+        return stats;
+    }
+}
+
+#endif  //ASM_X86_PEEPHOLE_H
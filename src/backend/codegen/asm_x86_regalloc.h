@@ -0,0 +1,216 @@
+#ifndef ASM_X86_REGALLOC_H
+#define ASM_X86_REGALLOC_H
+
+#include <algorithm>
+#include <memory_resource>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "asm_x86_mem.h"
+#include "../JIR/CFG/liveness.h"
+#include "../JIR/CFG/sccp.h"
+
+namespace eraxc {
+
+    /// Registers variables get, caller-saved ones first since they cost nothing unless a call is in the way.
+    /// Codegen computes in rax, divides with rbx and rdx and passes arguments in rcx, rdx, r8 and r9, so those are
+    /// left out, as are rsp and rbp
+    static constexpr x86_reg allocatable_regs[] = {x86_reg::R10, x86_reg::R11, x86_reg::RSI, x86_reg::RDI,
+                                                   x86_reg::R12, x86_reg::R13, x86_reg::R14, x86_reg::R15};
+
+    /// Whether function has to give register back as it was, so it keeps value over calls
+    inline bool is_callee_saved(x86_reg reg) {
+        return reg != x86_reg::R10 && reg != x86_reg::R11 && reg != x86_reg::RAX && reg != x86_reg::RCX &&
+               reg != x86_reg::RDX && reg != x86_reg::R8 && reg != x86_reg::R9;
+    }
+
+    struct register_allocation {
+        //variables in registers, the rest stay on stack
+        std::unordered_map<u64, x86_reg> registers {};
+        //callee-saved registers function uses, in the order they're pushed
+        std::vector<x86_reg> saved {};
+        //offsets of the rest from rsp once frame is allocated
+        std::unordered_map<u64, u64> slots {};
+        //bytes function subtracts from rsp after the pushes, once for all its stack variables
+        u64 frame_size = 0;
+    };
+
+    /// Linear scan register allocation of Poletto and Sarkar. Nodes are numbered in layout order, every variable
+    /// gets an interval from the first to the last number it's live at, and intervals are walked by start with
+    /// the ones holding registers kept aside. When no register is free, the interval ending last stays on stack.
+    /// Interval that spans a call gets only callee-saved registers.
+    ///
+    /// Variables left on stack are laid out in one frame by a second scan, where a variable takes the slot of one
+    /// whose interval ended before it starts. Slots are grouped by size, widest first, so every slot is aligned to
+    /// its size, and frame of function that calls keeps rsp 16-byte aligned at the calls.
+    ///
+    /// A node reads its operands at its even number and writes at the odd one after, so `MOVE a, b` that's the last
+    /// read of b can give a the register of b, and the copy goes away. Allocation tries that first
+    /// @param cfg function snapshot or CFG, anything with get_cfg_node()
+    /// @param globals ids of global variables, which stay where they are even if code allocates them
+    /// @param memory resource for everything allocation needs only while it runs
+    template<typename graph>
+    register_allocation allocate_registers(const JIR::CFG_Func& func, const graph& cfg,
+                                           const std::set<u64>& globals = {},
+                                           std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+        register_allocation allocation {};
+        constexpr u32 NONE = JIR::block_graph::NONE;
+        const JIR::block_graph blocks {cfg, func.blocks, memory};
+
+        //parameters and locals, by id. Only 4 and 8 byte variables fit registers codegen names
+        std::pmr::vector<JIR::Operand> variables {func.params.begin(), func.params.end(), memory};
+        for (const u32 b : func.blocks) {
+            for (const auto& node : cfg.get_cfg_node(b).body) {
+                if (node.op == JIR::Operation::ALLOC && !globals.contains(node.operand1.value))
+                    variables.push_back(node.operand1);
+            }
+        }
+        std::sort(variables.begin(), variables.end(), [](const auto& a, const auto& b) { return a.value < b.value; });
+        variables.erase(std::unique(variables.begin(), variables.end(),
+                                    [](const auto& a, const auto& b) { return a.value == b.value; }),
+                        variables.end());
+        auto index = [&](u64 id) -> u32 {
+            const auto it = std::lower_bound(variables.begin(), variables.end(), id,
+                                             [](const JIR::Operand& o, u64 id) { return o.value < id; });
+            return it != variables.end() && it->value == id ? u32(it - variables.begin()) : NONE;
+        };
+        auto tracked = [&](const JIR::Operand& o) { return o.is_instant ? NONE : index(o.value); };
+        const JIR::liveness live {cfg, blocks, variables.size(), index, memory};
+
+        struct interval {
+            u32 start = JIR::block_graph::NONE;
+            u32 end = 0;
+        };
+        std::pmr::vector<interval> intervals(variables.size(), memory);
+        //variable MOVE copies from, whose register is tried first
+        std::pmr::vector<u32> hints(variables.size(), NONE, memory);
+        std::pmr::vector<u32> calls {memory};
+        auto extend = [&](u32 v, u32 at) {
+            if (v == NONE) return;
+            intervals[v].start = std::min(intervals[v].start, at);
+            intervals[v].end = std::max(intervals[v].end, at);
+        };
+        //arguments are moved to parameters on entry, before any node
+        for (const auto& param : func.params) extend(index(param.value), 0);
+        u32 position = 0;
+        for (u32 b = 0; b < blocks.size(); b++) {
+            const u32 first = position;
+            for (const auto& node : cfg.get_cfg_node(blocks.id(b)).body) {
+                if (JIR::reads_operand1(node.op)) extend(tracked(node.operand1), position);
+                if (JIR::reads_operand2(node.op)) extend(tracked(node.operand2), position);
+                if (JIR::writes_operand1(node.op)) extend(tracked(node.operand1), position + 1);
+                if (JIR::writes_operand2(node.op)) extend(tracked(node.operand2), position + 1);
+                if (node.op == JIR::Operation::CALL) calls.push_back(position);
+                if (node.op == JIR::Operation::MOVE && tracked(node.operand1) != NONE)
+                    hints[tracked(node.operand1)] = tracked(node.operand2);
+                position += 2;
+            }
+            live.live_in(b).for_each([&](u32 v) { extend(v, first); });
+            live.live_out(b).for_each([&](u32 v) { extend(v, position); });
+            //terminator
+            position += 2;
+        }
+        auto crosses_call = [&](u32 v) {
+            const auto call = std::upper_bound(calls.begin(), calls.end(), intervals[v].start);
+            return call != calls.end() && *call + 1 < intervals[v].end;
+        };
+
+        std::pmr::vector<u32> order {memory};
+        for (u32 v = 0; v < variables.size(); v++) {
+            const u32 bits = JIR::type_bits(variables[v].type);
+            if (intervals[v].start != NONE && (bits == 32 || bits == 64)) order.push_back(v);
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](u32 a, u32 b) { return intervals[a].start < intervals[b].start; });
+
+        constexpr u32 count = std::size(allocatable_regs);
+        //register of every variable by its position in allocatable_regs, NONE on stack
+        std::pmr::vector<u32> assigned(variables.size(), NONE, memory);
+        std::pmr::vector<u32> active {memory};
+        bool free[count];
+        std::fill(std::begin(free), std::end(free), true);
+        for (const u32 v : order) {
+            std::erase_if(active, [&](u32 a) {
+                if (intervals[a].end >= intervals[v].start) return false;
+                free[assigned[a]] = true;
+                return true;
+            });
+            const bool call = crosses_call(v);
+            auto allowed = [&](u32 r) { return !call || is_callee_saved(allocatable_regs[r]); };
+            u32 reg = NONE;
+            const u32 hint = hints[v] == NONE ? NONE : assigned[hints[v]];
+            if (hint != NONE && free[hint] && allowed(hint)) reg = hint;
+            for (u32 r = 0; r < count && reg == NONE; r++) {
+                if (free[r] && allowed(r)) reg = r;
+            }
+            if (reg == NONE) {
+                //spilled is the interval ending last, so the rest of the walk has more registers
+                auto last = active.end();
+                for (auto a = active.begin(); a != active.end(); ++a) {
+                    if (allowed(assigned[*a]) && (last == active.end() || intervals[*a].end > intervals[*last].end))
+                        last = a;
+                }
+                if (last == active.end() || intervals[*last].end <= intervals[v].end) continue;
+                reg = assigned[*last];
+                assigned[*last] = NONE;
+                active.erase(last);
+            }
+            assigned[v] = reg;
+            free[reg] = false;
+            active.push_back(v);
+        }
+
+        bool used[count] {};
+        for (u32 v = 0; v < variables.size(); v++) {
+            if (assigned[v] == NONE) continue;
+            allocation.registers.emplace(variables[v].value, allocatable_regs[assigned[v]]);
+            used[assigned[v]] = true;
+        }
+        for (u32 r = 0; r < count; r++) {
+            if (used[r] && is_callee_saved(allocatable_regs[r])) allocation.saved.push_back(allocatable_regs[r]);
+        }
+
+        struct slot {
+            u32 size;
+            //end of interval of the last variable in the slot
+            u32 end;
+        };
+        std::pmr::vector<slot> slots {memory};
+        std::pmr::vector<u32> slot_of(variables.size(), NONE, memory);
+        std::pmr::vector<u32> spilled {memory};
+        for (u32 v = 0; v < variables.size(); v++) {
+            if (intervals[v].start != NONE && assigned[v] == NONE) spilled.push_back(v);
+        }
+        std::stable_sort(spilled.begin(), spilled.end(),
+                         [&](u32 a, u32 b) { return intervals[a].start < intervals[b].start; });
+        for (const u32 v : spilled) {
+            const u32 bits = JIR::type_bits(variables[v].type);
+            const u32 size = bits == 0 ? 8 : bits / 8;
+            auto free_slot = std::find_if(slots.begin(), slots.end(), [&](const slot& s) {
+                return s.size == size && s.end < intervals[v].start;
+            });
+            if (free_slot == slots.end()) free_slot = slots.insert(slots.end(), {size, 0});
+            free_slot->end = intervals[v].end;
+            slot_of[v] = free_slot - slots.begin();
+        }
+        std::pmr::vector<u64> offsets(slots.size(), memory);
+        u64 frame = 0;
+        for (const u32 size : {8u, 4u, 2u, 1u}) {
+            for (u32 s = 0; s < slots.size(); s++) {
+                if (slots[s].size != size) continue;
+                offsets[s] = frame;
+                frame += size;
+            }
+        }
+        for (u32 v = 0; v < variables.size(); v++) {
+            if (slot_of[v] != NONE) allocation.slots.emplace(variables[v].value, offsets[slot_of[v]]);
+        }
+        //call pushed return address on 16-byte aligned stack, and the pushes of saved registers came after it
+        const u64 pushed = 8 * (allocation.saved.size() + 1);
+        allocation.frame_size = calls.empty() ? (frame + 7) / 8 * 8 : (frame + pushed + 15) / 16 * 16 - pushed;
+        return allocation;
+    }
+}
+
+#endif  //ASM_X86_REGALLOC_H
@@ -0,0 +1,102 @@
+#ifndef ASM_X86_SELECT_H
+#define ASM_X86_SELECT_H
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+#include "../JIR/CFG/sccp.h"
+
+namespace eraxc {
+
+    /// Whether instant of type fits 32-bit immediate x86 sign-extends to operand size
+    inline bool fits_imm32(u64 value, u64 type) {
+        const i64 v = i64(JIR::extend(value, type));
+        return JIR::type_bits(type) != 64 ||
+               (v >= std::numeric_limits<int32_t>::min() && v <= std::numeric_limits<int32_t>::max());
+    }
+
+    /// @return k for value that is 2^k, -1 otherwise
+    inline int power_of_two(u64 value) { return std::has_single_bit(value) ? std::countr_zero(value) : -1; }
+
+    /// Multiplier division by constant turns into, Granlund and Montgomery. Quotient is the high half of product of
+    /// dividend and multiplier, shifted right by `shift`
+    struct division_magic {
+        u64 multiplier;
+        u32 shift;
+        //unsigned multiplier doesn't fit type, so quotient is ((x - high) / 2 + high) >> (shift - 1)
+        bool add;
+    };
+
+    /// Magic number of unsigned division, magicu2 of Hacker's Delight for any width
+    /// @param d divisor, at least 1
+    /// @param bits width of type, 32 or 64
+    inline division_magic unsigned_magic(u64 d, u32 bits) {
+        const u64 mask = bits == 64 ? ~u64(0) : (u64(1) << bits) - 1;
+        const u64 max_signed = mask >> 1;
+        division_magic magic {0, 0, false};
+        u32 p = bits - 1;
+        //q = (2^p - 1) / d, r = rem(2^p - 1, d), and p_bits = 2^(p - bits) once p reaches bits
+        u64 q = max_signed / d;
+        u64 r = max_signed - q * d;
+        u64 p_bits = 0;
+        u64 delta;
+        do {
+            p++;
+            p_bits = p == bits ? 1 : p_bits * 2;
+            if (r + 1 >= d - r) {
+                if (q >= max_signed) magic.add = true;
+                q = (2 * q + 1) & mask;
+                r = 2 * r + 1 - d;
+            } else {
+                if (q >= max_signed + 1) magic.add = true;
+                q = (2 * q) & mask;
+                r = 2 * r + 1;
+            }
+            delta = d - 1 - r;
+        } while (p < 2 * bits && (p_bits < delta || (p_bits == delta && r == 0)));
+        magic.multiplier = (q + 1) & mask;
+        magic.shift = p - bits;
+        return magic;
+    }
+
+    /// Magic number of signed division, of Hacker's Delight for any width. Multiplier is negative, as value of type,
+    /// when it doesn't fit, and then dividend is added to the high half before the shift
+    /// @param d divisor extended to 64 bits, not -1, 0 or 1
+    /// @param bits width of type, 32 or 64
+    inline division_magic signed_magic(i64 d, u32 bits) {
+        const u64 mask = bits == 64 ? ~u64(0) : (u64(1) << bits) - 1;
+        const u64 min = u64(1) << (bits - 1);
+        const u64 ad = d < 0 ? u64(0) - u64(d) : u64(d);
+        const u64 t = min + (d < 0);
+        //absolute value of the largest dividend that leaves remainder d - 1
+        const u64 anc = t - 1 - t % ad;
+        u32 p = bits - 1;
+        u64 q1 = min / anc;
+        u64 r1 = min - q1 * anc;
+        u64 q2 = min / ad;
+        u64 r2 = min - q2 * ad;
+        u64 delta;
+        do {
+            p++;
+            q1 = (2 * q1) & mask;
+            r1 = 2 * r1;
+            if (r1 >= anc) {
+                q1++;
+                r1 -= anc;
+            }
+            q2 = (2 * q2) & mask;
+            r2 = 2 * r2;
+            if (r2 >= ad) {
+                q2++;
+                r2 -= ad;
+            }
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+        u64 multiplier = (q2 + 1) & mask;
+        if (d < 0) multiplier = (u64(0) - multiplier) & mask;
+        return {multiplier, p - bits, false};
+    }
+}
+
+#endif  //ASM_X86_SELECT_H
@@ -0,0 +1,155 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexic/preprocessor_tokenizer.h"
+#include "util/error.h"
+
+namespace eraxc {
+
+    /// Diagnostics of one compilation. Parser reports every error it recovers from instead of stopping at the first
+    /// one, so all errors of a file come out of a single run. Messages stay interned failures until printed
+    class diagnostics {
+    public:
+        //CRITICAL error doesn't stop compilation of file, FATAL one does, as error::critical and error::fatal
+        enum class severity : unsigned char { NOTE, WARNING, CRITICAL, FATAL };
+
+        struct note {
+            error::failure what;
+            token at;
+        };
+
+        struct diagnostic {
+            severity level;
+            error::failure what;
+            //source range the diagnostic is about, from its first token to its last one
+            token begin;
+            token end;
+            std::vector<note> notes;
+        };
+
+    private:
+        std::vector<diagnostic> reported {};
+        size_t errors = 0;
+        size_t max_errors;
+
+        static std::string_view name(severity level) {
+            switch (level) {
+                case severity::NOTE: return "note";
+                case severity::WARNING: return "warning";
+                case severity::CRITICAL: return "error";
+                default: return "fatal";
+            }
+        }
+
+        static std::string code(const error::failure& what) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "E%04u", unsigned(what.code));
+            return buffer;
+        }
+
+        static void write_json_string(std::ostream& os, std::string_view s) {
+            os << '"';
+            for (unsigned char c : s) {
+                if (c == '"' || c == '\\') os << '\\' << c;
+                else if (c == '\n') os << "\\n";
+                else if (c == '\t') os << "\\t";
+                else if (c < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", unsigned(c));
+                    os << buffer;
+                } else os << c;
+            }
+            os << '"';
+        }
+
+        static void write_json_position(std::ostream& os, const tokenizer::source_location& at) {
+            os << "{\"line\":" << at.line << ",\"column\":" << at.column << '}';
+        }
+
+    public:
+        /// @param max_errors errors count after which parser gives up on the file
+        explicit diagnostics(size_t max_errors = 100) : max_errors(max_errors) {}
+
+        /// @param begin first token of source range the diagnostic is about
+        /// @param end last token of the range
+        void report(severity level, error::failure what, const token& begin, const token& end,
+                    std::vector<note> notes = {}) {
+            if (level >= severity::CRITICAL) errors++;
+            reported.push_back({level, what, begin, end, std::move(notes)});
+        }
+
+        size_t error_count() const { return errors; }
+        bool has_errors() const { return errors != 0; }
+
+        /// Whether so many errors were reported that the rest are most likely caused by them
+        bool limit_reached() const { return errors >= max_errors; }
+
+        const std::vector<diagnostic>& all() const { return reported; }
+
+        /// @return the first reported error, failure without message if there's none
+        error::failure first_error() const {
+            for (const auto& d : reported) {
+                if (d.level >= severity::CRITICAL) return d.what;
+            }
+            return {};
+        }
+
+        /// Prints every diagnostic as `file:line:column: error E0003: message`, followed by its notes.
+        /// Location is left out for diagnostics about the whole file, e.g. missing entrypoint
+        /// @param t tokenizer tokens of the diagnostics come from
+        void print(std::ostream& os, const tokenizer& t) const {
+            for (const auto& d : reported) {
+                if (d.begin.source != token::NO_SOURCE) os << t.location(d.begin) << ": ";
+                os << name(d.level);
+                if (d.what.code != 0) os << ' ' << code(d.what);
+                os << ": " << d.what.message() << '\n';
+                for (const auto& n : d.notes) os << t.location(n.at) << ": note: " << n.what.message() << '\n';
+            }
+        }
+
+        /// Writes diagnostics as JSON array of
+        /// `{"severity", "code", "message", "file", "begin": {"line", "column"}, "end": {...}, "notes": [...]}`
+        /// with end pointing right after the last token of the range, and notes of `{"message", "file", "begin"}`.
+        /// Diagnostics about the whole file have no file and range
+        void print_json(std::ostream& os, const tokenizer& t) const {
+            os << '[';
+            for (size_t i = 0; i < reported.size(); i++) {
+                const auto& d = reported[i];
+                os << (i ? "," : "") << "\n{\"severity\":\"" << name(d.level) << '"';
+                if (d.what.code != 0) os << ",\"code\":\"" << code(d.what) << '"';
+                os << ",\"message\":";
+                write_json_string(os, d.what.message());
+                if (d.begin.source != token::NO_SOURCE) {
+                    const auto begin = t.position(d.begin);
+                    os << ",\"file\":";
+                    write_json_string(os, begin.file);
+                    os << ",\"begin\":";
+                    write_json_position(os, begin);
+                    os << ",\"end\":";
+                    write_json_position(os, t.position(d.end, true));
+                }
+                os << ",\"notes\":[";
+                for (size_t k = 0; k < d.notes.size(); k++) {
+                    const auto at = t.position(d.notes[k].at);
+                    os << (k ? "," : "") << "{\"message\":";
+                    write_json_string(os, d.notes[k].what.message());
+                    os << ",\"file\":";
+                    write_json_string(os, at.file);
+                    os << ",\"begin\":";
+                    write_json_position(os, at);
+                    os << '}';
+                }
+                os << "]}";
+            }
+            os << "\n]\n";
+        }
+    };
+}
+
+#endif  //DIAGNOSTICS_H
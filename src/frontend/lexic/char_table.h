@@ -0,0 +1,93 @@
+#ifndef CHAR_TABLE_H
+#define CHAR_TABLE_H
+
+#include <array>
+#include <string_view>
+
+namespace eraxc::lexic {
+
+    enum char_class : unsigned char {
+        CC_SPACE = 1 << 0,
+        CC_IDENT_START = 1 << 1,
+        CC_IDENT = 1 << 2,
+        CC_DIGIT = 1 << 3,
+        //number instant continuation: digits and type suffixes (`64ul`, `2i`)
+        CC_NUMBER = 1 << 4,
+        CC_OPERATOR = 1 << 5,
+        CC_PUNCT = 1 << 6,
+    };
+
+    inline constexpr std::string_view operator_chars_list = "<=>&|^%*/~+-!?";
+    inline constexpr std::string_view punct_chars_list = "()[]{};:.,";
+
+    /// Every character class of 256 possible chars, built at compile time
+    inline constexpr std::array<unsigned char, 256> char_table = [] {
+        std::array<unsigned char, 256> t {};
+        for (unsigned char c : std::string_view {" \t\n\r"}) t[c] |= CC_SPACE;
+        for (int c = 'a'; c <= 'z'; c++) t[c] |= CC_IDENT_START | CC_IDENT;
+        for (int c = 'A'; c <= 'Z'; c++) t[c] |= CC_IDENT_START | CC_IDENT;
+        t['_'] |= CC_IDENT_START | CC_IDENT;
+        t['-'] |= CC_IDENT;
+        for (int c = '0'; c <= '9'; c++) t[c] |= CC_DIGIT | CC_IDENT | CC_NUMBER;
+        for (unsigned char c : std::string_view {"uli"}) t[c] |= CC_NUMBER;
+        for (unsigned char c : operator_chars_list) t[c] |= CC_OPERATOR;
+        for (unsigned char c : punct_chars_list) t[c] |= CC_PUNCT;
+        return t;
+    }();
+
+    constexpr bool is(char c, char_class cc) { return char_table[static_cast<unsigned char>(c)] & cc; }
+
+    /// All operators lexer recognizes. Longest match wins (maximal munch)
+    inline constexpr std::string_view operator_spellings[] = {
+        "==", "!=", "=",  ">",  "<",  ">=", "<=", "+",  "-",  "*",   "/",   "%",  "&&", "||", "^^", "!",  "&",  "|",
+        "^",  "~",  ">>", "<<", "+=", "-=", "*=", "/=", "%=", "&=", "^=",  "|=",  "~=", "++", "--", ">>=", "<<=", "?"};
+
+    /// Trie-shaped DFA over operator spellings. State 0 is start and also the dead state for transitions
+    struct operator_dfa {
+        static constexpr size_t ALPHABET = operator_chars_list.size();
+        static constexpr size_t MAX_STATES = [] {
+            size_t n = 1;
+            for (auto op : operator_spellings) n += op.size();
+            return n;
+        }();
+
+        //operator char -> alphabet index
+        std::array<unsigned char, 256> index {};
+        std::array<std::array<unsigned char, ALPHABET>, MAX_STATES> next {};
+        std::array<bool, MAX_STATES> accepting {};
+
+        constexpr operator_dfa() {
+            for (size_t i = 0; i < ALPHABET; i++) index[static_cast<unsigned char>(operator_chars_list[i])] = i;
+            size_t states = 1;
+            for (auto op : operator_spellings) {
+                size_t s = 0;
+                for (char c : op) {
+                    auto& to = next[s][index[static_cast<unsigned char>(c)]];
+                    if (to == 0) to = states++;
+                    s = to;
+                }
+                accepting[s] = true;
+            }
+        }
+
+        /// Matches longest operator at p
+        /// @return end of matched operator, p if there's no operator at p
+        constexpr const char* match(const char* p, const char* end) const {
+            const char* matched = p;
+            size_t s = 0;
+            while (p < end && is(*p, CC_OPERATOR)) {
+                s = next[s][index[static_cast<unsigned char>(*p)]];
+                if (s == 0) break;
+                ++p;
+                if (accepting[s]) matched = p;
+            }
+            return matched;
+        }
+    };
+
+    inline constexpr operator_dfa operators_dfa {};
+
+    static_assert(operator_dfa::MAX_STATES < 256, "operator DFA states have to fit in a byte");
+}
+
+#endif  //CHAR_TABLE_H
@@ -1,27 +1,33 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include <deque>
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <fstream>
 #include <sstream>
-#include <set>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <span>
+#include <type_traits>
 
 #include "../../util/error.h"
+#include "../../util/interner.h"
+#include "char_table.h"
+#include "simd_scan.h"
+#include "source_buffer.h"
 
 namespace eraxc {
+    /// Token parser reads. Packed POD: text is interned, position is an offset into one of tokenizer sources,
+    /// so it's never allocated and is turned into line and column only when a diagnostic needs it
     struct token {
-        static inline std::set<char> special_symbols {';', '\'', '\"', '=', '+', '<', '>', '%', '/',
-                                                      '*', '!',  '&',  '|', '^', '(', ')', '{', '}',
-                                                      '[', ']',  '-',  '?', ':', '.', ',', '~'};
-
-        static inline std::set<char> operator_chars {'<', '=', '>', '&', '|', '^', '%',
-                                                     '*', '/', '~', '+', '-', '!', '?'};
-
-        static inline std::set<char> instant_number_chars {'u', 'l', 'i'};
-
-        enum type {
+        enum type : unsigned char {
             SEMICOLON,
             COLON,
             COMMA,
@@ -39,217 +45,759 @@ namespace eraxc {
             NONE,
         };
 
-        type t;
-        std::string data;
+        /// Token type of every single-char punctuation symbol, NONE for the rest of chars
+        static constexpr std::array<type, 256> punctuation = [] {
+            std::array<type, 256> t {};
+            t.fill(NONE);
+            t['('] = L_BRACKET;
+            t[')'] = R_BRACKET;
+            t['['] = L_SQ_BRACKET;
+            t[']'] = R_SQ_BRACKET;
+            t['{'] = L_F_BRACKET;
+            t['}'] = R_F_BRACKET;
+            t[';'] = SEMICOLON;
+            t[':'] = COLON;
+            t['.'] = DOT;
+            t[','] = COMMA;
+            return t;
+        }();
+
+        enum flag : unsigned char {
+            //token comes out of macro expansion
+            FROM_MACRO = 1,
+        };
+
+        static constexpr u16 NO_SOURCE = -1;
+
+        type t = NONE;
+        unsigned char flags = 0;
+        //index of source buffer in tokenizer::sources
+        u16 source = NO_SOURCE;
+        //interned text of identifier or literal
+        symbol sym = NO_SYMBOL;
+        u32 offset = 0;
+
+        token() = default;
+        token(type t, std::string_view data) : t(t), sym(interner::global().intern(data)) {}
+        token(type t, symbol sym, u16 source, u32 offset, unsigned char flags = 0)
+            : t(t), flags(flags), source(source), sym(sym), offset(offset) {}
+
+        std::string_view data() const { return interner::global().text(sym); }
+
+        bool operator==(const token& other) const { return t == other.t && sym == other.sym; }
+    };
+
+    static_assert(sizeof(token) == 12 && std::is_trivially_copyable_v<token>);
+
+    /// Non-owning token. Data references source buffer owned by the tokenizer that produced it
+    struct token_view {
+        token::type t;
+        std::string_view data;
+        symbol sym = NO_SYMBOL;
+        unsigned char flags = 0;
+
+        token_view() : t(token::NONE), data() {}
+        token_view(token::type t, std::string_view data, symbol sym = NO_SYMBOL, unsigned char flags = 0)
+            : t(t), data(data), sym(sym), flags(flags) {}
+
+        bool operator==(const token_view& other) const { return t == other.t && data == other.data; }
+    };
+
+    /// Macro made by `#define`. Body is lexed once, every use splices its tokens
+    struct macro {
+        //definition after macro name, `(a, b) a + b` or `a + b`, so macros can be compared by text
+        std::string_view text;
+        std::vector<token_view> body;
+        std::vector<symbol> params;
+        bool function_like = false;
+    };
 
-        token() {
-            t = NONE;
-            data = std::string {};
+    typedef std::unordered_map<symbol, const macro*> macro_table;
+
+    /// Expands macros in token sequences. Macro isn't expanded inside of its own expansion,
+    /// so `#define X X + 1` turns `X` into `X + 1` once
+    class macro_expansion {
+        const macro_table& defined;
+        //macros being expanded, innermost last
+        std::vector<symbol> active {};
+
+        /// Splits arguments of call `(a, (b, c))`
+        /// @param i index of `(`, moved past `)`
+        /// @return false if there's no closing `)`
+        static bool split_args(std::span<const token_view> input, size_t& i,
+                               std::vector<std::span<const token_view>>& args) {
+            size_t depth = 0;
+            size_t start = i + 1;
+            for (; i < input.size(); i++) {
+                if (input[i].t == token::L_BRACKET) depth++;
+                else if (input[i].t == token::R_BRACKET && --depth == 0) {
+                    args.push_back(input.subspan(start, i - start));
+                    i++;
+                    return true;
+                } else if (input[i].t == token::COMMA && depth == 1) {
+                    args.push_back(input.subspan(start, i - start));
+                    start = i + 1;
+                }
+            }
+            return false;
         }
 
-        token(type t, const std::string& data) {
-            this->t = t;
-            this->data = data;
+        template<typename sink>
+        void call(symbol name, const macro& m, const std::vector<std::span<const token_view>>& args, sink& tokens) {
+            //`F()` has one empty argument
+            if (args.size() != m.params.size() && !(m.params.empty() && args.size() == 1 && args[0].empty())) {
+                error = "Macro " + std::string {interner::global().text(name)} + " expects " +
+                        std::to_string(m.params.size()) + " arguments, got " + std::to_string(args.size());
+                return;
+            }
+            //arguments are expanded before they're substituted
+            std::vector<std::vector<token_view>> expanded(m.params.size());
+            for (size_t a = 0; a < m.params.size(); a++) expand(args[a], expanded[a]);
+
+            std::vector<token_view> substituted {};
+            for (const auto& t : m.body) {
+                auto param = std::find(m.params.begin(), m.params.end(), t.sym);
+                if (t.t == token::IDENTIFIER && param != m.params.end()) {
+                    const auto& arg = expanded[param - m.params.begin()];
+                    substituted.insert(substituted.end(), arg.begin(), arg.end());
+                } else substituted.push_back(t);
+            }
+            active.push_back(name);
+            expand(substituted, tokens);
+            active.pop_back();
         }
 
-        bool operator==(const token& other) const { return t == other.t && data == other.data; }
+    public:
+        std::string error {};
+
+        explicit macro_expansion(const macro_table& defined) : defined(defined) {}
+
+        /// @return macro the token expands to or nullptr
+        const macro* find(const token_view& t) const {
+            if (t.t != token::IDENTIFIER || defined.empty()) return nullptr;
+            auto it = defined.find(t.sym);
+            if (it == defined.end() || std::find(active.begin(), active.end(), t.sym) != active.end()) return nullptr;
+            //`#define flag` only marks flag as defined, it's left in the code as it is
+            if (!it->second->function_like && it->second->body.empty()) return nullptr;
+            return it->second;
+        }
+
+        /// Appends tokens with every macro expanded
+        template<typename sink>
+        void expand(std::span<const token_view> input, sink& tokens) {
+            for (size_t i = 0; i < input.size();) {
+                const macro* m = find(input[i]);
+                const symbol name = input[i].sym;
+                size_t call_end = i + 1;
+                std::vector<std::span<const token_view>> args {};
+                //function-like macro name without arguments is just an identifier
+                if (m == nullptr || (m->function_like && (call_end == input.size() ||
+                                                          input[call_end].t != token::L_BRACKET ||
+                                                          !split_args(input, call_end, args)))) {
+                    const unsigned char flags = input[i].flags | (active.empty() ? 0 : token::FROM_MACRO);
+                    tokens.emplace_back(input[i].t, input[i].data, input[i].sym, flags);
+                    i++;
+                    continue;
+                }
+                if (m->function_like) call(name, *m, args, tokens);
+                else {
+                    active.push_back(name);
+                    expand(m->body, tokens);
+                    active.pop_back();
+                }
+                i = call_end;
+            }
+        }
     };
 
-    struct tokenizer {
-        std::unordered_map<std::string, std::string> defined;
+    /// Sink expanding macros in tokens as scanner produces them, before they get to the real sink
+    template<typename sink>
+    class macro_expander {
+        sink& tokens;
+        macro_expansion expansion;
+        //function-like macro call being read: name, `(` and arguments so far
+        std::vector<token_view> call {};
+        size_t depth = 0;
 
-        error::errable<std::vector<token>> process_macro(std::stringstream& ss) {
-            std::string macro;
-            ss >> macro;
-            if (macro == "define") {
-                char c;
-                ss.get(c);  //load first identifier letter
-                ss.get(c);  //load first identifier letter
-                std::string def;
-                if (c != '_' && !std::isalpha(c)) return {"#define expected identifier as first argument", {}};
-                do {
-                    def += c;
-                    ss.get(c);
-                } while (is_identifier_char(c) && !ss.eof());
-                if (c == '\n') {
-                    defined[def] = "";
-                    return {"", {}};
+    public:
+        macro_expander(const macro_table& defined, sink& tokens) : tokens(tokens), expansion(defined) {}
+
+        void emplace_back(token::type t, std::string_view data, symbol sym = NO_SYMBOL, unsigned char flags = 0) {
+            const token_view token {t, data, sym, flags};
+            if (!call.empty()) {
+                if (call.size() == 1 && t != token::L_BRACKET) {
+                    //not a call, just the name
+                    tokens.emplace_back(call[0].t, call[0].data, call[0].sym, call[0].flags);
+                    call.clear();
+                } else {
+                    call.push_back(token);
+                    if (t == token::L_BRACKET) depth++;
+                    else if (t == token::R_BRACKET && --depth == 0) {
+                        expansion.expand(call, tokens);
+                        call.clear();
+                    }
+                    return;
                 }
-                if (c != ' ') return {"Expected end of line or space at the end of identifier", {}};
-                std::string to_def;
-                ss.get(c);
-                do {
-                    to_def += c;
-                    ss.get(c);
-                } while (!ss.eof() && c != '\n');
-                defined[def] = to_def;
-                return {"", {}};
             }
-            if (macro == "ifdef") {
-                std::string def {};
-                ss >> def;
-                if (defined.contains(def)) {
-                    //scroll until #endif
-                    std::stringstream tr {};
-                    std::string l;
-                    do {
-                        ss >> l;
-                        if (l == "#endif") break;
-                        tr << l << ' ';
-                    } while (!ss.eof());
-                    if (l != "#endif") return {"expected #endif before EOF", {}};
-                    return tokenize(tr);
+            const macro* m = expansion.find(token);
+            if (m == nullptr) tokens.emplace_back(t, data, sym, flags);
+            else if (m->function_like) {
+                call.push_back(token);
+                depth = 0;
+            } else expansion.expand(std::span {&token, 1}, tokens);
+        }
+
+        /// Appends token that is already expanded, e.g. of included file
+        void emplace_expanded(const token_view& t) {
+            if (call.empty()) tokens.emplace_back(t.t, t.data, t.sym, t.flags);
+            else emplace_back(t.t, t.data, t.sym, t.flags);
+        }
+
+        /// Called at the end of buffer
+        error::errable<void> finish() {
+            if (call.size() == 1) tokens.emplace_back(call[0].t, call[0].data, call[0].sym, call[0].flags);
+            else if (!call.empty()) return {"Expected ) of macro call " + std::string {call[0].data} + " before EOF"};
+            call.clear();
+            return {expansion.error};
+        }
+    };
+
+    struct tokenizer {
+        //every macro ever defined, deque never relocates them
+        std::deque<macro> macros;
+        //macro name -> its current definition
+        macro_table defined;
+
+        //every #define in order, so defines of an included file can be replayed when its tokens are reused
+        std::vector<std::pair<symbol, const macro*>> define_log;
+        //id of the current state of defined macros, changes on every #define
+        u64 defines_state = 0;
+        u64 last_defines_state = 0;
+
+        /// Tokens of a file included during this compilation
+        struct included_file {
+            const source_buffer* buffer;
+            std::vector<token_view> tokens;
+            //tokens are the same whenever the file is included with the same macros defined
+            u64 state_before;
+            u64 state_after;
+            //defines the file made, range of define_log
+            size_t defines_begin;
+            size_t defines_end;
+            //`X` of a file wrapped in `#ifndef X #define X ... #endif`, NO_SYMBOL if file isn't guarded
+            symbol guard;
+        };
+
+        //canonical path -> included file
+        std::unordered_map<std::string, included_file> included;
+        //canonical paths of files being scanned right now, a file among them can't be included again
+        std::unordered_set<std::string> active_files;
+        //directories of files being scanned, included file is looked up relative to the innermost one first
+        std::vector<std::filesystem::path> file_dirs;
+
+        /// `#if`, `#ifdef` or `#ifndef` whose taken branch is being scanned
+        struct conditional {
+            bool has_else;
+        };
+
+        //open conditionals of all the buffers being scanned, innermost last
+        std::vector<conditional> conditionals;
+        //conditionals of the buffer being scanned start from here, it can't close the ones of buffer including it
+        size_t conditionals_base = 0;
+
+        //every buffer tokens were produced from. deque never relocates elements
+        std::deque<source_buffer> sources;
+
+        //source the last packed token pointed into
+        size_t last_source = 0;
+
+        //identifiers of sources, so lexer doesn't take interner lock on every identifier
+        symbol_cache symbols {};
+
+        //instruction set of whitespace, comment and identifier runs scanners, best supported by cpu by default
+        lexic::simd_level simd = lexic::detect_simd_level();
+
+        void set_simd_level(lexic::simd_level level) { simd = lexic::supported_simd_level(level); }
+
+        static bool is_identifier_char(char c) { return lexic::is(c, lexic::CC_IDENT); }
+
+        static bool is_space(char c) { return lexic::is(c, lexic::CC_SPACE); }
+
+        /// Skips spaces and tabs but not newlines
+        static const char* skip_blank(const char* p, const char* end) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+            return p;
+        }
+
+        /// Reads whitespace separated word, skipping leading whitespace
+        static std::string_view read_word(const char*& p, const char* end) {
+            while (p < end && is_space(*p)) ++p;
+            const char* start = p;
+            while (p < end && !is_space(*p)) ++p;
+            return {start, size_t(p - start)};
+        }
+
+        static const char* find_line_end(const char* p, const char* end) { return lexic::scalar::line_end(p, end); }
+
+        /// Skips whitespace and `//` comments
+        static const char* skip_space_and_comments(const char* p, const char* end) {
+            while (p < end) {
+                if (is_space(*p)) ++p;
+                else if (*p == '/' && p + 1 < end && p[1] == '/') p = find_line_end(p, end);
+                else break;
+            }
+            return p;
+        }
+
+        /// Reads directive name right after `#`, which may be followed by anything that isn't identifier char
+        static std::string_view directive_name(const char*& p, const char* end) {
+            p = skip_blank(p, end);
+            const char* start = p;
+            p = lexic::scalar::ident_end(p, end);
+            return {start, size_t(p - start)};
+        }
+
+        /// Skips branch of conditional that isn't taken. Only `#` that start a line are looked at, the rest of
+        /// branch isn't lexed. Nested conditionals are skipped as a whole
+        /// @param p position in the line of directive that opened the branch, moved past the closing directive
+        /// @return `else` or `endif` that closes the branch
+        static error::errable<std::string_view> skip_branch(const char*& p, const char* end) {
+            const char* region = p;
+            size_t depth = 0;
+            while (true) {
+                const char* hash = static_cast<const char*>(std::memchr(p, '#', end - p));
+                if (hash == nullptr) {
+                    p = end;
+                    return {"expected #endif before EOF", {}};
                 }
-                std::string l;
-                do {
-                    ss >> l;
-                    if (l == "#endif") break;
-                } while (!ss.eof());
-                if (l != "#endif") return {"expected #endif before EOF: ", {}};
-                return {"", {}};
+                p = hash + 1;
+                const char* line = hash;
+                while (line > region && (line[-1] == ' ' || line[-1] == '\t' || line[-1] == '\r')) --line;
+                if (line == region || line[-1] != '\n') continue;
+
+                const std::string_view name = directive_name(p, end);
+                if (name == "if" || name == "ifdef" || name == "ifndef") depth++;
+                else if (name == "endif" && depth > 0) depth--;
+                else if ((name == "endif" || name == "else") && depth == 0) return {"", name};
+            }
+        }
+
+        /// Evaluates `#if` condition: number, macro defined as number, `defined X` or `defined(X)`,
+        /// any of them may be negated by `!`
+        /// @param p position after `if`, moved to the end of line
+        error::errable<bool> eval_condition(const char*& p, const char* end) const {
+            const char* line_end = find_line_end(p, end);
+            bool negate = false;
+            p = skip_blank(p, line_end);
+            while (p < line_end && *p == '!') {
+                negate = !negate;
+                p = skip_blank(p + 1, line_end);
             }
-            if (macro == "ifndef") {
-                std::string def {};
-                ss >> def;
-                if (!defined.contains(def)) {
-                    //scroll until endif
-                    std::stringstream tr {};
-                    std::string l;
-                    do {
-                        ss >> l;
-                        if (l == "#endif") break;
-                        tr << l << ' ';
-                    } while (!ss.eof());
-                    if (l != "#endif") return {"expected #endif before EOF: ", {}};
-                    return tokenize(tr);
+            auto number = [](std::string_view text, bool& value) {
+                i64 n = 0;
+                const auto r = std::from_chars(text.data(), text.data() + text.size(), n);
+                value = n != 0;
+                return r.ec == std::errc {} && r.ptr != text.data();
+            };
+
+            bool value;
+            if (p < line_end && lexic::is(*p, lexic::CC_DIGIT)) {
+                const char* start = p;
+                p = lexic::scalar::number_end(p, line_end);
+                if (!number({start, size_t(p - start)}, value)) return {"#if expected number", false};
+            } else if (p < line_end && lexic::is(*p, lexic::CC_IDENT_START)) {
+                const char* start = p;
+                p = lexic::scalar::ident_end(p, line_end);
+                std::string_view word {start, size_t(p - start)};
+                if (word == "defined") {
+                    p = skip_blank(p, line_end);
+                    const bool bracket = p < line_end && *p == '(';
+                    if (bracket) p = skip_blank(p + 1, line_end);
+                    start = p;
+                    p = lexic::scalar::ident_end(p, line_end);
+                    if (p == start) return {"defined expected macro name", false};
+                    value = defined.contains(interner::global().find({start, size_t(p - start)}));
+                    p = skip_blank(p, line_end);
+                    if (bracket && (p == line_end || *p++ != ')')) return {"expected ) after defined(", false};
+                } else {
+                    //undefined macro is 0
+                    auto it = defined.find(interner::global().find(word));
+                    value = false;
+                    if (it != defined.end() && (it->second->function_like || !number(it->second->text, value))) {
+                        return {"#if expected macro with numeric value: " + std::string {word}, false};
+                    }
                 }
-                std::string l;
-                do {
-                    ss >> l;
-                    if (l == "#endif") break;
-                } while (!ss.eof());
-                if (l != "#endif") return {"expected #endif before EOF: ", {}};
-                return {"", {}};
+            } else return {"#if expected condition", false};
+
+            p = skip_space_and_comments(p, line_end);
+            if (p != line_end) return {"Unexpected " + std::string {p, line_end} + " after #if condition", false};
+            return {"", value != negate};
+        }
+
+        void define(symbol name, const macro* m) {
+            defined[name] = m;
+            define_log.emplace_back(name, m);
+            defines_state = ++last_defines_state;
+        }
+
+        /// Detects include guard: the whole file is `#ifndef X` `#define X` ... `#endif`, with only comments around
+        /// @return `X` or NO_SYMBOL if file isn't guarded
+        symbol include_guard(const char* p, const char* end) {
+            p = skip_space_and_comments(p, end);
+            if (p == end || *p++ != '#' || read_word(p, end) != "ifndef") return NO_SYMBOL;
+            const std::string_view guard = read_word(p, end);
+            p = skip_space_and_comments(p, end);
+            if (p == end || *p++ != '#' || read_word(p, end) != "define" || read_word(p, end) != guard) {
+                return NO_SYMBOL;
             }
-            return {{"No such macro: " + macro}, {}};
+            auto closing = skip_branch(p, end);
+            if (!closing || closing.value != "endif" || skip_space_and_comments(p, end) != end) return NO_SYMBOL;
+            return symbols.intern(guard);
         }
 
-        static bool is_identifier_char(char c) { return c == '_' || c == '-' || std::isalpha(c) || std::isdigit(c); }
+        /// @return path with symlinks and `..` resolved, so every file has just one
+        static std::string canonical(const std::string& filename) {
+            std::error_code ec;
+            auto path = std::filesystem::weakly_canonical(filename, ec);
+            return ec ? filename : path.string();
+        }
 
-        static void add_token(std::vector<token>& tr, std::stringstream& tmp, token::type t) {
-            if (t != token::NONE) tr.emplace_back(t, tmp.str());
-            tmp.str(std::string {});
+        /// Looks up included file relative to the including file first, then relative to working directory
+        /// @return canonical path or empty string if there's no such file
+        std::string resolve_include(const std::string& name) const {
+            std::error_code ec;
+            if (!file_dirs.empty()) {
+                auto path = std::filesystem::canonical(file_dirs.back() / name, ec);
+                if (!ec) return path.string();
+            }
+            auto path = std::filesystem::canonical(name, ec);
+            return ec ? std::string {} : path.string();
         }
 
-        error::errable<std::vector<token>> tokenize(std::stringstream& f) {
-            std::vector<token> tokens;
+        /// Scans file, keeping it active, so files it includes can't include it back
+        template<typename sink>
+        error::errable<void> scan_file(const source_buffer& buffer, const std::string& path, sink& tokens) {
+            active_files.insert(path);
+            file_dirs.emplace_back(std::filesystem::path {path}.parent_path());
+            auto r = scan(buffer.begin(), buffer.end(), tokens);
+            file_dirs.pop_back();
+            active_files.erase(path);
+            return r;
+        }
 
-            char c;
-            std::stringstream tmp {};
-            while (!f.eof()) {
-                f.get(c);
-                if (f.eof()) break;
-                if (c == ' ' || c == '\n' || c == '\t') { continue; }
-                if (c == '/' && f.peek() == '/') {
-                    //we're in comment, skip line
-                    do { f.get(c); } while (c != '\n' && !f.eof());
-                    continue;
+        /// Appends token that doesn't need expansion. Sink is plain while macro body is lexed
+        template<typename sink>
+        static void forward(sink& tokens, const token_view& t) {
+            if constexpr (requires { tokens.emplace_expanded(t); }) tokens.emplace_expanded(t);
+            else tokens.emplace_back(t.t, t.data, t.sym, t.flags);
+        }
+
+        /// Processes `#include "file"`. Every file is mapped and tokenized once per tokenizer: guarded file is
+        /// skipped once its guard is defined, other files reuse their tokens while the same macros are defined
+        /// @param p position after `include`, moved past file name
+        template<typename sink>
+        error::errable<void> process_include(const char*& p, const char* end, sink& tokens) {
+            p = skip_blank(p, end);
+            if (p == end || *p != '"') return {"#include expected file name in quotes"};
+            const char* name_start = ++p;
+            while (p < end && *p != '"' && *p != '\n') ++p;
+            if (p == end || *p != '"') return {"expected closing quote of #include file name"};
+            const std::string name {name_start, p};
+            ++p;
+
+            const std::string path = resolve_include(name);
+            if (path.empty()) return {"Cannot find included file: " + name};
+            if (active_files.contains(path)) return {"Include cycle: " + path + " includes itself"};
+
+            const source_buffer* buffer;
+            if (auto it = included.find(path); it != included.end()) {
+                const auto& file = it->second;
+                if (file.guard != NO_SYMBOL && defined.contains(file.guard)) return {""};
+                if (file.state_before == defines_state) {
+                    for (const auto& t : file.tokens) forward(tokens, t);
+                    for (size_t d = file.defines_begin; d < file.defines_end; d++) {
+                        define(define_log[d].first, define_log[d].second);
+                    }
+                    //the same defines made in the same state lead to the same state
+                    defines_state = file.state_after;
+                    return {""};
                 }
-                if (c == '#') {
-                    auto r = process_macro(f);
-                    if (!r) return {r.error, tokens};
-                    tokens.insert(tokens.end(), r.value.cbegin(), r.value.cend());
-                    continue;
+                buffer = file.buffer;
+            } else {
+                auto& mapped = sources.emplace_back();
+                auto m = mapped.map(path);
+                if (!m) return m;
+                buffer = &mapped;
+            }
+
+            included_file file {buffer, {}, defines_state, 0, define_log.size(), 0, NO_SYMBOL};
+            auto r = scan_file(*buffer, path, file.tokens);
+            if (!r) return {"In file included from " + path + ":\n" + r.error};
+            file.state_after = defines_state;
+            file.defines_end = define_log.size();
+            file.guard = include_guard(buffer->begin(), buffer->end());
+            for (const auto& t : file.tokens) forward(tokens, t);
+            included[path] = std::move(file);
+            return {""};
+        }
+
+        /// Processes macro right after `#`
+        /// @param p position after `#`, moved past macro
+        template<typename sink>
+        error::errable<void> process_macro(const char*& p, const char* end, sink& tokens) {
+            std::string_view macro = directive_name(p, end);
+            if (macro == "define") {
+                p = skip_blank(p, end);
+                if (p == end || !lexic::is(*p, lexic::CC_IDENT_START))
+                    return {"#define expected identifier as first argument"};
+                const char* def_start = p;
+                p = lexic::scalar::ident_end(p, end);
+                const symbol def = symbols.intern({def_start, size_t(p - def_start)});
+                const char* line_end = find_line_end(p, end);
+                auto& m = macros.emplace_back();
+                const char* text_start = p;
+                if (p < line_end && *p == '(') {
+                    //function-like macro, `(` right after the name
+                    m.function_like = true;
+                    p = skip_blank(p + 1, line_end);
+                    while (p < line_end && *p != ')') {
+                        if (!lexic::is(*p, lexic::CC_IDENT_START)) return {"#define expected parameter name"};
+                        const char* param = p;
+                        p = lexic::scalar::ident_end(p, line_end);
+                        m.params.push_back(symbols.intern({param, size_t(p - param)}));
+                        p = skip_blank(p, line_end);
+                        if (p < line_end && *p == ',') p = skip_blank(p + 1, line_end);
+                        else if (p == line_end || *p != ')') return {"#define expected , or ) in parameters list"};
+                    }
+                    if (p == line_end) return {"#define expected ) at the end of parameters list"};
+                    ++p;
+                } else if (p < line_end && *p != ' ' && *p != '\t' && *p != '\r') {
+                    return {"Expected end of line or space at the end of identifier"};
                 }
-                if (c == '(') {
-                    tokens.emplace_back(token::L_BRACKET, "(");
-                    continue;
+                const char* body_start = skip_blank(p, line_end);
+                const char* body_end = line_end;
+                while (body_end > body_start && is_space(body_end[-1])) --body_end;
+                if (!m.function_like) text_start = body_start;
+                m.text = {text_start, size_t(body_end - text_start)};
+                p = line_end;
+                if (std::memchr(body_start, '#', body_end - body_start)) return {"# isn't supported in macro body"};
+                //body is lexed as it is, macros in it are expanded on every use
+                auto body = scan<lexic::simd_level::SCALAR>(body_start, body_end, m.body);
+                if (!body) return body;
+                define(def, &m);
+                return {""};
+            }
+            if (macro == "include") return process_include(p, end, tokens);
+            if (macro == "ifdef" || macro == "ifndef" || macro == "if") {
+                bool taken;
+                if (macro == "if") {
+                    auto condition = eval_condition(p, end);
+                    if (!condition) return {condition.error};
+                    taken = condition.value;
+                } else {
+                    std::string_view def = read_word(p, end);
+                    taken = defined.contains(interner::global().find(def)) == (macro == "ifdef");
                 }
-                if (c == ')') {
-                    tokens.emplace_back(token::R_BRACKET, ")");
-                    continue;
+                //taken branch is lexed in place by the main loop, the other one is only searched for its end
+                if (taken) {
+                    conditionals.push_back({false});
+                    return {""};
                 }
-                if (c == '[') {
-                    tokens.emplace_back(token::L_SQ_BRACKET, "[");
-                    continue;
+                auto closing = skip_branch(p, end);
+                if (!closing) return {closing.error};
+                if (closing.value == "else") conditionals.push_back({true});
+                return {""};
+            }
+            if (macro == "else" || macro == "endif") {
+                if (conditionals.size() == conditionals_base) return {"#" + std::string {macro} + " without #if"};
+                if (macro == "else") {
+                    if (conditionals.back().has_else) return {"#else after #else"};
+                    //branch before #else was taken, so the rest is skipped
+                    auto closing = skip_branch(p, end);
+                    if (!closing) return {closing.error};
+                    if (closing.value == "else") return {"#else after #else"};
                 }
-                if (c == ']') {
-                    tokens.emplace_back(token::R_SQ_BRACKET, "]");
+                conditionals.pop_back();
+                return {""};
+            }
+            return {"No such macro: " + std::string {macro}};
+        }
+
+        /// Scans contiguous buffer, appending tokens that reference it
+        /// @param tokens anything with `emplace_back(token::type, std::string_view[, symbol[, flags]])`,
+        /// std::vector<token_view> or token_stream_writer
+        template<typename sink>
+        error::errable<void> scan(const char* p, const char* end, sink& tokens) {
+            const size_t outer_base = conditionals_base;
+            conditionals_base = conditionals.size();
+            macro_expander<sink> expander {defined, tokens};
+            error::errable<void> r {""};
+            //dispatch once per buffer so run scanners can be inlined into the loop
+            switch (simd) {
+                #ifdef ERAXC_SIMD_X86
+                case lexic::simd_level::AVX2: r = scan_avx2(p, end, expander); break;
+                case lexic::simd_level::SSE2: r = scan<lexic::simd_level::SSE2>(p, end, expander); break;
+                #endif
+                default: r = scan<lexic::simd_level::SCALAR>(p, end, expander);
+            }
+            if (r) r = expander.finish();
+            if (r && conditionals.size() != conditionals_base) r = {"expected #endif before EOF"};
+            conditionals.resize(conditionals_base);
+            conditionals_base = outer_base;
+            return r;
+        }
+
+        #ifdef ERAXC_SIMD_X86
+        //whole loop is compiled for avx2, otherwise avx2 kernels can't be inlined into it
+        template<typename sink>
+        ERAXC_TARGET_AVX2 error::errable<void> scan_avx2(const char* p, const char* end, sink& tokens) {
+            return scan<lexic::simd_level::AVX2>(p, end, tokens);
+        }
+        #endif
+
+        template<lexic::simd_level level, typename sink>
+        ERAXC_ALWAYS_INLINE error::errable<void> scan(const char* p, const char* end, sink& tokens) {
+            using kernels = lexic::scan_kernels<level>;
+            while (p < end) {
+                const char c = *p;
+                const unsigned char cls = lexic::char_table[static_cast<unsigned char>(c)];
+                if (cls & lexic::CC_SPACE) {
+                    p = kernels::skip_space(p + 1, end);
                     continue;
                 }
-                if (c == '{') {
-                    tokens.emplace_back(token::L_F_BRACKET, "{");
+                if (c == '/' && p + 1 < end && p[1] == '/') {
+                    //we're in comment, skip line
+                    p = kernels::line_end(p, end);
                     continue;
                 }
-                if (c == '}') {
-                    tokens.emplace_back(token::R_F_BRACKET, "}");
+                if (c == '#') {
+                    ++p;
+                    auto r = process_macro(p, end, tokens);
+                    if (!r) return r;
                     continue;
                 }
-                if (c == ';') {
-                    tokens.emplace_back(token::SEMICOLON, ";");
+
+                if (cls & lexic::CC_PUNCT) {
+                    tokens.emplace_back(token::punctuation[static_cast<unsigned char>(c)], std::string_view {p, 1});
+                    ++p;
                     continue;
                 }
-                if (c == ':') {
-                    tokens.emplace_back(token::COLON, ":");
+
+                const char* start = p;
+                if (cls & lexic::CC_OPERATOR) {
+                    p = lexic::operators_dfa.match(p, end);
+                    tokens.emplace_back(token::OPERATOR, std::string_view {start, size_t(p - start)});
                     continue;
                 }
-                if (c == '.') {
-                    tokens.emplace_back(token::DOT, ".");
+                if (cls & lexic::CC_DIGIT) {
+                    p = kernels::number_end(p + 1, end);
+                    tokens.emplace_back(token::INSTANT, std::string_view {start, size_t(p - start)});
                     continue;
                 }
-                if (c == ',') {
-                    tokens.emplace_back(token::COMMA, ",");
+                if (cls & lexic::CC_IDENT_START) {
+                    p = kernels::ident_end(p + 1, end);
+                    std::string_view word {start, size_t(p - start)};
+                    tokens.emplace_back(token::IDENTIFIER, word, symbols.intern(word));
                     continue;
                 }
                 if (c == '"') {
-                    while (!f.eof()) {
-                        f.get(c);
-                        if (c == '\n') break;
-                        if (c == '"') {
-                            add_token(tokens, tmp, token::STRING_INSTANT);
-                            break;
-                        }
-                        tmp << c;
+                    ++start;
+                    ++p;
+                    while (p < end && *p != '"' && *p != '\n') ++p;
+                    if (p == end) return {R"(expected end of string instant (""") before EOF)"};
+                    if (*p == '"') {
+                        tokens.emplace_back(token::STRING_INSTANT, std::string_view {start, size_t(p - start)});
                     }
-                    if (f.eof()) return {R"(expected end of string instant (""") before EOF)", tokens};
+                    ++p;
                     continue;
                 }
-                if (token::operator_chars.contains(c)) {
-                    //is an operator
-                    tmp << c;
-                    while (token::operator_chars.contains(char(f.peek())) && !f.eof()) { tmp << char(f.get()); }
-                    add_token(tokens, tmp, token::OPERATOR);
-                    continue;
-                }
-                if (std::isdigit(c)) {
-                    tmp << c;
-                    while ((std::isdigit(f.peek()) || token::instant_number_chars.contains(f.peek())) && !f.eof()) {
-                        tmp << char(f.get());
+                //unknown symbol, skip it
+                ++p;
+            }
+            return {""};
+        }
+
+        /// Tokenizes buffer without copying any of token data
+        error::errable<std::vector<token_view>> tokenize_view(const source_buffer& buffer) {
+            std::vector<token_view> tokens;
+            //rough guess to avoid most of reallocations
+            tokens.reserve(buffer.size() / 4);
+            auto r = scan(buffer.begin(), buffer.end(), tokens);
+            return {r.error, tokens};
+        }
+
+        /// Memory-maps file and tokenizes it. Tokens are valid while this tokenizer is alive
+        error::errable<std::vector<token_view>> tokenize_file_view(const std::string& filename) {
+            auto& buffer = sources.emplace_back();
+            auto m = buffer.map(filename);
+            if (!m) return {m.error, {}};
+            std::vector<token_view> tokens;
+            tokens.reserve(buffer.size() / 4);
+            auto r = scan_file(buffer, canonical(filename), tokens);
+            return {r.error, tokens};
+        }
+
+        /// Packs token, interning its text and finding the source it points into
+        token pack(const token_view& v) {
+            const char* p = v.data.data();
+            auto in = [p](const source_buffer& b) {
+                return std::less_equal<> {}(b.begin(), p) && std::less_equal<> {}(p, b.end());
+            };
+            //tokens mostly come from the same buffer in a row
+            if (last_source >= sources.size() || !in(sources[last_source])) {
+                last_source = token::NO_SOURCE;
+                for (size_t s = 0; s < sources.size() && s < token::NO_SOURCE; s++) {
+                    if (in(sources[s])) {
+                        last_source = s;
+                        break;
                     }
-                    add_token(tokens, tmp, token::INSTANT);
-                    continue;
-                }
-                if (std::isalpha(c) || c == '_') {
-                    tmp << c;
-                    while (is_identifier_char(f.peek()) && !f.eof()) { tmp << char(f.get()); }
-                    if (defined.contains(tmp.str()) && !defined.at(tmp.str()).empty()) tmp.str(defined.at(tmp.str()));
-                    add_token(tokens, tmp, token::IDENTIFIER);
-                    continue;
                 }
-                tmp << c;
             }
+            const symbol sym = v.sym != NO_SYMBOL ? v.sym : symbols.intern(v.data);
+            if (last_source == token::NO_SOURCE) return {v.t, sym, token::NO_SOURCE, 0, v.flags};
+            return {v.t, sym, u16(last_source), u32(p - sources[last_source].begin()), v.flags};
+        }
 
+        std::vector<token> to_tokens(const std::vector<token_view>& views) {
+            std::vector<token> tokens;
+            tokens.reserve(views.size());
+            for (const auto& v : views) tokens.push_back(pack(v));
+            return tokens;
+        }
+
+        struct source_location {
+            std::string file;
+            //both counted from 1, 0 if position is unknown
+            u32 line;
+            u32 column;
+        };
 
-            return {"", tokens};
+        /// Position of token for diagnostics
+        /// @param after position right after the token text instead of its start, to end a source range with
+        source_location position(const token& t, bool after = false) const {
+            if (t.source >= sources.size()) return {"<unknown>", 0, 0};
+            const auto& buffer = sources[t.source];
+            const u32 offset = t.offset + (after ? u32(interner::global().text(t.sym).size()) : 0);
+            const auto [line, column] = buffer.position_of(offset);
+            return {buffer.name().empty() ? "<input>" : buffer.name(), line, column};
         }
 
+        /// Position of token for diagnostics, `file:line:column`
+        std::string location(const token& t) const {
+            if (t.source >= sources.size()) return "<unknown>";
+            const auto [file, line, column] = position(t);
+            return file + ':' + std::to_string(line) + ':' + std::to_string(column);
+        }
+
+        error::errable<std::vector<token>> tokenize(std::stringstream& f) {
+            auto& buffer = sources.emplace_back(std::string {std::istreambuf_iterator<char> {f}, {}});
+            auto r = tokenize_view(buffer);
+            return {r.error, to_tokens(r.value)};
+        }
 
         error::errable<std::vector<token>> tokenize_file(const std::string& filename) {
-            std::ifstream f {filename};
-            if (!f) return {"Cannot open file: " + filename, {}};
-            std::stringstream ss;
-            ss << f.rdbuf();
-            return tokenize(ss);
+            auto r = tokenize_file_view(filename);
+            return {r.error, to_tokens(r.value)};
         }
     };
 }
@@ -0,0 +1,240 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <bit>
+
+#include "char_table.h"
+
+#ifdef _MSC_VER
+    #define ERAXC_ALWAYS_INLINE __forceinline
+#else
+    #define ERAXC_ALWAYS_INLINE [[gnu::always_inline]] inline
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define ERAXC_SIMD_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define ERAXC_TARGET_AVX2
+    #else
+        #define ERAXC_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace eraxc::lexic {
+
+    enum class simd_level { SCALAR, SSE2, AVX2 };
+
+    namespace scalar {
+        template<char_class cc, bool in_class>
+        inline const char* run_end(const char* p, const char* end) {
+            while (p < end && is(*p, cc) == in_class) ++p;
+            return p;
+        }
+
+        inline const char* skip_space(const char* p, const char* end) { return run_end<CC_SPACE, true>(p, end); }
+        inline const char* ident_end(const char* p, const char* end) { return run_end<CC_IDENT, true>(p, end); }
+        inline const char* number_end(const char* p, const char* end) { return run_end<CC_NUMBER, true>(p, end); }
+        inline const char* line_end(const char* p, const char* end) {
+            while (p < end && *p != '\n') ++p;
+            return p;
+        }
+    }
+
+#ifdef ERAXC_SIMD_X86
+    /// Kernels build a mask of chars in class, so the first unset bit (or set one for `in_class == false`) ends the run
+    namespace sse2 {
+        inline __m128i in_range(__m128i v, char lo, char hi) {
+            //chars >= 0x80 are negative and never fall into ascii ranges
+            return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(char(lo - 1))),
+                                 _mm_cmpgt_epi8(_mm_set1_epi8(char(hi + 1)), v));
+        }
+
+        inline __m128i eq(__m128i v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+
+        inline __m128i space(__m128i v) {
+            return _mm_or_si128(_mm_or_si128(eq(v, ' '), eq(v, '\t')), _mm_or_si128(eq(v, '\n'), eq(v, '\r')));
+        }
+
+        inline __m128i ident(__m128i v) {
+            //`c | 0x20` folds upper case letters into lower case ones and maps nothing else into a..z
+            __m128i letter = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+            return _mm_or_si128(_mm_or_si128(letter, in_range(v, '0', '9')), _mm_or_si128(eq(v, '_'), eq(v, '-')));
+        }
+
+        inline __m128i number(__m128i v) {
+            return _mm_or_si128(_mm_or_si128(in_range(v, '0', '9'), eq(v, 'u')), _mm_or_si128(eq(v, 'l'), eq(v, 'i')));
+        }
+
+        template<__m128i (*matches)(__m128i), bool in_class, const char* (*tail)(const char*, const char*)>
+        inline const char* run_end(const char* p, const char* end) {
+            while (end - p >= 16) {
+                __m128i m = matches(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+                unsigned mask = unsigned(_mm_movemask_epi8(m));
+                if constexpr (in_class) mask = ~mask & 0xFFFFu;
+                if (mask != 0) return p + std::countr_zero(mask);
+                p += 16;
+            }
+            return tail(p, end);
+        }
+
+        inline __m128i newline(__m128i v) { return eq(v, '\n'); }
+
+        inline const char* skip_space(const char* p, const char* end) {
+            return run_end<space, true, scalar::skip_space>(p, end);
+        }
+        inline const char* ident_end(const char* p, const char* end) {
+            return run_end<ident, true, scalar::ident_end>(p, end);
+        }
+        inline const char* number_end(const char* p, const char* end) {
+            return run_end<number, true, scalar::number_end>(p, end);
+        }
+        inline const char* line_end(const char* p, const char* end) {
+            return run_end<newline, false, scalar::line_end>(p, end);
+        }
+    }
+
+    namespace avx2 {
+        ERAXC_TARGET_AVX2 inline __m256i in_range(__m256i v, char lo, char hi) {
+            return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(char(lo - 1))),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(char(hi + 1)), v));
+        }
+
+        ERAXC_TARGET_AVX2 inline __m256i eq(__m256i v, char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+
+        ERAXC_TARGET_AVX2 inline __m256i space(__m256i v) {
+            return _mm256_or_si256(_mm256_or_si256(eq(v, ' '), eq(v, '\t')), _mm256_or_si256(eq(v, '\n'), eq(v, '\r')));
+        }
+
+        ERAXC_TARGET_AVX2 inline __m256i ident(__m256i v) {
+            __m256i letter = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+            return _mm256_or_si256(_mm256_or_si256(letter, in_range(v, '0', '9')),
+                                   _mm256_or_si256(eq(v, '_'), eq(v, '-')));
+        }
+
+        ERAXC_TARGET_AVX2 inline __m256i number(__m256i v) {
+            return _mm256_or_si256(_mm256_or_si256(in_range(v, '0', '9'), eq(v, 'u')),
+                                   _mm256_or_si256(eq(v, 'l'), eq(v, 'i')));
+        }
+
+        ERAXC_TARGET_AVX2 inline __m256i newline(__m256i v) { return eq(v, '\n'); }
+
+        template<__m256i (*matches)(__m256i), bool in_class, const char* (*tail)(const char*, const char*)>
+        ERAXC_TARGET_AVX2 inline const char* run_end(const char* p, const char* end) {
+            while (end - p >= 32) {
+                __m256i m = matches(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+                unsigned mask = unsigned(_mm256_movemask_epi8(m));
+                if constexpr (in_class) mask = ~mask;
+                if (mask != 0) return p + std::countr_zero(mask);
+                p += 32;
+            }
+            return tail(p, end);
+        }
+
+        ERAXC_TARGET_AVX2 inline const char* skip_space(const char* p, const char* end) {
+            return run_end<space, true, sse2::skip_space>(p, end);
+        }
+        ERAXC_TARGET_AVX2 inline const char* ident_end(const char* p, const char* end) {
+            return run_end<ident, true, sse2::ident_end>(p, end);
+        }
+        ERAXC_TARGET_AVX2 inline const char* number_end(const char* p, const char* end) {
+            return run_end<number, true, sse2::number_end>(p, end);
+        }
+        ERAXC_TARGET_AVX2 inline const char* line_end(const char* p, const char* end) {
+            return run_end<newline, false, sse2::line_end>(p, end);
+        }
+    }
+#endif
+
+    /// Run scanners used by the tokenizer. Every function returns pointer to first char that doesn't belong to run,
+    /// or end if whole [p, end) does:
+    /// skip_space - first char that is not whitespace; line_end - first '\n';
+    /// ident_end - first char that can't continue identifier; number_end - same for number instant
+    template<simd_level l>
+    struct scan_kernels;
+
+    template<>
+    struct scan_kernels<simd_level::SCALAR> {
+        static const char* skip_space(const char* p, const char* end) { return scalar::skip_space(p, end); }
+        static const char* line_end(const char* p, const char* end) { return scalar::line_end(p, end); }
+        static const char* ident_end(const char* p, const char* end) { return scalar::ident_end(p, end); }
+        static const char* number_end(const char* p, const char* end) { return scalar::number_end(p, end); }
+    };
+
+#ifdef ERAXC_SIMD_X86
+    /// Most of runs are a few chars long, so first chars are checked one by one and only long runs go wide
+    template<char_class cc, const char* (*wide)(const char*, const char*)>
+    inline const char* short_run_first(const char* p, const char* end) {
+        constexpr long SCALAR_PREFIX = 8;
+        const char* scalar_end = end - p > SCALAR_PREFIX ? p + SCALAR_PREFIX : end;
+        for (; p < scalar_end; ++p) {
+            if (!is(*p, cc)) return p;
+        }
+        return wide(p, end);
+    }
+
+    template<>
+    struct scan_kernels<simd_level::SSE2> {
+        static const char* skip_space(const char* p, const char* end) {
+            return short_run_first<CC_SPACE, sse2::skip_space>(p, end);
+        }
+        static const char* line_end(const char* p, const char* end) { return sse2::line_end(p, end); }
+        static const char* ident_end(const char* p, const char* end) {
+            return short_run_first<CC_IDENT, sse2::ident_end>(p, end);
+        }
+        static const char* number_end(const char* p, const char* end) {
+            return short_run_first<CC_NUMBER, sse2::number_end>(p, end);
+        }
+    };
+
+    template<>
+    struct scan_kernels<simd_level::AVX2> {
+        ERAXC_TARGET_AVX2 static const char* skip_space(const char* p, const char* end) {
+            return short_run_first<CC_SPACE, avx2::skip_space>(p, end);
+        }
+        ERAXC_TARGET_AVX2 static const char* line_end(const char* p, const char* end) {
+            return avx2::line_end(p, end);
+        }
+        ERAXC_TARGET_AVX2 static const char* ident_end(const char* p, const char* end) {
+            return short_run_first<CC_IDENT, avx2::ident_end>(p, end);
+        }
+        ERAXC_TARGET_AVX2 static const char* number_end(const char* p, const char* end) {
+            return short_run_first<CC_NUMBER, avx2::number_end>(p, end);
+        }
+    };
+#endif
+
+    /// Detects best instruction set supported by the cpu. Evaluated once
+    inline simd_level detect_simd_level() {
+        static const simd_level level = [] {
+#ifdef ERAXC_SIMD_X86
+    #ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] >= 7) {
+                __cpuid(info, 1);
+                const bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+                __cpuidex(info, 7, 0);
+                if (os_saves_ymm && (info[1] & (1 << 5))) return simd_level::AVX2;
+            }
+    #else
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return simd_level::AVX2;
+    #endif
+            //SSE2 is part of x86-64 baseline
+            return simd_level::SSE2;
+#else
+            return simd_level::SCALAR;
+#endif
+        }();
+        return level;
+    }
+
+    /// @return requested level if cpu supports it, the best supported one below it otherwise
+    inline simd_level supported_simd_level(simd_level level) {
+        return level > detect_simd_level() ? detect_simd_level() : level;
+    }
+}
+
+#endif  //SIMD_SCAN_H
@@ -0,0 +1,159 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../../util/common.h"
+#include "../../util/error.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace eraxc {
+
+    /// Contiguous read-only source text. Files are memory-mapped, in-memory sources are owned copies.
+    /// Tokens produced from the buffer reference its memory, so it is neither copyable nor movable.
+    class source_buffer {
+        const char* data = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+        std::string owned {};
+        std::string path {};
+        //offsets of line starts, built on first position_of()
+        mutable std::vector<u32> line_starts {};
+
+        #ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+        #endif
+
+        void unmap() {
+            if (!mapped) return;
+            #ifdef _WIN32
+            UnmapViewOfFile(data);
+            CloseHandle(mapping);
+            CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+            #else
+            munmap(const_cast<char*>(data), length);
+            #endif
+            mapped = false;
+        }
+
+    public:
+        source_buffer() = default;
+        explicit source_buffer(std::string text) : owned(std::move(text)) {
+            data = owned.data();
+            length = owned.size();
+        }
+
+        source_buffer(const source_buffer&) = delete;
+        source_buffer& operator=(const source_buffer&) = delete;
+
+        ~source_buffer() { unmap(); }
+
+        /// Maps file into memory
+        /// @param filename file to map
+        /// @return error if file cannot be opened or mapped
+        error::errable<void> map(const std::string& filename) {
+            unmap();
+            path = filename;
+            line_starts.clear();
+            #ifdef _WIN32
+            file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return {"Cannot open file: " + filename};
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size)) {
+                CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+                return {"Cannot get size of file: " + filename};
+            }
+            length = size.QuadPart;
+            if (length == 0) {
+                CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+                data = "";
+                return {""};
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) {
+                CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+                return {"Cannot map file: " + filename};
+            }
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (data == nullptr) {
+                CloseHandle(mapping);
+                CloseHandle(file);
+                mapping = nullptr;
+                file = INVALID_HANDLE_VALUE;
+                return {"Cannot map file: " + filename};
+            }
+            #else
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) return {"Cannot open file: " + filename};
+            struct stat st {};
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return {"Cannot get size of file: " + filename};
+            }
+            length = st.st_size;
+            if (length == 0) {
+                close(fd);
+                data = "";
+                return {""};
+            }
+            void* m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);  //mapping keeps its own reference
+            if (m == MAP_FAILED) return {"Cannot map file: " + filename};
+            madvise(m, length, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(m);
+            #endif
+            mapped = true;
+            return {""};
+        }
+
+        std::string_view view() const { return {data, length}; }
+        const char* begin() const { return data; }
+        const char* end() const { return data + length; }
+        size_t size() const { return length; }
+
+        /// File the buffer was mapped from, empty for in-memory sources
+        const std::string& name() const { return path; }
+
+        struct position {
+            u32 line;
+            u32 column;
+        };
+
+        /// Line and column of offset in buffer, both counted from 1. Line table is built on the first call,
+        /// so it costs nothing unless a diagnostic is reported. Not thread-safe
+        position position_of(u32 offset) const {
+            if (line_starts.empty()) {
+                line_starts.push_back(0);
+                for (const char* p = data; p < end(); ++p) {
+                    p = static_cast<const char*>(std::memchr(p, '\n', end() - p));
+                    if (p == nullptr) break;
+                    line_starts.push_back(u32(p + 1 - data));
+                }
+            }
+            const auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+            return {u32(line), offset - line_starts[line - 1] + 1};
+        }
+    };
+}
+
+#endif  //SOURCE_BUFFER_H
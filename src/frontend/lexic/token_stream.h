@@ -0,0 +1,190 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "preprocessor_tokenizer.h"
+
+namespace eraxc {
+
+    /// Tokens source for parser with bounded lookahead.
+    /// Either wraps already materialized token vector, or is a ring buffer filled by lexer running on another thread,
+    /// so memory stays O(capacity) instead of O(file). Indices are absolute positions in token stream.
+    /// Parser may look up to LOOKBEHIND tokens back from the furthest token it requested and any number of tokens ahead
+    /// (blocking until lexer produces them). Reading past the end yields NONE token
+    class token_stream {
+        const std::vector<token>* materialized = nullptr;
+
+        std::vector<token> ring {};
+        size_t mask = 0;
+
+        std::mutex mutex {};
+        std::condition_variable cv {};
+        //guarded by mutex
+        size_t produced = 0;
+        size_t released = 0;
+        bool closed = false;
+        bool abandoned = false;
+        std::string lexer_error {};
+
+        //consumer side copies, touched only by parser thread
+        size_t visible = 0;
+        size_t furthest = 0;
+        size_t released_local = 0;
+
+        static inline const token eof {};
+
+        void wait_for(size_t i) {
+            std::unique_lock lock {mutex};
+            release_locked();
+            cv.wait(lock, [&] { return produced > i || closed; });
+            visible = produced;
+        }
+
+        void release_locked() {
+            const size_t can_release = furthest > LOOKBEHIND ? furthest - LOOKBEHIND : 0;
+            if (can_release > released) {
+                released = released_local = can_release;
+                cv.notify_all();
+            }
+        }
+
+    public:
+        static constexpr size_t LOOKBEHIND = 8;
+        static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+        explicit token_stream(const std::vector<token>& tokens) : materialized(&tokens) {}
+
+        explicit token_stream(size_t capacity = DEFAULT_CAPACITY) {
+            size_t c = 64;
+            while (c < capacity) c <<= 1;
+            ring.resize(c);
+            mask = c - 1;
+        }
+
+        token_stream(const token_stream&) = delete;
+        token_stream& operator=(const token_stream&) = delete;
+
+        //consumer side
+
+        const token& operator[](size_t i) {
+            if (materialized) return i < materialized->size() ? (*materialized)[i] : eof;
+            if (i >= visible) {
+                wait_for(i);
+                if (i >= visible) return eof;
+            }
+            if (i > furthest) {
+                furthest = i;
+                //let lexer refill a quarter of the ring at once instead of waking it up on every token
+                if (furthest - released_local > ring.size() / 4) {
+                    std::lock_guard lock {mutex};
+                    release_locked();
+                }
+            }
+            return ring[i & mask];
+        }
+
+        /// @return whether token i can still be read, it may be overwritten once parser went LOOKBEHIND tokens past it
+        bool readable(size_t i) const { return materialized || i + LOOKBEHIND >= furthest; }
+
+        /// Stops lexer, called by parser when it won't read anything anymore
+        void abandon() {
+            if (materialized) return;
+            std::lock_guard lock {mutex};
+            abandoned = true;
+            cv.notify_all();
+        }
+
+        /// @return error lexer finished with. Valid after reading past the end of stream
+        std::string error() {
+            if (materialized) return {};
+            std::lock_guard lock {mutex};
+            return lexer_error;
+        }
+
+        //producer side
+
+        /// Copies tokens into stream, blocking while ring is full
+        /// @return false if parser abandoned the stream and lexing should stop
+        bool push(std::vector<token>& batch) {
+            size_t pushed = 0;
+            while (pushed < batch.size()) {
+                size_t from, space;
+                {
+                    std::unique_lock lock {mutex};
+                    cv.wait(lock, [&] { return produced - released < ring.size() || abandoned; });
+                    if (abandoned) return false;
+                    from = produced;
+                    space = std::min(ring.size() - (produced - released), batch.size() - pushed);
+                }
+                //slots [from, from + space) are not visible to parser yet, so they're filled without lock
+                for (size_t k = 0; k < space; k++) ring[(from + k) & mask] = batch[pushed + k];
+                pushed += space;
+                {
+                    std::lock_guard lock {mutex};
+                    produced += space;
+                }
+                cv.notify_all();
+            }
+            batch.clear();
+            return true;
+        }
+
+        /// Marks end of tokens
+        /// @param error lexer error if any
+        void close(const std::string& error = {}) {
+            std::lock_guard lock {mutex};
+            closed = true;
+            lexer_error = error;
+            cv.notify_all();
+        }
+    };
+
+    /// Lexer side of token_stream. Collects tokens into batches, so stream lock is taken once per batch
+    class token_stream_writer {
+        token_stream& stream;
+        tokenizer& source;
+        std::vector<token> batch {};
+        bool open = true;
+
+    public:
+        static constexpr size_t BATCH_SIZE = 256;
+
+        /// @param source tokenizer tokens are scanned by, packs them
+        token_stream_writer(token_stream& stream, tokenizer& source) : stream(stream), source(source) {
+            batch.reserve(BATCH_SIZE);
+        }
+
+        void emplace_back(token::type t, std::string_view data, symbol sym = NO_SYMBOL, unsigned char flags = 0) {
+            //parser doesn't need the rest of tokens
+            if (!open) return;
+            batch.push_back(source.pack({t, data, sym, flags}));
+            if (batch.size() == BATCH_SIZE) open = stream.push(batch);
+        }
+
+        void flush() {
+            if (open && !batch.empty()) open = stream.push(batch);
+        }
+    };
+
+    /// Tokenizes file into the stream and closes it, passing lexer error to parser. Meant to be run on its own thread
+    /// @param t tokenizer to keep file buffer and macro definitions in
+    inline void tokenize_file_to_stream(tokenizer& t, const std::string& filename, token_stream& stream) {
+        auto& buffer = t.sources.emplace_back();
+        auto m = buffer.map(filename);
+        if (!m) {
+            stream.close(m.error);
+            return;
+        }
+        token_stream_writer writer {stream, t};
+        auto r = t.scan_file(buffer, tokenizer::canonical(filename), writer);
+        writer.flush();
+        stream.close(r.error);
+    }
+}
+
+#endif  //TOKEN_STREAM_H
@@ -2,6 +2,7 @@
 #define ERAXC_ENUMS_H
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <set>
 
@@ -167,7 +168,7 @@ namespace eraxc::syntax {
         {"continue", CONTINUE}
     };
 
-    static const inline std::unordered_map<std::string, operator_type> operators{
+    static const inline std::unordered_map<std::string_view, operator_type> operators{
         {"==", EQUAL},
         {"!=", NOT_EQUAL},
         {"=", ASSIGN},
@@ -272,7 +273,7 @@ namespace eraxc::syntax {
         {BITWISE_XOR_ASSIGN, 16}
     };
 
-    const inline std::unordered_map<std::string, operator_type> prefix_operators{
+    const inline std::unordered_map<std::string_view, operator_type> prefix_operators{
         {"+", POSITIVE},
         {"-", NEGATIVE},
         {"*", INDIRECTION},
@@ -283,7 +284,7 @@ namespace eraxc::syntax {
         {"--", DECREMENT}
     };
 
-    const inline std::unordered_map<std::string, operator_type> postfix_operators{
+    const inline std::unordered_map<std::string_view, operator_type> postfix_operators{
         {"++", INCREMENT},
         {"--", DECREMENT},
     };
@@ -1,9 +1,20 @@
 #include <iostream>
 #include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
 
 #include "backend/JIR/CFG/CFG.h"
+#include "backend/JIR/module_image.h"
 #include "frontend/lexic/preprocessor_tokenizer.h"
+#include "frontend/lexic/token_stream.h"
 #include "backend/codegen/asm_x86.h"
+#include "backend/codegen/asm_parallel.h"
+#include "util/compile_cache.h"
+#include "util/jobserver.h"
+#include "util/thread_pool.h"
 
 #ifdef DEBUG
 #define TEST
@@ -12,77 +23,280 @@
 
 using namespace eraxc;
 
-error::errable<void> compilation_pipeline(const std::string& filename) {
+//every option that changes produced asm or object, part of compile cache key
+static constexpr std::string_view OUTPUT_FLAGS = "x64 win64";
+
+typedef std::vector<std::unique_ptr<JIR::module_image>> modules;
+
+/// Every error CFG found in the file, as JSON array if `json` or as text lines otherwise
+static std::string report(const tokenizer& t, const JIR::CFG& cfg, bool json) {
+    std::ostringstream os;
+    if (json) cfg.get_diagnostics().print_json(os, t);
+    else {
+        os << "Failed to translate to JIR code. Errors:\n";
+        cfg.get_diagnostics().print(os, t);
+    }
+    return os.str();
+}
+
+/// Compiles one input into `<input name>.asm` and `<input name>.obj` in working directory
+/// @param pool pool to translate functions on, shared by all inputs
+/// @param cache compile cache or nullptr if disabled
+/// @param imports modules imported before the input is parsed
+/// @param log stream to write timings to
+/// @param link whether to link object into executable and dump JIR, done only when compiling single input
+/// @param json whether CFG errors are reported as JSON
+/// @param optimization_level passes functions go through before codegen, see run_function_passes()
+error::errable<void> compilation_pipeline(const std::string& filename, thread_pool& pool, compile_cache* cache,
+                                          const modules& imports, std::ostream& log, bool link, bool json,
+                                          int optimization_level) {
     double total_time = 0;
+    const std::string name = std::filesystem::path(filename).stem().string();
 
+    //lexer fills token stream on its own thread while CFG is built from the tokens already produced,
+    //and every parsed function is translated to asm on worker pool while the rest of file is parsed.
+    //Cache key needs all the tokens before parsing, so with cache the file is lexed first
     auto t1 = std::chrono::high_resolution_clock::now();
+    parallel_asm_translator<X64> asmt {pool, optimization_level};
     tokenizer tokenizer;
-    auto tokens = tokenizer.tokenize_file(filename);
-    auto t2 = std::chrono::high_resolution_clock::now();
-    double dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
-    total_time += dur;
-    std::cout << "preprocessor_tokenizer done in: " << dur << "ms\n";
-    if (!tokens) {
-        return {"Failed to tokenize file " + filename + ". Error:\n" + tokens.error};
+    std::optional<token_stream> tokens;
+    std::thread lexer;
+    std::vector<token> lexed;
+    std::string cache_key;
+    if (cache) {
+        auto views = tokenizer.tokenize_file_view(filename);
+        if (!views) return {"Failed to tokenize file " + filename + ". Error:\n" + views.error};
+        //imported module is a part of the input, so its image is a part of the key
+        std::string flags {OUTPUT_FLAGS};
+        flags += " -O" + std::to_string(optimization_level);
+        for (const auto& module : imports) {
+            key_hasher h {};
+            h.add(module->bytes());
+            flags += ' ' + h.hex();
+        }
+        cache_key = compile_cache_key(views.value, tokenizer.defined, flags);
+        if (cache->fetch(cache_key, name)) {
+            log << "Cache hit, CFG and ASM translation skipped\n";
+            if (!std::filesystem::exists(name + ".obj")) {
+                system(("nasm -f win64 " + name + ".asm -o " + name + ".obj").c_str());
+            }
+            if (link) system(("gcc " + name + ".obj -o a.exe").c_str());
+            return {""};
+        }
+        lexed = tokenizer.to_tokens(views.value);
+        tokens.emplace(lexed);
+    } else {
+        tokens.emplace();
+        lexer = std::thread {tokenize_file_to_stream, std::ref(tokenizer), std::cref(filename), std::ref(*tokens)};
     }
 
-    t1 = std::chrono::high_resolution_clock::now();
     JIR::CFG cfg{};
-    auto JIR_err = cfg.create(tokens.value);
-    t2 = std::chrono::high_resolution_clock::now();
-    if (!JIR_err) {
-        return {"Failed to translate to JIR code. Error:\n" + JIR_err.error};
+    asmt.attach(cfg);
+    error::expected<void> JIR_err {};
+    for (const auto& module : imports) {
+        JIR_err = cfg.import_module(*module);
+        if (!JIR_err) break;
     }
-    dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    if (JIR_err) JIR_err = cfg.create(*tokens);
+    tokens->abandon();
+    if (lexer.joinable()) lexer.join();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (auto lexer_err = tokens->error(); !lexer_err.empty()) {
+        return {"Failed to tokenize file " + filename + ". Error:\n" + lexer_err};
+    }
+    if (!JIR_err) return {report(tokenizer, cfg, json)};
+    double dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
     total_time += dur;
-    std::cout << "CFG created in: " << dur << "ms\n";
+    log << "preprocessor_tokenizer and CFG done in: " << dur << "ms\n";
 
-    cfg.print_nodes();
+    if (link) cfg.print_nodes();
 
     t1 = std::chrono::high_resolution_clock::now();
-    asm_translator<X64> asmt{};
-    auto asmtr = asmt.translate(cfg, "eraxc.asm");
+    auto asmtr = asmt.write(cfg, name + ".asm");
     t2 = std::chrono::high_resolution_clock::now();
     if (!asmtr) {
-        return {"Failed to translate to ASM. Error:\n" + asmtr.error};
+        return {"Failed to translate to ASM. Error:\n" + asmtr.message()};
     }
     dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
     total_time += dur;
-    std::cout << "ASM translator done in: " << dur << "ms\n";
+    log << "ASM translator done in: " << dur << "ms\n";
+    if (optimization_level >= 1) {
+        log << "Peephole rewrites:\n";
+        asmt.peephole_hits().print(log);
+    }
 
-    std::cout << "\nTranslation completed successfully in " << total_time << "ms\n";
+    log << "\nTranslation completed successfully in " << total_time << "ms\n";
 
-    //autorun compilation to .exe
+    //autorun compilation to .obj. Object of previous compilation mustn't get into cache if nasm fails
     t1 = std::chrono::high_resolution_clock::now();
-    system("nasm -f win64 eraxc.asm -o eraxc.obj");
+    std::filesystem::remove(name + ".obj");
+    system(("nasm -f win64 " + name + ".asm -o " + name + ".obj").c_str());
     t2 = std::chrono::high_resolution_clock::now();
     dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
-    std::cout << "nasm compiler done in: " << dur<<"ms\n";
+    log << "nasm compiler done in: " << dur<<"ms\n";
     total_time += dur;
 
-    t1 = std::chrono::high_resolution_clock::now();
-    system("gcc eraxc.obj -o a.exe");
-    t2 = std::chrono::high_resolution_clock::now();
-    dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
-    std::cout << "gcc linker done in: " << dur<<"ms\n";
-    total_time += dur;
+    //every input has its own main(), so several objects are left for the build system to link
+    if (link) {
+        t1 = std::chrono::high_resolution_clock::now();
+        system(("gcc " + name + ".obj -o a.exe").c_str());
+        t2 = std::chrono::high_resolution_clock::now();
+        dur = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        log << "gcc linker done in: " << dur<<"ms\n";
+        total_time += dur;
+    }
+
+    if (cache) cache->store(cache_key, name);
+
+    log << "\nCompilation completed successfully in " << total_time << "ms\n";
+
+    return {""};
+}
+
+/// Compiles one input into module image `<input name>.jirm` other inputs can import
+/// @param optimization_level constants are propagated and dead code is eliminated from the image from level 1
+error::errable<void> module_pipeline(const std::string& filename, std::ostream& log, bool json,
+                                     int optimization_level) {
+    const std::string name = std::filesystem::path(filename).stem().string();
 
-    std::cout << "\nCompilation completed successfully in " << total_time << "ms\n";
+    auto t1 = std::chrono::high_resolution_clock::now();
+    tokenizer tokenizer;
+    auto tokens = tokenizer.tokenize_file(filename);
+    if (!tokens) return {"Failed to tokenize file " + filename + ". Error:\n" + tokens.error};
+    token_stream stream {tokens.value};
+    JIR::CFG cfg{};
+    auto JIR_err = cfg.create_module(stream);
+    if (!JIR_err) return {report(tokenizer, cfg, json)};
+    if (optimization_level >= 1) cfg.dead_code_elimination_pass();
+    auto written = JIR::write_module(cfg, name + ".jirm");
+    if (!written) return written;
+    auto t2 = std::chrono::high_resolution_clock::now();
 
+    log << "Module " << name << ".jirm written in " << std::chrono::duration<double, std::milli>(t2 - t1).count()
+        << "ms\n";
     return {""};
 }
 
+struct options {
+    size_t jobs = std::thread::hardware_concurrency();
+    std::string cache_dir {};
+    u64 cache_size_mb = 1024;
+    bool module = false;
+    bool json_diagnostics = false;
+    int optimization_level = 0;
+    std::vector<std::string> imports {};
+    std::vector<std::string> inputs {};
+};
+
+static bool is_number(const std::string& s) {
+    return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos;
+}
+
+/// Parses `eraxc [-j N] [-O0|-O1] [--cache-dir DIR [--cache-size MB]] [--module | --import FILE...]
+/// [--diagnostics text|json] inputs...`. `-O` is `-O1`
+error::errable<options> parse_options(int argc, char* argv[]) {
+    options o {};
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg.starts_with("-j")) {
+            std::string n = arg.size() > 2 ? arg.substr(2) : (a + 1 < argc ? argv[++a] : "");
+            if (!is_number(n) || std::stoul(n) == 0) {
+                return {"-j expects positive number of jobs instead of `" + n + '`', {}};
+            }
+            o.jobs = std::stoul(n);
+        } else if (arg.starts_with("-O")) {
+            std::string level = arg.size() > 2 ? arg.substr(2) : "1";
+            if (level != "0" && level != "1") {
+                return {"-O expects optimization level 0 or 1 instead of `" + level + '`', {}};
+            }
+            o.optimization_level = std::stoi(level);
+        } else if (arg == "--cache-dir") {
+            if (a + 1 == argc) return {"--cache-dir expects directory", {}};
+            o.cache_dir = argv[++a];
+        } else if (arg == "--cache-size") {
+            std::string n = a + 1 < argc ? argv[++a] : "";
+            if (!is_number(n)) return {"--cache-size expects size in megabytes instead of `" + n + '`', {}};
+            o.cache_size_mb = std::stoull(n);
+        } else if (arg == "--module") {
+            o.module = true;
+        } else if (arg == "--diagnostics") {
+            std::string format = a + 1 < argc ? argv[++a] : "";
+            if (format != "text" && format != "json") {
+                return {"--diagnostics expects `text` or `json` instead of `" + format + '`', {}};
+            }
+            o.json_diagnostics = format == "json";
+        } else if (arg == "--import") {
+            if (a + 1 == argc) return {"--import expects module file", {}};
+            o.imports.emplace_back(argv[++a]);
+        } else o.inputs.emplace_back(arg);
+    }
+    if (o.inputs.empty()) o.inputs.emplace_back("../examples/0.erx");
+    return {"", o};
+}
+
 int main(int argc, char* argv[]) {
     #ifdef DEBUG
     std::cout << "DEBUG build. Running tests...\n";
     if (!test_all()) return -1;
     #endif
 
-    auto err = compilation_pipeline("../examples/0.erx");
-    if (!err) {
-        std::cerr << err.error << std::endl;
+    auto opts = parse_options(argc, argv);
+    if (!opts) {
+        std::cerr << opts.error << std::endl;
         exit(-1);
     }
+    const auto& [jobs, cache_dir, cache_size_mb, module, json, optimization_level, imports, inputs] = opts.value;
+
+    //modules are mapped once and shared by all inputs
+    modules imported {};
+    for (const auto& filename : imports) {
+        auto& image = imported.emplace_back(std::make_unique<JIR::module_image>());
+        auto mapped = image->map(filename);
+        if (!mapped) {
+            std::cerr << mapped.error << std::endl;
+            exit(-1);
+        }
+    }
+
+    std::unique_ptr<compile_cache> cache;
+    if (!cache_dir.empty()) {
+        const std::vector<std::string> outputs {".asm", ".obj"};
+        cache = std::make_unique<compile_cache>(cache_dir, cache_size_mb << 20, outputs);
+    }
+
+    //inputs are compiled on the same pool their functions are translated on, and with make jobserver
+    //every input waits for a job slot before it's scheduled
+    auto js = jobserver::from_environment();
+    thread_pool pool {jobs};
+    std::mutex output_mutex;
+    std::vector<std::future<bool>> compiled;
+    compiled.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        if (js) js->acquire();
+        compiled.emplace_back(pool.submit([&, input] {
+            std::ostringstream log;
+            auto err = module ? module_pipeline(input, log, json, optimization_level)
+                              : compilation_pipeline(input, pool, cache.get(), imported, log, inputs.size() == 1, json,
+                                                     optimization_level);
+            if (js) js->release();
+
+            std::lock_guard lock {output_mutex};
+            if (inputs.size() > 1) std::cout << input << ":\n";
+            std::cout << log.str();
+            if (!err) std::cerr << err.error << std::endl;
+            return bool(err);
+        }));
+    }
+
+    bool success = true;
+    for (auto& c : compiled) success &= pool.wait(c);
+
+    if (cache) {
+        auto stats = cache->stats();
+        std::cout << "Compile cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores
+                  << " stores, " << stats.evictions << " evictions\n";
+    }
+    if (!success) exit(-1);
 
     return 0;
 }
@@ -0,0 +1,100 @@
+#ifndef ERAXC_ARENA_H
+#define ERAXC_ARENA_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+namespace eraxc {
+
+    /// Bump allocator owning everything one compilation builds: CFG nodes, JIR nodes, edges and scopes.
+    /// Memory is taken from heap in geometrically growing chunks, allocation is a pointer bump and all of it is
+    /// freed at once with the arena. Small blocks are rounded up to power of two size classes, and blocks given
+    /// back are kept in free list of their class, so buffers growing vectors outgrow are reused by the next ones
+    /// instead of piling up. Not thread-safe, the arena belongs to the thread building the IR
+    class arena : public std::pmr::memory_resource {
+    public:
+        struct statistics {
+            //allocations served by the arena and bytes they asked for, reused blocks included
+            size_t allocations;
+            size_t bytes;
+            //chunks taken from heap and their total size
+            size_t chunks;
+            size_t chunk_bytes;
+        };
+
+    private:
+        //counts chunks bump allocator takes from heap
+        class chunk_source : public std::pmr::memory_resource {
+            void* do_allocate(size_t size, size_t alignment) override {
+                chunks++;
+                bytes += size;
+                return std::pmr::new_delete_resource()->allocate(size, alignment);
+            }
+
+            void do_deallocate(void* p, size_t size, size_t alignment) override {
+                std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+            }
+
+            bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+        public:
+            size_t chunks = 0;
+            size_t bytes = 0;
+        };
+
+        //blocks of 16 bytes up to 64KB are recycled, bigger ones are rare and stay until arena is destroyed
+        static constexpr size_t MIN_CLASS = 4;
+        static constexpr size_t MAX_CLASS = 16;
+
+        struct free_block {
+            free_block* next;
+        };
+
+        chunk_source source {};
+        std::pmr::monotonic_buffer_resource bump;
+        std::array<free_block*, MAX_CLASS + 1> free_lists {};
+        size_t allocations = 0;
+        size_t allocated = 0;
+
+        /// @return size class of block, MAX_CLASS + 1 if it's not recycled
+        static size_t size_class(size_t size, size_t alignment) {
+            if (alignment > alignof(std::max_align_t)) return MAX_CLASS + 1;
+            return std::max(size_t(std::bit_width(size - 1)), MIN_CLASS);
+        }
+
+        void* do_allocate(size_t size, size_t alignment) override {
+            allocations++;
+            allocated += size;
+            const size_t c = size_class(size, alignment);
+            if (c > MAX_CLASS) return bump.allocate(size, alignment);
+            if (free_block* block = free_lists[c]) {
+                free_lists[c] = block->next;
+                return block;
+            }
+            return bump.allocate(size_t(1) << c, alignof(std::max_align_t));
+        }
+
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            const size_t c = size_class(size, alignment);
+            if (c > MAX_CLASS) return;
+            free_lists[c] = new (p) free_block {free_lists[c]};
+        }
+
+        bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+    public:
+        /// @param initial_size size of the first chunk, the next ones grow from it
+        explicit arena(size_t initial_size = 64 << 10) : bump(initial_size, &source) {}
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        statistics stats() const { return {allocations, allocated, source.chunks, source.bytes}; }
+    };
+}
+
+#endif  //ERAXC_ARENA_H
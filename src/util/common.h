@@ -3,5 +3,7 @@
 
 typedef unsigned long long int u64;
 typedef long long int i64;
+typedef unsigned int u32;
+typedef unsigned short u16;
 
 #endif //COMMON_H
@@ -0,0 +1,226 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "interner.h"
+
+//bump when the same tokens start to compile into different asm, so old cache entries aren't reused
+#define ERAXC_VERSION "eraxc 0.1.0"
+
+namespace eraxc {
+
+    /// 128-bit streaming hash of cache key parts. Two independent 64-bit lanes, so accidental collisions of
+    /// thousands of cached files are practically impossible. Not meant to resist crafted collisions
+    class key_hasher {
+        u64 a = 0xCBF29CE484222325ull;
+        u64 b = 0x9E3779B97F4A7C15ull;
+
+    public:
+        void add(std::string_view s) {
+            for (unsigned char c : s) a = (a ^ c) * 0x100000001B3ull;
+            //length keeps ("ab", "c") and ("a", "bc") apart
+            a = (a ^ s.size()) * 0x100000001B3ull;
+            b = (b ^ hash_text(s)) * 0xFF51AFD7ED558CCDull;
+            b ^= b >> 31;
+        }
+
+        void add(u64 v) { add(std::string_view {reinterpret_cast<const char*>(&v), sizeof(v)}); }
+
+        std::string hex() const {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string r(32, '0');
+            for (int i = 0; i < 16; i++) {
+                r[15 - i] = digits[(a >> (i * 4)) & 15];
+                r[31 - i] = digits[(b >> (i * 4)) & 15];
+            }
+            return r;
+        }
+    };
+
+    /// Key of preprocessed file: compiler version, flags, tokens after macro substitution and macros left defined
+    /// @param tokens anything iterable with `t` and `data` of tokens
+    /// @param defined macro name -> macro with its definition `text`
+    /// @param flags every compiler option that changes output
+    template<typename tokens_t, typename defines_t>
+    std::string compile_cache_key(const tokens_t& tokens, const defines_t& defined, std::string_view flags) {
+        key_hasher h {};
+        h.add(ERAXC_VERSION);
+        h.add(flags);
+        h.add(u64(tokens.size()));
+        for (const auto& token : tokens) {
+            h.add(u64(token.t));
+            h.add(token.data);
+        }
+        //symbol ids depend on interning order, so macros are hashed by name
+        std::vector<std::pair<std::string_view, std::string_view>> macros {};
+        for (const auto& [name, value] : defined) macros.emplace_back(interner::global().text(name), value->text);
+        std::sort(macros.begin(), macros.end());
+        h.add(u64(macros.size()));
+        for (const auto& [name, value] : macros) {
+            h.add(name);
+            h.add(value);
+        }
+        return h.hex();
+    }
+
+    /// Content-addressed on-disk cache of compilation outputs. Entry is a set of files `<key><extension>` in cache
+    /// directory. Size of directory is bounded, least recently used entries are evicted first.
+    /// Usage is tracked by file modification time, so it survives between runs and is shared by processes
+    class compile_cache {
+    public:
+        struct statistics {
+            size_t hits;
+            size_t misses;
+            size_t stores;
+            size_t evictions;
+        };
+
+    private:
+        struct entry {
+            std::list<std::string>::iterator lru_position;
+            u64 size;
+        };
+
+        std::filesystem::path dir;
+        u64 max_size;
+        std::vector<std::string> extensions;
+
+        std::mutex mutex {};
+        //most recently used first
+        std::list<std::string> lru {};
+        std::unordered_map<std::string, entry> entries {};
+        u64 total_size = 0;
+
+        std::atomic<size_t> hits = 0;
+        std::atomic<size_t> misses = 0;
+        std::atomic<size_t> stores = 0;
+        std::atomic<size_t> evictions = 0;
+
+        std::filesystem::path file(const std::string& key, const std::string& extension) const {
+            return dir / (key + extension);
+        }
+
+        /// Loads index of entries already in directory, ordered by their last use
+        void scan() {
+            std::unordered_map<std::string, std::pair<std::filesystem::file_time_type, u64>> found {};
+            std::error_code ec;
+            for (const auto& f : std::filesystem::directory_iterator {dir, ec}) {
+                if (!f.is_regular_file(ec)) continue;
+                const auto path = f.path();
+                if (std::find(extensions.begin(), extensions.end(), path.extension().string()) == extensions.end())
+                    continue;
+                auto& [time, size] = found[path.stem().string()];
+                time = std::max(time, f.last_write_time(ec));
+                size += f.file_size(ec);
+            }
+            std::vector<std::pair<std::filesystem::file_time_type, std::string>> by_time {};
+            for (const auto& [key, info] : found) by_time.emplace_back(info.first, key);
+            std::sort(by_time.begin(), by_time.end(), std::greater {});
+            for (const auto& [time, key] : by_time) {
+                lru.push_back(key);
+                entries[key] = {std::prev(lru.end()), found[key].second};
+                total_size += found[key].second;
+            }
+        }
+
+        /// Removes least recently used entries until cache fits. Has to be called under lock
+        void evict() {
+            while (total_size > max_size && !lru.empty()) {
+                const std::string key = lru.back();
+                std::error_code ec;
+                for (const auto& extension : extensions) std::filesystem::remove(file(key, extension), ec);
+                total_size -= entries[key].size;
+                entries.erase(key);
+                lru.pop_back();
+                evictions++;
+            }
+        }
+
+    public:
+        /// @param dir cache directory, created if doesn't exist
+        /// @param max_size size in bytes directory is trimmed to
+        /// @param extensions extensions of files that make up an entry, e.g. {".asm", ".obj"}
+        compile_cache(std::filesystem::path dir, u64 max_size, std::vector<std::string> extensions)
+            : dir(std::move(dir)), max_size(max_size), extensions(std::move(extensions)) {
+            std::error_code ec;
+            std::filesystem::create_directories(this->dir, ec);
+            scan();
+        }
+
+        compile_cache(const compile_cache&) = delete;
+        compile_cache& operator=(const compile_cache&) = delete;
+
+        /// Copies cached files of the key to `<output><extension>`
+        /// @return whether entry was found. Files missing in entry (e.g. object when assembler failed) aren't copied
+        bool fetch(const std::string& key, const std::string& output) {
+            {
+                std::lock_guard lock {mutex};
+                auto it = entries.find(key);
+                if (it == entries.end()) {
+                    misses++;
+                    return false;
+                }
+                lru.splice(lru.begin(), lru, it->second.lru_position);
+            }
+            std::error_code ec;
+            bool copied = false;
+            for (const auto& extension : extensions) {
+                const auto cached = file(key, extension);
+                if (!std::filesystem::exists(cached, ec)) continue;
+                const auto overwrite = std::filesystem::copy_options::overwrite_existing;
+                std::filesystem::copy_file(cached, output + extension, overwrite, ec);
+                if (ec) break;
+                std::filesystem::last_write_time(cached, std::filesystem::file_time_type::clock::now(), ec);
+                copied = true;
+            }
+            //evicted by another compiler process
+            if (!copied || ec) {
+                misses++;
+                return false;
+            }
+            hits++;
+            return true;
+        }
+
+        /// Puts existing `<output><extension>` files into cache under the key
+        void store(const std::string& key, const std::string& output) {
+            u64 size = 0;
+            std::error_code ec;
+            for (const auto& extension : extensions) {
+                const std::filesystem::path produced = output + extension;
+                if (!std::filesystem::exists(produced, ec)) continue;
+                //copy + rename, so other processes never see partially written entry
+                const auto tmp = file(key, extension + ".tmp");
+                std::filesystem::copy_file(produced, tmp, std::filesystem::copy_options::overwrite_existing, ec);
+                if (ec) return;
+                std::filesystem::rename(tmp, file(key, extension), ec);
+                if (ec) return;
+                size += std::filesystem::file_size(file(key, extension), ec);
+            }
+            std::lock_guard lock {mutex};
+            if (auto it = entries.find(key); it != entries.end()) {
+                total_size -= it->second.size;
+                lru.erase(it->second.lru_position);
+            }
+            lru.push_front(key);
+            entries[key] = {lru.begin(), size};
+            total_size += size;
+            stores++;
+            evict();
+        }
+
+        statistics stats() const { return {hits, misses, stores, evictions}; }
+    };
+}
+
+#endif  //COMPILE_CACHE_H
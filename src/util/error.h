@@ -1,7 +1,13 @@
 #ifndef ERAXC_ERROR_H
 #define ERAXC_ERROR_H
 
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "interner.h"
 
 namespace error {
 
@@ -47,6 +53,112 @@ namespace error {
         }
     };
 
+    /// Error of `expected`: interned format text and interned text it's about, e.g. name of unknown identifier.
+    /// Message is put together only when it's reported, so failing and passing failure up never allocate
+    struct failure {
+        eraxc::symbol what = eraxc::NO_SYMBOL;
+        eraxc::symbol subject = eraxc::NO_SYMBOL;
+        //kind of error diagnostics are reported with, 0 if it has none
+        u16 code = 0;
+
+        /// `what` with the first `{}` replaced by subject, or with subject appended if there's no `{}`
+        std::string message() const {
+            const auto& in = eraxc::interner::global();
+            std::string text {in.text(what)};
+            const std::string_view s = in.text(subject);
+            if (auto at = text.find("{}"); at != std::string::npos) text.replace(at, 2, s);
+            else text += s;
+            return text;
+        }
+
+        /// Failure with this one's message put into context, e.g. "Error while parsing a function:\n{}"
+        failure within(std::string_view context) const {
+            auto& in = eraxc::interner::global();
+            return {in.intern(context), in.intern(message()), code};
+        }
+    };
+
+    inline failure fail(std::string_view what) { return {eraxc::interner::global().intern(what)}; }
+
+    /// @param subject symbol of text the error is about, e.g. of token
+    inline failure fail(std::string_view what, eraxc::symbol subject) {
+        return {eraxc::interner::global().intern(what), subject};
+    }
+
+    inline failure fail(std::string_view what, std::string_view subject) {
+        auto& in = eraxc::interner::global();
+        return {in.intern(what), in.intern(subject)};
+    }
+
+    /// @param code kind of error, e.g. one of JIR::error_code
+    inline failure fail(u16 code, std::string_view what, eraxc::symbol subject = eraxc::NO_SYMBOL) {
+        return {eraxc::interner::global().intern(what), subject, code};
+    }
+
+    inline failure fail(u16 code, std::string_view what, std::string_view subject) {
+        auto& in = eraxc::interner::global();
+        return {in.intern(what), in.intern(subject), code};
+    }
+
+    /// Value or failure. Replaces errable on hot paths: success carries no string, and value is moved in and out,
+    /// never copied, so `expected` is move-only
+    template<typename T>
+    class expected {
+        failure err {};
+        bool ok;
+        union {
+            T val;
+        };
+
+    public:
+        expected(failure f) : err(f), ok(false) {}
+        expected(T&& v) : ok(true) { new (&val) T(std::move(v)); }
+        expected(const T& v) requires std::is_trivially_copyable_v<T> : ok(true) { new (&val) T(v); }
+
+        expected(expected&& other) noexcept : err(other.err), ok(other.ok) {
+            if (ok) new (&val) T(std::move(other.val));
+        }
+
+        expected& operator=(expected&& other) noexcept {
+            if (this == &other) return *this;
+            if (ok) val.~T();
+            err = other.err;
+            ok = other.ok;
+            if (ok) new (&val) T(std::move(other.val));
+            return *this;
+        }
+
+        expected(const expected&) = delete;
+        expected& operator=(const expected&) = delete;
+
+        ~expected() {
+            if (ok) val.~T();
+        }
+
+        explicit operator bool() const { return ok; }
+
+        T& value() & { return val; }
+        const T& value() const& { return val; }
+        T&& value() && { return std::move(val); }
+
+        const failure& error() const { return err; }
+        std::string message() const { return ok ? std::string {} : err.message(); }
+    };
+
+    template<>
+    class expected<void> {
+        failure err {};
+
+    public:
+        expected() = default;
+        expected(failure f) : err(f) {}
+
+        explicit operator bool() const { return err.what == eraxc::NO_SYMBOL; }
+
+        const failure& error() const { return err; }
+        std::string message() const { return err.message(); }
+    };
+
     /// Fatal error stops the process of compilation of file
     /// \param what error to print
     void fatal(const std::string &filename, int line, const std::string &what, int err_code);
@@ -0,0 +1,237 @@
+#ifndef ERAXC_INTERNER_H
+#define ERAXC_INTERNER_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+#include "common.h"
+
+namespace eraxc {
+
+    /// Dense id of interned string
+    typedef u32 symbol;
+
+    static constexpr symbol NO_SYMBOL = -1u;
+
+    /// Symbols interned at start, so their ids are known at compile time
+    namespace sym {
+        enum builtin : symbol {
+            I8,
+            I16,
+            I32,
+            I64,
+            I128,
+            I256,
+            U8,
+            U16,
+            U32,
+            U64,
+            U128,
+            U256,
+            INT,
+            LONG,
+            CHAR,
+            BOOL,
+            SHORT,
+            VOID,
+
+            MAIN,
+            RETURN,
+            IF,
+            ELSE,
+            FOR,
+            WHILE,
+            DO,
+
+            BUILTINS_COUNT
+        };
+
+        inline constexpr std::string_view builtin_names[BUILTINS_COUNT] {
+            "i8",  "i16",  "i32",  "i64",  "i128",   "i256", "u8",   "u16",   "u32", "u64", "u128", "u256", "int",
+            "long", "char", "bool", "short", "void", "main", "return", "if", "else", "for", "while", "do"};
+    }
+
+    /// Fast hash for short strings, reads 8 bytes at a time
+    inline u64 hash_text(std::string_view s) {
+        u64 h = s.size() * 0x9E3779B97F4A7C15ull;
+        size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            u64 w;
+            std::memcpy(&w, s.data() + i, 8);
+            h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+            h ^= h >> 32;
+        }
+        for (; i < s.size(); i++) h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001B3ull;
+        return h ^ (h >> 29);
+    }
+
+    /// Thread-safe string interner. Strings are copied once into arena and never move,
+    /// so returned views are valid for whole process lifetime
+    class interner {
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> chunks;
+        char* chunk_ptr = nullptr;
+        size_t chunk_left = 0;
+
+        struct slot {
+            u64 hash = 0;
+            symbol id = NO_SYMBOL;
+        };
+
+        //strings by id in segments of doubling size. Segments never move, so text() reads them without lock:
+        //whoever got an id got it after its string was stored
+        static constexpr size_t FIRST_SEGMENT_BITS = 10;
+        std::array<std::unique_ptr<std::string_view[]>, 32 - FIRST_SEGMENT_BITS> segments;
+        size_t count = 0;
+
+        static std::pair<size_t, size_t> segment_of(symbol id) {
+            const size_t i = size_t(id) + (size_t(1) << FIRST_SEGMENT_BITS);
+            const size_t segment = std::bit_width(i) - 1 - FIRST_SEGMENT_BITS;
+            return {segment, i - (size_t(1) << (segment + FIRST_SEGMENT_BITS))};
+        }
+
+        std::string_view at(symbol id) const {
+            const auto [segment, index] = segment_of(id);
+            return segments[segment][index];
+        }
+
+        void add(std::string_view s) {
+            const auto [segment, index] = segment_of(count);
+            if (index == 0) segments[segment].reset(new std::string_view[size_t(1) << (segment + FIRST_SEGMENT_BITS)]);
+            segments[segment][index] = s;
+            count++;
+        }
+
+        //open addressing table of ids, power of 2 sized
+        std::vector<slot> table = std::vector<slot>(1024);
+
+        mutable std::shared_mutex mutex;
+
+        std::string_view store(std::string_view s) {
+            if (s.size() > chunk_left) {
+                size_t size = std::max(CHUNK_SIZE, s.size());
+                chunks.emplace_back(new char[size]);
+                chunk_ptr = chunks.back().get();
+                chunk_left = size;
+            }
+            std::copy(s.begin(), s.end(), chunk_ptr);
+            std::string_view stored {chunk_ptr, s.size()};
+            chunk_ptr += s.size();
+            chunk_left -= s.size();
+            return stored;
+        }
+
+        size_t find_slot(std::string_view s, u64 hash) const {
+            const size_t mask = table.size() - 1;
+            size_t i = hash & mask;
+            while (table[i].id != NO_SYMBOL && (table[i].hash != hash || at(table[i].id) != s)) i = (i + 1) & mask;
+            return i;
+        }
+
+        void grow() {
+            std::vector<slot> old = std::move(table);
+            table = std::vector<slot>(old.size() * 2);
+            const size_t mask = table.size() - 1;
+            for (const auto& s : old) {
+                if (s.id == NO_SYMBOL) continue;
+                size_t i = s.hash & mask;
+                while (table[i].id != NO_SYMBOL) i = (i + 1) & mask;
+                table[i] = s;
+            }
+        }
+
+    public:
+        interner() {
+            for (auto name : sym::builtin_names) intern(name);
+        }
+
+        interner(const interner&) = delete;
+        interner& operator=(const interner&) = delete;
+
+        /// Global interner shared by all compilations
+        static interner& global() {
+            static interner instance {};
+            return instance;
+        }
+
+        /// @return id of string, interning it if it's new
+        symbol intern(std::string_view s) {
+            const u64 hash = hash_text(s);
+            {
+                std::shared_lock lock {mutex};
+                if (symbol id = table[find_slot(s, hash)].id; id != NO_SYMBOL) return id;
+            }
+            std::unique_lock lock {mutex};
+            size_t i = find_slot(s, hash);
+            if (table[i].id != NO_SYMBOL) return table[i].id;
+            symbol id = count;
+            add(store(s));
+            table[i] = {hash, id};
+            if (count * 2 > table.size()) grow();
+            return id;
+        }
+
+        /// @return id of string, NO_SYMBOL if it was never interned
+        symbol find(std::string_view s) const {
+            std::shared_lock lock {mutex};
+            return table[find_slot(s, hash_text(s))].id;
+        }
+
+        /// Lock-free, so parser can read text of tokens on every step
+        /// @param id symbol returned by intern() or NO_SYMBOL
+        std::string_view text(symbol id) const { return id == NO_SYMBOL ? std::string_view {} : at(id); }
+
+        size_t size() const {
+            std::shared_lock lock {mutex};
+            return count;
+        }
+    };
+
+    /// Lock-free front of the global interner for hot loops such as lexer. Not thread-safe itself, one per thread.
+    /// Keeps views passed to intern(), so they have to outlive the cache
+    class symbol_cache {
+        struct slot {
+            std::string_view text {};
+            symbol id = NO_SYMBOL;
+        };
+
+        std::vector<slot> slots = std::vector<slot>(1024);
+        size_t count = 0;
+
+        void grow() {
+            std::vector<slot> old = std::move(slots);
+            slots = std::vector<slot>(old.size() * 2);
+            const size_t mask = slots.size() - 1;
+            for (auto& s : old) {
+                if (s.id == NO_SYMBOL) continue;
+                size_t i = hash_text(s.text) & mask;
+                while (slots[i].id != NO_SYMBOL) i = (i + 1) & mask;
+                slots[i] = s;
+            }
+        }
+
+    public:
+        symbol intern(std::string_view s) {
+            const size_t mask = slots.size() - 1;
+            size_t i = hash_text(s) & mask;
+            while (slots[i].id != NO_SYMBOL) {
+                if (slots[i].text == s) return slots[i].id;
+                i = (i + 1) & mask;
+            }
+            const symbol id = interner::global().intern(s);
+            slots[i] = {s, id};
+            if (++count * 2 > slots.size()) grow();
+            return id;
+        }
+    };
+}
+
+#endif  //ERAXC_INTERNER_H
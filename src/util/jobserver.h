@@ -0,0 +1,137 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace eraxc {
+
+    /// Client of GNU make jobserver, so parallel compilation doesn't run more jobs than `make -j N` allows.
+    /// make passes it in MAKEFLAGS as `--jobserver-auth=R,W` (pipe fds), `--jobserver-auth=fifo:PATH` (make 4.4)
+    /// or a semaphore name on Windows. Every process owns one implicit job slot,
+    /// every other concurrent job needs a token read from jobserver, which is written back when the job is done
+    class jobserver {
+        std::mutex mutex {};
+        bool implicit_free = true;
+        //tokens are written back as they were read
+        std::vector<char> tokens {};
+
+        #ifdef _WIN32
+        HANDLE semaphore = nullptr;
+        #else
+        int read_fd = -1;
+        int write_fd = -1;
+        bool owns_fds = false;
+        #endif
+
+        jobserver() = default;
+
+        static std::string_view auth_value(std::string_view flags) {
+            for (std::string_view key : {"--jobserver-auth=", "--jobserver-fds="}) {
+                //the last one wins if make passed several
+                size_t pos = flags.rfind(key);
+                if (pos == std::string_view::npos) continue;
+                std::string_view value = flags.substr(pos + key.size());
+                return value.substr(0, value.find(' '));
+            }
+            return {};
+        }
+
+    public:
+        jobserver(const jobserver&) = delete;
+        jobserver& operator=(const jobserver&) = delete;
+
+        ~jobserver() {
+            #ifdef _WIN32
+            if (semaphore) CloseHandle(semaphore);
+            #else
+            if (owns_fds) close(read_fd);
+            #endif
+        }
+
+        /// @return jobserver from MAKEFLAGS or nullptr if compiler isn't run by make with jobserver
+        static std::unique_ptr<jobserver> from_environment() {
+            const char* flags = std::getenv("MAKEFLAGS");
+            if (flags == nullptr) return nullptr;
+            std::string value {auth_value(flags)};
+            if (value.empty()) return nullptr;
+
+            std::unique_ptr<jobserver> js {new jobserver {}};
+            #ifdef _WIN32
+            js->semaphore = OpenSemaphoreA(SYNCHRONIZE | SEMAPHORE_MODIFY_STATE, FALSE, value.c_str());
+            if (js->semaphore == nullptr) return nullptr;
+            #else
+            if (value.starts_with("fifo:")) {
+                js->read_fd = js->write_fd = open(value.c_str() + 5, O_RDWR);
+                js->owns_fds = true;
+            } else {
+                size_t comma = value.find(',');
+                if (comma == std::string::npos) return nullptr;
+                js->read_fd = std::atoi(value.c_str());
+                js->write_fd = std::atoi(value.c_str() + comma + 1);
+            }
+            //make doesn't pass the fds to commands not marked as recursive (`+`)
+            if (js->read_fd < 0 || fcntl(js->read_fd, F_GETFD) == -1 || fcntl(js->write_fd, F_GETFD) == -1) {
+                return nullptr;
+            }
+            #endif
+            return js;
+        }
+
+        /// Blocks until job slot is available
+        void acquire() {
+            {
+                std::lock_guard lock {mutex};
+                if (implicit_free) {
+                    implicit_free = false;
+                    return;
+                }
+            }
+            #ifdef _WIN32
+            WaitForSingleObject(semaphore, INFINITE);
+            const char token = '+';
+            #else
+            char token;
+            ssize_t r;
+            do { r = read(read_fd, &token, 1); } while (r < 0 && errno == EINTR);
+            //jobserver is gone, don't block compilation because of it
+            if (r != 1) return;
+            #endif
+            std::lock_guard lock {mutex};
+            tokens.push_back(token);
+        }
+
+        /// Frees job slot taken by acquire()
+        void release() {
+            std::lock_guard lock {mutex};
+            if (tokens.empty()) {
+                implicit_free = true;
+                return;
+            }
+            #ifdef _WIN32
+            tokens.pop_back();
+            ReleaseSemaphore(semaphore, 1, nullptr);
+            #else
+            char token = tokens.back();
+            tokens.pop_back();
+            ssize_t r;
+            do { r = write(write_fd, &token, 1); } while (r < 0 && errno == EINTR);
+            #endif
+        }
+    };
+}
+
+#endif  //JOBSERVER_H
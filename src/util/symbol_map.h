@@ -0,0 +1,98 @@
+#ifndef ERAXC_SYMBOL_MAP_H
+#define ERAXC_SYMBOL_MAP_H
+
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "interner.h"
+
+namespace eraxc {
+
+    /// Open addressing hash map keyed by symbols. No erase, as scopes only grow until they're popped.
+    /// Slots are allocated from the memory resource of the map, e.g. arena of the compilation
+    template<typename V>
+    class symbol_map {
+        struct slot {
+            symbol key = NO_SYMBOL;
+            V value {};
+        };
+
+        std::pmr::vector<slot> slots;
+        size_t count = 0;
+
+        static size_t hash(symbol s) {
+            //fibonacci hashing, symbols are dense so they need some scattering
+            return size_t(s) * 0x9E3779B97F4A7C15ull >> 32;
+        }
+
+        size_t find_slot(symbol key) const {
+            const size_t mask = slots.size() - 1;
+            size_t i = hash(key) & mask;
+            while (slots[i].key != key && slots[i].key != NO_SYMBOL) i = (i + 1) & mask;
+            return i;
+        }
+
+        void grow() {
+            std::pmr::vector<slot> old = std::move(slots);
+            slots = std::pmr::vector<slot>(old.empty() ? 8 : old.size() * 2, old.get_allocator());
+            for (auto& s : old) {
+                if (s.key != NO_SYMBOL) slots[find_slot(s.key)] = std::move(s);
+            }
+        }
+
+    public:
+        explicit symbol_map(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) : slots(memory) {}
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        const V* find(symbol key) const {
+            if (count == 0) return nullptr;
+            const slot& s = slots[find_slot(key)];
+            return s.key == key ? &s.value : nullptr;
+        }
+
+        V* find(symbol key) { return const_cast<V*>(std::as_const(*this).find(key)); }
+
+        bool contains(symbol key) const { return find(key) != nullptr; }
+
+        /// Inserts value if key is not present yet
+        /// @return true if value was inserted
+        bool emplace(symbol key, const V& value) {
+            if ((count + 1) * 4 > slots.size() * 3) grow();
+            slot& s = slots[find_slot(key)];
+            if (s.key == key) return false;
+            s.key = key;
+            s.value = value;
+            count++;
+            return true;
+        }
+
+        V& operator[](symbol key) {
+            if ((count + 1) * 4 > slots.size() * 3) grow();
+            slot& s = slots[find_slot(key)];
+            if (s.key != key) {
+                s.key = key;
+                count++;
+            }
+            return s.value;
+        }
+
+        /// Removes every value, keeping slots for the next ones
+        void clear() {
+            if (count == 0) return;
+            for (auto& s : slots) s = slot {};
+            count = 0;
+        }
+
+        template<typename F>
+        void for_each(F&& f) const {
+            for (const auto& s : slots) {
+                if (s.key != NO_SYMBOL) f(s.key, s.value);
+            }
+        }
+    };
+}
+
+#endif  //ERAXC_SYMBOL_MAP_H
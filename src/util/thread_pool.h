@@ -0,0 +1,151 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace eraxc {
+
+    /// Work-stealing thread pool. Every worker has its own deque: jobs submitted from a worker go to its own deque and
+    /// are taken from the back (the most recent, still hot in cache), idle workers steal from the front of others.
+    /// Jobs submitted from outside of pool go to shared injection queue, which is taken from only by idle workers,
+    /// never by workers helping in wait(). So an outside job (e.g. whole file compilation) may wait for jobs
+    /// it submits, while jobs submitted from workers must not wait on pool themselves
+    class thread_pool {
+        struct job_queue {
+            std::mutex mutex {};
+            std::deque<std::function<void()>> jobs {};
+        };
+
+        std::vector<std::unique_ptr<job_queue>> queues;
+        job_queue injected {};
+        std::vector<std::thread> workers;
+
+        //jobs in queues. Incremented under sleep_mutex after the job is queued, so a job taken right after it's queued
+        //makes it negative for a moment instead of waking everyone up
+        std::atomic<long> pending = 0;
+        std::mutex sleep_mutex {};
+        std::condition_variable cv {};
+        bool stopping = false;
+
+        static inline thread_local thread_pool* current_pool = nullptr;
+        static inline thread_local size_t current_worker = 0;
+
+        bool pop_own(size_t worker, std::function<void()>& job) {
+            auto& q = *queues[worker];
+            std::lock_guard lock {q.mutex};
+            if (q.jobs.empty()) return false;
+            job = std::move(q.jobs.back());
+            q.jobs.pop_back();
+            return true;
+        }
+
+        bool steal(size_t worker, std::function<void()>& job) {
+            for (size_t k = 1; k < queues.size(); k++) {
+                auto& q = *queues[(worker + k) % queues.size()];
+                std::lock_guard lock {q.mutex};
+                if (q.jobs.empty()) continue;
+                job = std::move(q.jobs.front());
+                q.jobs.pop_front();
+                return true;
+            }
+            return false;
+        }
+
+        bool pop_injected(std::function<void()>& job) {
+            std::lock_guard lock {injected.mutex};
+            if (injected.jobs.empty()) return false;
+            job = std::move(injected.jobs.front());
+            injected.jobs.pop_front();
+            return true;
+        }
+
+        /// Runs one queued job if there is any
+        /// @param take_injected whether jobs submitted from outside can be run
+        bool run_one(size_t worker, bool take_injected) {
+            std::function<void()> job;
+            if (!pop_own(worker, job) && !steal(worker, job) && !(take_injected && pop_injected(job))) return false;
+            pending--;
+            job();
+            return true;
+        }
+
+        void work(size_t worker) {
+            current_pool = this;
+            current_worker = worker;
+            while (true) {
+                if (run_one(worker, true)) continue;
+                std::unique_lock lock {sleep_mutex};
+                cv.wait(lock, [&] { return stopping || pending > 0; });
+                if (stopping && pending == 0) return;
+            }
+        }
+
+    public:
+        /// @param threads workers count, hardware concurrency by default
+        explicit thread_pool(size_t threads = std::thread::hardware_concurrency()) {
+            if (threads == 0) threads = 1;
+            for (size_t i = 0; i < threads; i++) queues.emplace_back(std::make_unique<job_queue>());
+            workers.reserve(threads);
+            for (size_t i = 0; i < threads; i++) workers.emplace_back(&thread_pool::work, this, i);
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        /// Finishes all submitted jobs and joins workers
+        ~thread_pool() {
+            {
+                std::lock_guard lock {sleep_mutex};
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& w : workers) w.join();
+        }
+
+        /// Schedules job
+        /// @return future of job result
+        template<typename F>
+        auto submit(F&& f) -> std::future<std::invoke_result_t<F>> {
+            //std::function needs copyable callable, so the task is shared
+            auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+            auto result = task->get_future();
+            {
+                auto& q = current_pool == this ? *queues[current_worker] : injected;
+                std::lock_guard lock {q.mutex};
+                q.jobs.emplace_back([task] { (*task)(); });
+            }
+            {
+                std::lock_guard lock {sleep_mutex};
+                pending++;
+            }
+            cv.notify_one();
+            return result;
+        }
+
+        /// Waits for the job result. Called from a worker runs jobs submitted by workers meanwhile, so a job waiting
+        /// for jobs it submitted doesn't occupy a worker all of them are queued behind
+        template<typename T>
+        T wait(std::future<T>& result) {
+            if (current_pool == this) {
+                while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    //nothing to help with, the job is being run by another worker
+                    if (!run_one(current_worker, false)) result.wait_for(std::chrono::microseconds(50));
+                }
+            }
+            return result.get();
+        }
+
+        size_t size() const { return workers.size(); }
+    };
+}
+
+#endif  //THREAD_POOL_H
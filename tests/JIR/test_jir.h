@@ -1,23 +1,32 @@
 #ifndef TEST_JIR_H
 #define TEST_JIR_H
 
-#define ALL_TESTS_JIR 1
+#define ALL_TESTS_JIR 17
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "../../src/backend/codegen/asm_x86.h"
 #include "../../src/backend/JIR/CFG/errors.h"
+#include "../../src/backend/JIR/CFG/passes.h"
+#include "../../src/backend/JIR/module_image.h"
+#include "../../src/frontend/lexic/token_stream.h"
 
 namespace tests {
 
     namespace JIR {
 
-        inline error::errable<eraxc::JIR::CFG> open_cfg(const std::string& filename) {
+        inline error::errable<void> open_cfg(const std::string& filename) {
             eraxc::tokenizer tokenizer {};
             auto tokens = tokenizer.tokenize_file("../tests/JIR/files/"+filename);
             if (!tokens) {
                 std::cerr << "JIR " << filename << " test failed to tokenize with error:\n" << tokens.error << '\n';
-                return {"token_err", {}};
+                return {"token_err"};
             }
             eraxc::JIR::CFG cfg {};
             auto cfg_err = cfg.create(tokens.value);
-            return {cfg_err.error, cfg};
+            return {cfg_err.message()};
         }
 
         inline bool global_no_main() {
@@ -36,11 +45,682 @@ namespace tests {
 
             return true;
         }
+
+        inline bool same_operand(const eraxc::JIR::Operand& a, const eraxc::JIR::Operand& b) {
+            return a.type == b.type && a.value == b.value && a.is_instant == b.is_instant && a.is_rvalue == b.is_rvalue;
+        }
+
+        /// CFG built while lexer thread streams tokens through a ring much smaller than the file
+        /// has to be the same as CFG built from whole token vector
+        inline bool streamed_tokens() {
+            //files with stoi("0") crash in parse_instant no matter how tokens are read, so they're not here yet
+            for (const std::string filename : {"../tests/JIR/files/global_no_main.erx",
+                                               "../tests/JIR/files/rvalue_unary.erx", "../tests/JIR/files/void.erx",
+                                               "../examples/0.erx", "../examples/if_test.erx", "../examples/main.erx"}) {
+                eraxc::tokenizer vector_tokenizer {};
+                auto tokens = vector_tokenizer.tokenize_file(filename);
+                eraxc::JIR::CFG expected {};
+                auto expected_err = expected.create(tokens.value);
+
+                eraxc::tokenizer tokenizer {};
+                eraxc::token_stream stream {64};
+                std::thread lexer {eraxc::tokenize_file_to_stream, std::ref(tokenizer), filename, std::ref(stream)};
+                eraxc::JIR::CFG cfg {};
+                auto err = cfg.create(stream);
+                stream.abandon();
+                lexer.join();
+
+                bool same = expected_err.message() == err.message() &&
+                            expected.get_nodes().size() == cfg.get_nodes().size();
+                for (size_t n = 0; same && n < cfg.get_nodes().size(); n++) {
+                    const auto& a = expected.get_nodes()[n].body;
+                    const auto& b = cfg.get_nodes()[n].body;
+                    same = a.size() == b.size();
+                    for (size_t k = 0; same && k < a.size(); k++) {
+                        same = a[k].op == b[k].op && same_operand(a[k].operand1, b[k].operand1) &&
+                               same_operand(a[k].operand2, b[k].operand2);
+                    }
+                }
+                if (!same) {
+                    std::cerr << "Test JIR " << filename << " failed: streamed tokens produced different CFG\n";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// CFG of a file importing module image has to be the same as CFG of module source followed by the file
+        inline bool imported_module() {
+            const std::string dir = "../tests/JIR/files/";
+            eraxc::tokenizer module_tokenizer {};
+            auto module_tokens = module_tokenizer.tokenize_file(dir + "module.erx");
+            eraxc::tokenizer main_tokenizer {};
+            auto main_tokens = main_tokenizer.tokenize_file(dir + "module_main.erx");
+            if (!module_tokens || !main_tokens) {
+                std::cerr << "Test JIR module failed to tokenize\n";
+                return false;
+            }
+
+            const std::string image_file = (std::filesystem::temp_directory_path() / "eraxc_test_module.jirm").string();
+            eraxc::token_stream module_stream {module_tokens.value};
+            eraxc::JIR::CFG module {};
+            auto module_err = module.create_module(module_stream);
+            auto written = module_err ? eraxc::JIR::write_module(module, image_file)
+                                      : error::errable<void> {module_err.message()};
+            eraxc::JIR::module_image image {};
+            auto mapped = written ? image.map(image_file) : written;
+            if (!mapped) {
+                std::cerr << "Test JIR module failed to make module image:\n" << mapped.error << '\n';
+                return false;
+            }
+
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.import_module(image);
+            if (err) err = cfg.create(main_tokens.value);
+
+            auto all_tokens = module_tokens.value;
+            all_tokens.insert(all_tokens.end(), main_tokens.value.begin(), main_tokens.value.end());
+            eraxc::JIR::CFG expected {};
+            auto expected_err = expected.create(all_tokens);
+            std::filesystem::remove(image_file);
+
+            bool same = err && expected_err && expected.get_nodes().size() == cfg.get_nodes().size() &&
+                        expected.get_funcs().size() == cfg.get_funcs().size();
+            for (size_t n = 0; same && n < cfg.get_nodes().size(); n++) {
+                const auto& a = expected.get_nodes()[n].body;
+                const auto& b = cfg.get_nodes()[n].body;
+                same = a.size() == b.size() && expected.get_nodes()[n].exit == cfg.get_nodes()[n].exit;
+                for (size_t k = 0; same && k < a.size(); k++) {
+                    same = a[k].op == b[k].op && same_operand(a[k].operand1, b[k].operand1) &&
+                           same_operand(a[k].operand2, b[k].operand2);
+                }
+            }
+            for (const auto& [id, func] : expected.get_funcs()) {
+                same = same && cfg.get_funcs().contains(id) && cfg.get_funcs().at(id).node_id == func.node_id &&
+                       cfg.get_funcs().at(id).params.size() == func.params.size() &&
+                       cfg.get_funcs().at(id).blocks == func.blocks;
+            }
+
+            //the same module can't be imported twice
+            same = same && !cfg.import_module(image);
+            if (!same) {
+                std::cerr << "Test JIR module failed: imported module produced different CFG\n" << err.message()
+                          << expected_err.message() << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        /// CFG error has to point at the token it's about, both for materialized and streamed tokens
+        inline bool error_location() {
+            const std::string source = "int main() {\n    return missing;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            const std::string location = tokenizer.location(cfg.error_token());
+            if (err || cfg.error_token().data() != "missing" || location != "<input>:2:12") {
+                std::cerr << "Test JIR error location failed: got " << location << " at `"
+                          << cfg.error_token().data() << "`\n";
+                return false;
+            }
+            //message is put together from interned parts only when it's reported
+            const std::string message = "Error while parsing expression:\nUnknown identifier in this scope: missing";
+            if (err.message() != message) {
+                std::cerr << "Test JIR error location failed: got message\n" << err.message() << '\n';
+                return false;
+            }
+
+            const auto file = (std::filesystem::temp_directory_path() / "eraxc_test_location.erx").string();
+            std::ofstream {file} << source;
+            eraxc::tokenizer stream_tokenizer {};
+            eraxc::token_stream stream {64};
+            std::thread lexer {eraxc::tokenize_file_to_stream, std::ref(stream_tokenizer), file, std::ref(stream)};
+            eraxc::JIR::CFG streamed {};
+            auto streamed_err = streamed.create(stream);
+            stream.abandon();
+            lexer.join();
+            std::filesystem::remove(file);
+            const std::string streamed_location = stream_tokenizer.location(streamed.error_token());
+            if (streamed_err || streamed_location != file + ":2:12") {
+                std::cerr << "Test JIR error location failed for streamed tokens: got " << streamed_location << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        /// Parser recovers at `;` and `}` after an error, so every error of a file is reported in one run
+        inline bool recovered_errors() {
+            eraxc::tokenizer tokenizer {};
+            auto tokens = tokenizer.tokenize_file("../tests/JIR/files/many_errors.erx");
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            const auto& diagnostics = cfg.get_diagnostics();
+
+            const std::vector<std::pair<u16, u32>> expected {{eraxc::JIR::UNKNOWN_IDENTIFIER, 3},
+                                                             {eraxc::JIR::UNKNOWN_TYPENAME, 8},
+                                                             {eraxc::JIR::UNKNOWN_IDENTIFIER, 9},
+                                                             {eraxc::JIR::UNKNOWN_IDENTIFIER, 15}};
+            bool same = !err && diagnostics.error_count() == expected.size() &&
+                        diagnostics.all().size() == expected.size();
+            for (size_t k = 0; same && k < expected.size(); k++) {
+                const auto& d = diagnostics.all()[k];
+                same = d.what.code == expected[k].first && tokenizer.position(d.begin).line == expected[k].second &&
+                       d.notes.size() == 1;
+            }
+            if (!same) {
+                std::cerr << "Test JIR recovered errors failed, got:\n";
+                diagnostics.print(std::cerr, tokenizer);
+                return false;
+            }
+
+            std::ostringstream json {};
+            diagnostics.print_json(json, tokenizer);
+            const std::string first = "{\"severity\":\"error\",\"code\":\"E0003\",\"message\":\"Error while parsing "
+                                      "expression:\\nUnknown identifier in this scope: unknown_one\"";
+            if (json.str().find(first) == std::string::npos ||
+                json.str().find("\"begin\":{\"line\":3,\"column\":5},\"end\":{\"line\":3,\"column\":20}") ==
+                    std::string::npos) {
+                std::cerr << "Test JIR recovered errors failed, got JSON:\n" << json.str();
+                return false;
+            }
+            return true;
+        }
+
+        /// Successor and predecessor index of branches, of the whole CFG and of function snapshot
+        inline bool branch_edges() {
+            const std::string source = "int main() {\n    u64 c = 2ul;\n    if (c > 13ul) {\n        c += c;\n"
+                                       "    } else {\n        c -= c;\n    }\n    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+
+            //main body, positive branch, negative branch and node after else
+            auto same = [](std::span<const u32> got, std::vector<u32> expected) {
+                return std::equal(got.begin(), got.end(), expected.begin(), expected.end());
+            };
+            const auto& main = cfg.get_funcs().begin()->second;
+            const auto snapshot = cfg.snapshot_function(main);
+            bool ok = err && cfg.get_nodes().size() == 5 && main.node_id == 1;
+            for (size_t n = 0; ok && n < cfg.get_nodes().size(); n++) {
+                ok = same(snapshot.successors(n), {cfg.successors(n).begin(), cfg.successors(n).end()}) &&
+                     same(snapshot.predecessors(n), {cfg.predecessors(n).begin(), cfg.predecessors(n).end()});
+            }
+            ok = ok && same(cfg.successors(1), {2, 3}) && same(cfg.successors(2), {4}) && same(cfg.successors(3), {4}) &&
+                 same(cfg.predecessors(3), {1}) && same(cfg.predecessors(4), {2, 3}) && cfg.predecessors(1).empty() &&
+                 cfg.successors(0).empty() && cfg.successors(4).empty() && cfg.successors(5).empty();
+            if (!ok) {
+                std::cerr << "Test JIR branch edges failed " << err.message() << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        /// Blocks are laid out in reverse post-order with branches falling through to their not taken successor,
+        /// so asm has no jumps to the next block
+        inline bool block_layout() {
+            const std::string source = "int main() {\n    u64 c = 2ul;\n    if (c > 13ul) {\n"
+                                       "        if (c == 14ul) c = 1ul;\n        c += 1ul;\n    }\n"
+                                       "    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+
+            using eraxc::JIR::terminator;
+            const auto& [main_id, main] = *cfg.get_funcs().begin();
+            const auto& nodes = cfg.get_nodes();
+            bool ok = err && nodes.size() == 6 && main.blocks == std::vector<u32> {1, 2, 3, 4, 5} &&
+                      nodes[1].exit.kind == terminator::BRANCH && nodes[1].exit.target == 5 &&
+                      nodes[1].exit.next == 2 && nodes[2].exit.kind == terminator::BRANCH &&
+                      nodes[3].exit == terminator {terminator::JUMP, eraxc::JIR::Operation::NONE, 4} &&
+                      nodes[4].exit == terminator {terminator::JUMP, eraxc::JIR::Operation::NONE, 5} &&
+                      nodes[5].exit.kind == terminator::RETURN;
+
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(main_id, main, cfg, {});
+            ok = ok && code && code.value().find("jmp") == std::string::npos &&
+                 code.value().find(".l1:") == std::string::npos && code.value().find("\nret\n") != std::string::npos;
+            if (!ok) {
+                std::cerr << "Test JIR block layout failed " << err.message() << '\n';
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+
+        /// Snapshot of function `f` of source, the one with parameters
+        inline std::pair<eraxc::JIR::CFG_FuncSnapshot, eraxc::JIR::CFG_Func> parse_f(const std::string& source) {
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            if (!err) return {};
+            for (const auto& [id, func] : cfg.get_funcs()) {
+                if (!func.params.empty()) return {cfg.snapshot_function(func), func};
+            }
+            return {};
+        }
+
+        /// Dominators, phi placement and renaming of a variable assigned in both branches, and taking function out of
+        /// SSA form gives back the same nodes
+        inline bool ssa_form() {
+            const std::string source = "u64 f(u64 a) {\n    u64 c = a;\n    if (c > 13ul) {\n        c += a;\n"
+                                       "    } else {\n        c = 1ul;\n    }\n    return c;\n}\n\n"
+                                       "int main() {\n    return 0i;\n}\n";
+            using eraxc::JIR::Operation;
+            auto [fn, func] = parse_f(source);
+            const auto original = fn;
+            bool ok = func.blocks.size() == 4;
+            if (!ok) {
+                std::cerr << "Test JIR SSA form failed to parse\n";
+                return false;
+            }
+
+            const eraxc::JIR::block_graph graph {fn, func.blocks};
+            const eraxc::JIR::dominator_tree dom {graph};
+            auto same = [](std::span<const u32> got, std::vector<u32> expected) {
+                return std::equal(got.begin(), got.end(), expected.begin(), expected.end());
+            };
+            ok = dom.idom(1) == 0 && dom.idom(2) == 0 && dom.idom(3) == 0 && same(dom.frontier(1), {3}) &&
+                 same(dom.frontier(2), {3}) && dom.frontier(0).empty() && dom.dominates(0, 3) && !dom.dominates(1, 3);
+
+            //phi of `c` at the join takes the version each branch assigned last
+            const auto vars = eraxc::JIR::construct_ssa(fn, func);
+            const auto& join = fn.get_cfg_node(graph.id(3)).body;
+            auto last_assigned = [&](u32 b) {
+                const auto& body = fn.get_cfg_node(graph.id(b)).body;
+                return std::find_if(body.rbegin(), body.rend(), [](const eraxc::JIR::Node& n) {
+                    return writes_operand1(n.op);
+                })->operand1.value;
+            };
+            ok = ok && join.size() > 2 && join[0].op == Operation::PHI && join[1].op == Operation::PHI &&
+                 join[2].op != Operation::PHI && join[0].operand1.value == join[1].operand1.value &&
+                 join[0].operand1.value >= vars.first_version && join[0].operand2.value == last_assigned(1) &&
+                 join[1].operand2.value == last_assigned(2) && join[0].operand2.value != join[1].operand2.value &&
+                 vars.local(join[0].operand2.value) == vars.local(join[1].operand2.value) &&
+                 vars.local(join[0].operand1.value) != eraxc::JIR::ssa_variables::NONE;
+
+            eraxc::JIR::destruct_ssa(fn, func, vars);
+            ok = ok && fn.nodes.size() == original.nodes.size();
+            for (size_t n = 0; ok && n < fn.nodes.size(); n++) {
+                const auto& got = fn.nodes[n].body;
+                const auto& expected = original.nodes[n].body;
+                ok = got.size() == expected.size() && fn.nodes[n].exit == original.nodes[n].exit;
+                for (size_t i = 0; ok && i < got.size(); i++) {
+                    ok = got[i].op == expected[i].op && same_operand(got[i].operand1, expected[i].operand1) &&
+                         same_operand(got[i].operand2, expected[i].operand2);
+                }
+            }
+            if (!ok) {
+                std::cerr << "Test JIR SSA form failed\n";
+                return false;
+            }
+            return true;
+        }
+
+        /// Versions a pass made live at the same time get variables of their own, and phi copy on the critical
+        /// edge from the branch gets a block of its own
+        inline bool ssa_interference() {
+            const std::string source = "u64 f(u64 a) {\n    u64 c = a;\n    if (c > 13ul) {\n        c += a;\n"
+                                       "    }\n    return c;\n}\n\nint main() {\n    return 0i;\n}\n";
+            using eraxc::JIR::Operation;
+            using eraxc::JIR::terminator;
+            auto [fn, func] = parse_f(source);
+            if (func.blocks.size() != 3) {
+                std::cerr << "Test JIR SSA interference failed to parse\n";
+                return false;
+            }
+            const u32 entry = func.blocks[0];
+            const u32 join = func.blocks[2];
+            const auto& parsed_entry = fn.get_cfg_node(entry).body;
+            const auto c = std::find_if(parsed_entry.begin(), parsed_entry.end(), [](const eraxc::JIR::Node& n) {
+                return n.op == Operation::ALLOC;
+            })->operand1;
+
+            //value of `c` from before the branch stays live after the phi joining it with the updated one
+            const auto vars = eraxc::JIR::construct_ssa(fn, func);
+            auto& body = fn.get_cfg_node(join).body;
+            bool ok = body.size() > 2 && body[0].op == Operation::PHI && body[1].op == Operation::PHI;
+            if (ok) body.insert(body.begin() + 2, {Operation::CMP, body[0].operand1, body[0].operand2});
+            const size_t nodes = fn.nodes.size();
+            eraxc::JIR::destruct_ssa(fn, func, vars);
+
+            const u32 middle = u32(fn.first_node_id + nodes);
+            const auto& split = fn.get_cfg_node(middle);
+            const terminator& branch = fn.get_cfg_node(entry).exit;
+            ok = ok && fn.nodes.size() == nodes + 1 && func.blocks.size() == 4 && split.body.size() == 1 &&
+                 split.body[0].op == Operation::MOVE && split.body[0].operand2.value == c.value &&
+                 split.body[0].operand1.value != c.value &&
+                 split.exit == terminator {terminator::JUMP, Operation::NONE, join} &&
+                 (branch.target == middle || branch.next == middle) && branch.target != join && branch.next != join &&
+                 fn.predecessors(join).size() == 2;
+            //copy is allocated right after `c`
+            const auto& entry_body = fn.get_cfg_node(entry).body;
+            for (size_t n = 0; ok && n + 1 < entry_body.size(); n++) {
+                if (entry_body[n].op != Operation::ALLOC || entry_body[n].operand1.value != c.value) continue;
+                ok = entry_body[n + 1].op == Operation::ALLOC &&
+                     entry_body[n + 1].operand1.value == split.body[0].operand1.value;
+            }
+            for (const auto& node : fn.nodes) {
+                ok = ok && std::none_of(node.body.begin(), node.body.end(), [](const eraxc::JIR::Node& n) {
+                    return n.op == Operation::PHI;
+                });
+            }
+            if (!ok) {
+                std::cerr << "Test JIR SSA interference failed\n";
+                return false;
+            }
+            return true;
+        }
+
+        /// Value and variable nothing reads go at level 1 along with temporaries computing them, level 0 keeps them
+        inline bool dead_code() {
+            const std::string source = "u64 f(u64 a) {\n    u64 unused = a * 3ul;\n    u64 c = a + 1ul;\n"
+                                       "    if (c > 13ul) {\n        c += a;\n    } else {\n        c = 1ul;\n"
+                                       "        unused = 5ul;\n    }\n    return c;\n}\n\n"
+                                       "int main() {\n    return 0i;\n}\n";
+            using eraxc::JIR::Operation;
+            auto [kept, kept_func] = parse_f(source);
+            auto [fn, func] = parse_f(source);
+            if (func.blocks.size() != 4) {
+                std::cerr << "Test JIR dead code failed to parse\n";
+                return false;
+            }
+            const u64 unused = fn.get_cfg_node(func.blocks[0]).body[0].operand1.value;
+            eraxc::JIR::run_function_passes(kept, kept_func, 0);
+            eraxc::JIR::run_function_passes(fn, func, 1);
+
+            auto count = [](const eraxc::JIR::CFG_FuncSnapshot& snapshot, auto&& matches) {
+                size_t n = 0;
+                for (const auto& node : snapshot.nodes) n += std::count_if(node.body.begin(), node.body.end(), matches);
+                return n;
+            };
+            auto is_mul = [](const eraxc::JIR::Node& n) { return n.op == Operation::MUL; };
+            auto refers_unused = [&](const eraxc::JIR::Node& n) {
+                return (!n.operand1.is_instant && n.operand1.value == unused) ||
+                       (!n.operand2.is_instant && n.operand2.value == unused);
+            };
+            auto any = [](const eraxc::JIR::Node&) { return true; };
+            //`unused` and the temporary of `a * 3ul` lose their ALLOC, DEALLOC and every assignment, and so does the
+            //temporary of `13ul` once it's propagated into CMP
+            bool ok = count(kept, is_mul) == 1 && count(kept, refers_unused) == 4 && count(fn, is_mul) == 0 &&
+                      count(fn, refers_unused) == 0 && count(fn, any) + 11 == count(kept, any) &&
+                      count(fn, [](const eraxc::JIR::Node& n) { return n.op == Operation::CMP; }) == 1 &&
+                      count(fn, [](const eraxc::JIR::Node& n) { return n.op == Operation::PASS_RET; }) == 1;
+
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(0, func, fn, {});
+            ok = ok && code && code.value().find("imul") == std::string::npos;
+            if (!ok) {
+                std::cerr << "Test JIR dead code failed\n";
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+
+        /// CFG pass empties blocks nothing jumps to and drops their edges
+        inline bool dead_code_pass() {
+            const std::string source = "u64 f(u64 a) {\n    u64 c = a * 2ul;\n    u64 d = c + a;\n"
+                                       "    if (c > 13ul) {\n        return c;\n        d = 2ul;\n    }\n"
+                                       "    return d;\n}\n\nint main() {\n    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+
+            //function entry, both returns and the block after `return c;`
+            const auto& nodes = cfg.get_nodes();
+            const std::vector<u32> blocks = {1, 2, 4};
+            bool ok = err && nodes.size() == 6 && !nodes[3].body.empty() && cfg.successors(3).size() == 1;
+            cfg.dead_code_elimination_pass();
+            for (const auto& [id, func] : cfg.get_funcs()) {
+                if (func.node_id == 1) ok = ok && func.blocks == blocks;
+            }
+            ok = ok && nodes.size() == 6 && nodes[3].body.empty() &&
+                 nodes[3].exit.kind == eraxc::JIR::terminator::NONE && cfg.successors(3).empty() &&
+                 cfg.predecessors(4).size() == 1 && cfg.successors(1).size() == 2 && !nodes[1].body.empty();
+            if (!ok) {
+                std::cerr << "Test JIR dead code pass failed " << err.message() << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        /// Constant expression folds into a single MOVE, and branch on it becomes a jump with the other branch gone
+        inline bool constant_folding() {
+            const std::string source = "u64 f(u64 a) {\n    u64 c = (1ul + 2ul) * 256ul;\n    if (c > 13ul) {\n"
+                                       "        c += a;\n    } else {\n        c = 1ul;\n    }\n    return c;\n}\n\n"
+                                       "int main() {\n    return 0i;\n}\n";
+            using eraxc::JIR::Operation;
+            using eraxc::JIR::terminator;
+            auto [fn, func] = parse_f(source);
+            if (func.blocks.size() != 4) {
+                std::cerr << "Test JIR constant folding failed to parse\n";
+                return false;
+            }
+            eraxc::JIR::run_function_passes(fn, func, 1);
+
+            size_t folded = 0;
+            bool ok = func.blocks.size() == 3;
+            for (const u32 b : func.blocks) {
+                const auto& node = fn.get_cfg_node(b);
+                ok = ok && node.exit.kind != terminator::BRANCH;
+                for (const auto& n : node.body) {
+                    //`c = 1ul` is in the branch that can't be taken
+                    const bool else_branch = n.op == Operation::MOVE && n.operand2.is_instant && n.operand2.value == 1;
+                    ok = ok && n.op != Operation::MUL && n.op != Operation::CMP && !else_branch;
+                    folded += n.op == Operation::MOVE && n.operand2.is_instant && n.operand2.value == 768;
+                }
+            }
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(0, func, fn, {});
+            ok = ok && folded == 1 && code && code.value().find("imul") == std::string::npos &&
+                 code.value().find("cmp") == std::string::npos;
+            if (!ok) {
+                std::cerr << "Test JIR constant folding failed\n";
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+
+        /// Globals initialized with constants are data at level 1, with no initialization code left to call
+        inline bool static_globals() {
+            const std::string source = "i64 global = 2l + 2l;\nu32 other;\n\nint main() {\n    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            if (!err) {
+                std::cerr << "Test JIR static globals failed to parse " << err.message() << '\n';
+                return false;
+            }
+            std::stringstream parsed;
+            std::stringstream folded;
+            const bool printed = eraxc::asm_translator<eraxc::X64> {}.print_prologue(cfg, parsed, 0) &&
+                                 eraxc::asm_translator<eraxc::X64> {}.print_prologue(cfg, folded, 1);
+            const bool ok = printed && parsed.str().find("call $f_0") != std::string::npos &&
+                            parsed.str().find(" dq 0\n") != std::string::npos &&
+                            folded.str().find(" dq 4\n") != std::string::npos &&
+                            folded.str().find(" dq 0\n") == std::string::npos &&
+                            folded.str().find(" dd 0\n") != std::string::npos &&
+                            folded.str().find("$f_0") == std::string::npos;
+            if (!ok) {
+                std::cerr << "Test JIR static globals failed\n" << folded.str();
+                return false;
+            }
+            return true;
+        }
+        /// Few variables all get registers, and the one live across the call gets a callee-saved register the
+        /// function pushes on entry and pops before return
+        inline bool register_allocation() {
+            const std::string source = "u64 id(u64 x) {\n    return x;\n}\n\nu64 f(u64 a, u64 c) {\n"
+                                       "    u64 b = a * 3ul;\n    u64 r = id(c);\n    return r + b;\n}\n\n"
+                                       "int main() {\n    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            const auto f = std::find_if(cfg.get_funcs().begin(), cfg.get_funcs().end(),
+                                        [](const auto& entry) { return entry.second.params.size() == 2; });
+            if (!err || f == cfg.get_funcs().end()) {
+                std::cerr << "Test JIR register allocation failed to parse\n";
+                return false;
+            }
+            const eraxc::JIR::CFG_Func& func = f->second;
+            const auto fn = cfg.snapshot_function(func);
+            const auto allocation = eraxc::allocate_registers(func, fn);
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(0, func, fn, {});
+            bool ok = code && allocation.registers.contains(func.params[0].value) && allocation.saved.size() == 1;
+            if (ok) {
+                const std::string saved = eraxc::reg_name(allocation.saved[0], 8);
+                const std::string& asm_code = code.value();
+                ok = asm_code.find("push " + saved) < asm_code.find("call") &&
+                     asm_code.find("pop " + saved) > asm_code.find("call") &&
+                     asm_code.find("[rsp") == std::string::npos;
+            }
+            if (!ok) {
+                std::cerr << "Test JIR register allocation failed\n";
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+        /// Variables live across a call outnumber callee-saved registers, so some stay on stack, in aligned slots of
+        /// one frame allocated on entry that keeps the call 16-byte aligned
+        inline bool stack_frame() {
+            std::string source = "u64 id(u64 x) {\n    return x;\n}\n\nu64 f(u64 a, u64 c) {\n";
+            std::string sum = "r";
+            for (int v = 1; v <= 8; v++) {
+                source += "    u64 v" + std::to_string(v) + " = a * " + std::to_string(v + 1) + "ul;\n";
+                sum += " + v" + std::to_string(v);
+            }
+            source += "    u64 r = id(c);\n    return " + sum + ";\n}\n\nint main() {\n    return 0i;\n}\n";
+            eraxc::tokenizer tokenizer {};
+            std::stringstream ss {source};
+            auto tokens = tokenizer.tokenize(ss);
+            eraxc::JIR::CFG cfg {};
+            auto err = cfg.create(tokens.value);
+            const auto f = std::find_if(cfg.get_funcs().begin(), cfg.get_funcs().end(),
+                                        [](const auto& entry) { return entry.second.params.size() == 2; });
+            if (!err || f == cfg.get_funcs().end()) {
+                std::cerr << "Test JIR stack frame failed to parse\n";
+                return false;
+            }
+            const auto fn = cfg.snapshot_function(f->second);
+            const auto allocation = eraxc::allocate_registers(f->second, fn);
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(0, f->second, fn, {});
+
+            bool ok = code && !allocation.slots.empty() &&
+                      (allocation.frame_size + 8 * (allocation.saved.size() + 1)) % 16 == 0;
+            for (const auto& [var, offset] : allocation.slots) {
+                ok = ok && offset % 8 == 0 && offset + 8 <= allocation.frame_size;
+            }
+            if (ok) {
+                const std::string& asm_code = code.value();
+                const size_t sub = asm_code.find("sub rsp, ");
+                ok = sub != std::string::npos && asm_code.find("sub rsp", sub + 1) == std::string::npos &&
+                     asm_code.find("add rsp, " + std::to_string(allocation.frame_size)) != std::string::npos;
+            }
+            if (!ok) {
+                std::cerr << "Test JIR stack frame failed\n";
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+        /// Copy and addition make lea, division by constants is multiplication by magic numbers with no div left,
+        /// shifts right follow signedness, and negation is one-operand neg
+        inline bool instruction_selection() {
+            const std::string source = "u64 f(u64 a, i64 b) {\n    u64 c = a;\n    c += 8ul;\n    a /= 10ul;\n"
+                                       "    b /= 7l;\n    b >>= 2l;\n    a >>= 3ul;\n    i64 d = -b;\n"
+                                       "    return a + c;\n}\n\nint main() {\n    return 0i;\n}\n";
+            auto [fn, func] = parse_f(source);
+            if (func.blocks.empty()) {
+                std::cerr << "Test JIR instruction selection failed to parse\n";
+                return false;
+            }
+            auto code = eraxc::asm_translator<eraxc::X64>::translate_function(0, func, fn, {});
+            bool ok = bool(code);
+            if (ok) {
+                const std::string& asm_code = code.value();
+                auto has = [&](const std::string& part) { return asm_code.find(part) != std::string::npos; };
+                ok = has("lea ") && has("+8]") && has("0xcccccccccccccccd") && has("mul ") && has("imul ") &&
+                     !has("div ") && has("sar ") && has("shr ") && has("neg ") && !has("neg rax,");
+            }
+            if (!ok) {
+                std::cerr << "Test JIR instruction selection failed\n";
+                if (code) std::cerr << code.value();
+                return false;
+            }
+            return true;
+        }
+        /// Every peephole rule rewrites its pattern once, rules enabled by other rewrites included, and `mov reg, 0`
+        /// stays between compare and the jump reading its flags
+        inline bool peephole() {
+            eraxc::x86_code code;
+            code.label("$f_0");
+            code.emit("mov", "QWORD[rsp+8]", "rax");
+            code.emit("mov", "rax", "QWORD[rsp+8]");
+            code.emit("add", "rsp", 0);
+            code.emit("mov", "r10d", 0);
+            code.emit("cmp", "r10d", 0);
+            code.emit("jne", ".l2");
+            code.emit("mov", "rax", 0);
+            code.emit("jmp", ".l1");
+            code.label(".l1");
+            code.emit("cmp", "rsi", "rdi");
+            code.emit("mov", "ecx", 0);
+            code.emit("je", ".l1");
+            code.label(".l2");
+            code.emit("ret");
+            const auto stats = eraxc::peephole(code);
+            std::stringstream printed;
+            code.print(printed);
+            const std::string expected = "$f_0:\nmov QWORD[rsp+8], rax\nxor r10d, r10d\ntest r10d, r10d\njne .l2\n"
+                                         "xor eax, eax\n.l1:\ncmp rsi, rdi\nmov ecx, 0\nje .l1\n.l2:\nret\n";
+            bool ok = printed.str() == expected && stats.hits == decltype(stats.hits) {1, 1, 1, 2, 1};
+
+            //pass runs over functions from level 1
+            auto [fn, func] = parse_f("u64 f(u64 a) {\n    return 0ul;\n}\n\nint main() {\n    return 0i;\n}\n");
+            eraxc::peephole_stats hits {};
+            auto translated = eraxc::asm_translator<eraxc::X64>::translate_function(0, func, fn, {}, 1, &hits);
+            ok = ok && translated && translated.value().find("xor eax, eax") != std::string::npos && hits.hits[3] == 1;
+            if (!ok) {
+                std::cerr << "Test JIR peephole failed\n" << printed.str();
+                if (translated) std::cerr << translated.value();
+                return false;
+            }
+            return true;
+        }
     }
 
     inline int test_jir() {
         int successful_tests = 0;
         if (JIR::global_no_main()) successful_tests++;
+        if (JIR::streamed_tokens()) successful_tests++;
+        if (JIR::imported_module()) successful_tests++;
+        if (JIR::error_location()) successful_tests++;
+        if (JIR::recovered_errors()) successful_tests++;
+        if (JIR::branch_edges()) successful_tests++;
+        if (JIR::block_layout()) successful_tests++;
+        if (JIR::ssa_form()) successful_tests++;
+        if (JIR::ssa_interference()) successful_tests++;
+        if (JIR::dead_code()) successful_tests++;
+        if (JIR::dead_code_pass()) successful_tests++;
+        if (JIR::constant_folding()) successful_tests++;
+        if (JIR::static_globals()) successful_tests++;
+        if (JIR::register_allocation()) successful_tests++;
+        if (JIR::stack_frame()) successful_tests++;
+        if (JIR::instruction_selection()) successful_tests++;
+        if (JIR::peephole()) successful_tests++;
 
 
         return ALL_TESTS_JIR - successful_tests;
@@ -4,6 +4,7 @@
 #ifdef TEST
 
 #include "test_preprocessor.h"
+#include "test_compile_cache.h"
 
 #endif
 #include "JIR/test_jir.h"
@@ -28,6 +29,14 @@ bool test_all() {
         std::cout << "JIR and CFG generators passed all tests!\n";
     }
 
+    int cache = tests::test_compile_cache();
+    if (cache != 0) {
+        std::cout << "Compile cache failed " << cache << "/" << ALL_TESTS_COMPILE_CACHE << " tests\n";
+        return false;
+    } else {
+        std::cout << "Compile cache passed all tests!\n";
+    }
+
     std::cerr.flush();
     std::cout.flush();
 
@@ -0,0 +1,72 @@
+#ifndef ERAXC_TEST_COMPILE_CACHE_H
+#define ERAXC_TEST_COMPILE_CACHE_H
+
+#include <filesystem>
+#include <fstream>
+
+#include "../src/frontend/lexic/preprocessor_tokenizer.h"
+#include "../src/util/compile_cache.h"
+
+#define ALL_TESTS_COMPILE_CACHE 2
+
+namespace tests {
+
+    inline std::string cache_key_of(const std::string& source) {
+        eraxc::tokenizer t {};
+        auto& buffer = t.sources.emplace_back(source);
+        auto tokens = t.tokenize_view(buffer);
+        return eraxc::compile_cache_key(tokens.value, t.defined, "test");
+    }
+
+    /// Key depends on tokens and macros only, not on formatting
+    inline bool test_cache_key() {
+        const std::string base = cache_key_of("int main() {\n    return 0i;\n}\n");
+        if (base != cache_key_of("//entrypoint\nint   main(){return 0i;}")) {
+            std::cerr << "Compile cache test 1 failed: formatting changed the key" << std::endl;
+            return false;
+        }
+        if (base == cache_key_of("int main() {\n    return 1i;\n}\n") ||
+            base == cache_key_of("#define DEBUG\nint main() {\n    return 0i;\n}\n")) {
+            std::cerr << "Compile cache test 1 failed: different program has the same key" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /// Entries are evicted least recently used first and survive reopening of cache
+    inline bool test_cache_lru() {
+        const auto dir = std::filesystem::temp_directory_path() / "eraxc_test_compile_cache";
+        const std::string output = (std::filesystem::temp_directory_path() / "eraxc_test_output").string();
+        std::filesystem::remove_all(dir);
+        std::ofstream {output + ".asm"} << std::string(100, 'x');
+
+        bool passed;
+        {
+            //room for two entries only
+            eraxc::compile_cache cache {dir, 250, {".asm"}};
+            cache.store("a", output);
+            cache.store("b", output);
+            cache.fetch("a", output);
+            cache.store("c", output);
+            passed = cache.fetch("a", output) && !cache.fetch("b", output) && cache.fetch("c", output) &&
+                     cache.stats().evictions == 1 && cache.stats().hits == 3 && cache.stats().misses == 1;
+        }
+        {
+            eraxc::compile_cache reopened {dir, 250, {".asm"}};
+            passed = passed && reopened.fetch("a", output) && reopened.fetch("c", output);
+        }
+        std::filesystem::remove_all(dir);
+        std::filesystem::remove(output + ".asm");
+        if (!passed) std::cerr << "Compile cache test 2 failed: wrong entries evicted" << std::endl;
+        return passed;
+    }
+
+    inline int test_compile_cache() {
+        int successful_tests = 0;
+        if (test_cache_key()) successful_tests++;
+        if (test_cache_lru()) successful_tests++;
+        return ALL_TESTS_COMPILE_CACHE - successful_tests;
+    }
+}
+
+#endif  //ERAXC_TEST_COMPILE_CACHE_H
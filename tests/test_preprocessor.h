@@ -1,11 +1,74 @@
 #ifndef ERAXC_TEST_PREPROCESSOR_H
 #define ERAXC_TEST_PREPROCESSOR_H
 
+#include <random>
+
 #include "../src/frontend/lexic/preprocessor_tokenizer.h"
 
-#define ALL_TESTS_PREPROCESSOR 4
+#define ALL_TESTS_PREPROCESSOR 13
 
 namespace tests {
+    /// Random source made of long identifier, number, whitespace and comment runs mixed with random bytes
+    inline std::string random_source(std::mt19937& rng, size_t pieces) {
+        static const std::string ident_chars = "abcxyzABCXYZ_-0123456789";
+        static const std::string other_chars = "+-*/<>=!&|^%~?()[]{};:.,\"'$@\\";
+        std::string src;
+        auto rand = [&](size_t n) { return size_t(rng() % n); };
+        for (size_t i = 0; i < pieces; i++) {
+            switch (rand(7)) {
+                case 0:
+                    src += "_abc"[rand(4)];
+                    for (size_t n = rand(80); n > 0; n--) src += ident_chars[rand(ident_chars.size())];
+                    break;
+                case 1:
+                    for (size_t n = rand(40) + 1; n > 0; n--) src += " \t\n\r"[rand(4)];
+                    break;
+                case 2:
+                    src += "//";
+                    for (size_t n = rand(100); n > 0; n--) src += char(rand(2) ? ' ' + rand(95) : 0x80 + rand(128));
+                    if (rand(8)) src += '\n';
+                    break;
+                case 3:
+                    for (size_t n = rand(40) + 1; n > 0; n--) src += "0123456789uli"[rand(13)];
+                    break;
+                case 4: src += other_chars[rand(other_chars.size())]; break;
+                case 5: src += char(0x80 + rand(128)); break;
+                default: src += ' '; break;
+            }
+        }
+        return src;
+    }
+
+    /// Every SIMD scanning level has to produce exactly the same tokens as scalar one
+    inline bool test_simd_scan_fuzz() {
+        std::mt19937 rng {0xE4A8C};
+        for (int iteration = 0; iteration < 500; iteration++) {
+            eraxc::tokenizer t {};
+            auto& buffer = t.sources.emplace_back(random_source(rng, 1 + rng() % 400));
+
+            t.set_simd_level(eraxc::lexic::simd_level::SCALAR);
+            auto expected = t.tokenize_view(buffer);
+
+            for (auto level : {eraxc::lexic::simd_level::SSE2, eraxc::lexic::simd_level::AVX2}) {
+                t.set_simd_level(level);
+                auto got = t.tokenize_view(buffer);
+                bool same = got.error == expected.error && got.value.size() == expected.value.size();
+                for (size_t i = 0; same && i < got.value.size(); i++) {
+                    //views into one buffer have to be the same char ranges, not just equal strings
+                    same = got.value[i].t == expected.value[i].t &&
+                           got.value[i].data.data() == expected.value[i].data.data() &&
+                           got.value[i].data.size() == expected.value[i].data.size();
+                }
+                if (!same) {
+                    std::cerr << "Test 5 failed: simd level " << int(level) << " differs from scalar on iteration "
+                              << iteration << " source:\n" << buffer.view() << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
     inline int test_preprocessor_tokenizer() {
         std::cerr << "Running preprocessor tokenizer tests..." << std::endl;
 
@@ -23,12 +86,12 @@ namespace tests {
             if (r1.value != res1) {
                 std::cerr << "Expected content: " << std::endl;
                 for (const auto &i : res1) {
-                    std::cerr << i.data << " ";
+                    std::cerr << i.data() << " ";
                 }
                 std::cerr << std::endl;
                 std::cerr << "Got content: " << std::endl;
                 for (const auto &i : r1.value) {
-                    std::cerr << i.data << " ";
+                    std::cerr << i.data() << " ";
                 }
                 std::cerr << std::endl;
             } else {
@@ -47,7 +110,7 @@ namespace tests {
             bool is_passed = true;
             for (const auto &i : r2.value) {
                 if (i.t != eraxc::token::type::OPERATOR) {
-                    std::cerr << "Test 2 failed: types dont match for \"" << i.data << "\" operator" << std::endl;
+                    std::cerr << "Test 2 failed: types dont match for \"" << i.data() << "\" operator" << std::endl;
                     is_passed = false;
                     break;
                 };
@@ -86,8 +149,8 @@ namespace tests {
                 bool is_passed = true;
                 for (size_t i = 0; i < res3.size(); ++i) {
                     if (r3.value[i].t != res3[i]) {
-                        std::cerr << "Test 3 failed: type mismatch at position " << i << " - expected: " << res3[i]
-                                  << ", got: " << r3.value[i].t << std::endl;
+                        std::cerr << "Test 3 failed: type mismatch at position " << i << " - expected: " << int(res3[i])
+                                  << ", got: " << int(r3.value[i].t) << std::endl;
                         is_passed = false;
                         break;
                     }
@@ -435,15 +498,15 @@ namespace tests {
             } else {
                 bool is_passed = true;
                 for (size_t i = 0; i < res4.size(); ++i) {
-                    if (r4.value[i].data != res4[i].data) {
-                        std::cerr << "Test 4 failed: data mismatch at position " << i << " - expected: " << res4[i].data
-                                  << ", got: " << r4.value[i].data << std::endl;
+                    if (r4.value[i].data() != res4[i].data()) {
+                        std::cerr << "Test 4 failed: data mismatch at position " << i
+                                  << " - expected: " << res4[i].data() << ", got: " << r4.value[i].data() << std::endl;
                         is_passed = false;
                         break;
                     }
                     if (r4.value[i].t != res4[i].t) {
-                        std::cerr << "Test 4 failed: type mismatch at position " << i << " - expected: " << res4[i].data
-                                  << ", got: " << r4.value[i].data << std::endl;
+                        std::cerr << "Test 4 failed: type mismatch at position " << i
+                                  << " - expected: " << res4[i].data() << ", got: " << r4.value[i].data() << std::endl;
                         is_passed = false;
                         break;
                     }
@@ -455,6 +518,139 @@ namespace tests {
             }
         }
 
+        //test 5 - SIMD and scalar scanners fuzz
+        if (test_simd_scan_fuzz()) {
+            std::cerr << "Test 5 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 6 - #include
+        eraxc::tokenizer t6 {};
+        auto r6 = t6.tokenize_file("../tests/files/preprocessor_include.erx");
+        if (!r6) {
+            std::cerr << "Test 6 for preprocessor tokenizer failed with error: " << r6.error << std::endl;
+        } else if (r6.value != res1) {
+            std::cerr << "Test 6 failed: included file content differs from its own content" << std::endl;
+        } else {
+            std::cerr << "Test 6 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 7 - include cycle
+        eraxc::tokenizer t7 {};
+        auto r7 = t7.tokenize_file("../tests/files/preprocessor_cycle_include.erx");
+        if (r7 || r7.error.find("Include cycle") == std::string::npos) {
+            std::cerr << "Test 7 failed: expected include cycle error, got: " << r7.error << std::endl;
+        } else {
+            std::cerr << "Test 7 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 8 - guarded file is included once, unguarded one twice, both are read once
+        eraxc::tokenizer t8 {};
+        auto r8 = t8.tokenize_file("../tests/files/preprocessor_include_twice.erx");
+        std::vector<eraxc::token> res8 {{eraxc::token::IDENTIFIER, "guarded_content"},
+                                        {eraxc::token::IDENTIFIER, "unguarded_content"},
+                                        {eraxc::token::IDENTIFIER, "unguarded_content"},
+                                        {eraxc::token::IDENTIFIER, "end"}};
+        if (!r8) {
+            std::cerr << "Test 8 for preprocessor tokenizer failed with error: " << r8.error << std::endl;
+        } else if (r8.value != res8 || t8.included.size() != 2 || t8.sources.size() != 3) {
+            std::cerr << "Test 8 failed: wrong content or files read more than once" << std::endl;
+        } else {
+            std::cerr << "Test 8 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 9 - nested #if #ifdef #ifndef #else #endif
+        eraxc::tokenizer t9 {};
+        auto r9 = t9.tokenize_file("../tests/files/preprocessor_conditional.erx");
+        std::vector<eraxc::token> res9 {{eraxc::token::IDENTIFIER, "a"}, {eraxc::token::IDENTIFIER, "b"},
+                                        {eraxc::token::IDENTIFIER, "c"}, {eraxc::token::IDENTIFIER, "d"},
+                                        {eraxc::token::IDENTIFIER, "e"}};
+        if (!r9) {
+            std::cerr << "Test 9 for preprocessor tokenizer failed with error: " << r9.error << std::endl;
+        } else if (r9.value != res9) {
+            std::cerr << "Test 9 failed: wrong branches taken, got:" << std::endl;
+            for (const auto& i : r9.value) std::cerr << i.data() << " ";
+            std::cerr << std::endl;
+        } else {
+            std::cerr << "Test 9 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 10 - unbalanced conditionals
+        bool passed10 = true;
+        for (std::string src : {"#else\n", "#endif\n", "#ifdef x\na\n", "#ifndef x\na\n#else\nb\n#else\n#endif",
+                                "#if 1 2\n#endif\n", "#ifndef x\n#endif\n#endif\n"}) {
+            eraxc::tokenizer t10 {};
+            std::stringstream ss10 {src};
+            if (t10.tokenize(ss10)) {
+                std::cerr << "Test 10 failed: no error for:\n" << src << std::endl;
+                passed10 = false;
+            }
+        }
+        if (passed10) {
+            std::cerr << "Test 10 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 11 - object-like and function-like macros, macro isn't expanded inside of itself
+        eraxc::tokenizer t11 {};
+        auto r11 = t11.tokenize_file("../tests/files/preprocessor_macro.erx");
+        const eraxc::token l {eraxc::token::L_BRACKET, "("}, r {eraxc::token::R_BRACKET, ")"};
+        const eraxc::token plus {eraxc::token::OPERATOR, "+"};
+        const eraxc::token two {eraxc::token::INSTANT, "2"}, three {eraxc::token::INSTANT, "3"};
+        std::vector<eraxc::token> res11 {two, plus, three,
+                                         l, l, two, plus, three, r, plus, l, two, plus, three, r, r,
+                                         {eraxc::token::IDENTIFIER, "SELF"}, plus, {eraxc::token::INSTANT, "1"},
+                                         {eraxc::token::IDENTIFIER, "ADD"}, plus, {eraxc::token::IDENTIFIER, "FLAG"},
+                                         {eraxc::token::INSTANT, "0"},
+                                         l, l, {eraxc::token::IDENTIFIER, "f"}, l, {eraxc::token::INSTANT, "1"},
+                                         {eraxc::token::COMMA, ","}, two, r, r, plus, l, three, r, r};
+        if (!r11) {
+            std::cerr << "Test 11 for preprocessor tokenizer failed with error: " << r11.error << std::endl;
+        } else if (r11.value != res11) {
+            std::cerr << "Test 11 failed: wrong expansion, got:" << std::endl;
+            for (const auto& i : r11.value) std::cerr << i.data() << " ";
+            std::cerr << std::endl;
+        } else {
+            std::cerr << "Test 11 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 12 - bad macro calls and definitions
+        bool passed12 = true;
+        for (std::string src : {"#define F(a) a\nF(1", "#define F(a, b) a\nF(1)", "#define F() 1\nF(2)",
+                                "#define F(a b) a\n", "#define F(a a\n", "#define F(a) #a\n"}) {
+            eraxc::tokenizer t12 {};
+            std::stringstream ss12 {src};
+            if (t12.tokenize(ss12)) {
+                std::cerr << "Test 12 failed: no error for:\n" << src << std::endl;
+                passed12 = false;
+            }
+        }
+        if (passed12) {
+            std::cerr << "Test 12 passed" << std::endl;
+            passed_tests++;
+        }
+
+        //test 13 - token positions are turned into line and column, expanded tokens point into macro definition
+        eraxc::tokenizer t13 {};
+        std::stringstream ss13 {"#define TWO 2\na\n  bb TWO\n\tccc"};
+        auto r13 = t13.tokenize(ss13);
+        const std::vector<std::string> res13 {"<input>:2:1", "<input>:3:3", "<input>:1:13", "<input>:4:2"};
+        std::vector<std::string> locations13 {};
+        for (const auto& i : r13.value) locations13.push_back(t13.location(i));
+        if (!r13 || locations13 != res13 || r13.value[1].flags != 0 || r13.value[2].flags != eraxc::token::FROM_MACRO) {
+            std::cerr << "Test 13 failed: wrong token positions, got:" << std::endl;
+            for (const auto& i : locations13) std::cerr << i << " ";
+            std::cerr << std::endl;
+        } else {
+            std::cerr << "Test 13 passed" << std::endl;
+            passed_tests++;
+        }
+
         return ALL_TESTS_PREPROCESSOR - passed_tests;
     }
 }